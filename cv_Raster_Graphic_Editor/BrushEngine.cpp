@@ -0,0 +1,463 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file BrushEngine.cpp
+ * @brief Implementation of the BrushEngine class
+ *
+ * This class turns mouse samples into continuous, anti-aliased, variable-width brush strokes
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "BrushEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Range of x for which lo <= a * x + b <= hi
+ * @param[in] a slope
+ * @param[in] b offset
+ * @param[in] lo lower bound
+ * @param[in] hi upper bound
+ * @param[out] xMin start of the range
+ * @param[out] xMax end of the range, smaller than xMin if the range is empty
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static void linearRange(float a, float b, float lo, float hi, float &xMin, float &xMax)
+{
+    if (fabs(a) < 1e-6f)
+    {
+        bool inside = (b >= lo && b <= hi);
+        xMin = inside ? -numeric_limits<float>::max() : 1.0f;
+        xMax = inside ? numeric_limits<float>::max() : 0.0f;
+        return;
+    }
+
+    float p = (lo - b) / a;
+    float q = (hi - b) / a;
+    xMin = min(p, q);
+    xMax = max(p, q);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Span of a capsule of constant radius on one image row
+ *
+ * The capsule is the union of the two end disks and the rectangle swept between them, and its intersection with a
+ * row is a single interval because the capsule is convex.
+ *
+ * @param[in] segment segment defining the capsule axis
+ * @param[in] radius capsule radius
+ * @param[in] y row coordinate
+ * @param[out] xMin start of the span
+ * @param[out] xMax end of the span
+ * @return false if the row does not intersect the capsule
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static bool capsuleSpan(const BrushSegment &segment, float radius, float y, float &xMin, float &xMax)
+{
+    bool found = false;
+    xMin = numeric_limits<float>::max();
+    xMax = -numeric_limits<float>::max();
+    if (radius <= 0)
+    {
+        return false;
+    }
+
+    // end disks
+    const Point2f ends[2] = {segment.start, segment.end};
+    for (int i = 0; i < 2; i++)
+    {
+        float dy = y - ends[i].y;
+        if (fabs(dy) <= radius)
+        {
+            float halfWidth = sqrt(radius * radius - dy * dy);
+            xMin = min(xMin, ends[i].x - halfWidth);
+            xMax = max(xMax, ends[i].x + halfWidth);
+            found = true;
+        }
+    }
+
+    // swept rectangle: perpendicular distance within the radius and projection within the segment
+    Point2f axis = segment.end - segment.start;
+    float length = sqrt(axis.x * axis.x + axis.y * axis.y);
+    if (length > 1e-6f)
+    {
+        float ux = axis.x / length;
+        float uy = axis.y / length;
+        float dy = y - segment.start.y;
+        float acrossMin, acrossMax, alongMin, alongMax;
+        linearRange(uy, -dy * ux - segment.start.x * uy, -radius, radius, acrossMin, acrossMax);
+        linearRange(ux, dy * uy - segment.start.x * ux, 0, length, alongMin, alongMax);
+        float rectMin = max(acrossMin, alongMin);
+        float rectMax = min(acrossMax, alongMax);
+        if (rectMin <= rectMax)
+        {
+            xMin = min(xMin, rectMin);
+            xMax = max(xMax, rectMax);
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Anti-aliased coverage of a pixel by a segment
+ * @param[in] segment brush segment
+ * @param[in] px pixel x coordinate
+ * @param[in] py pixel y coordinate
+ * @return coverage in [0, 1]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static float segmentCoverage(const BrushSegment &segment, float px, float py)
+{
+    Point2f axis = segment.end - segment.start;
+    Point2f offset(px - segment.start.x, py - segment.start.y);
+    float lengthSquared = axis.x * axis.x + axis.y * axis.y;
+    float t = (lengthSquared > 0) ? min(1.0f, max(0.0f, (offset.x * axis.x + offset.y * axis.y) / lengthSquared)) : 0.0f;
+    float dx = offset.x - axis.x * t;
+    float dy = offset.y - axis.y * t;
+    float radius = segment.startRadius + (segment.endRadius - segment.startRadius) * t;
+    return min(1.0f, max(0.0f, radius - sqrt(dx * dx + dy * dy) + 0.5f));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Bounding box of all pixels a segment can touch
+ * @return bounds in image coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect BrushSegment::bounds() const
+{
+    float radius = max(startRadius, endRadius) + 1.0f;
+    int x0 = (int)floor(min(start.x, end.x) - radius);
+    int y0 = (int)floor(min(start.y, end.y) - radius);
+    int x1 = (int)ceil(max(start.x, end.x) + radius);
+    int y1 = (int)ceil(max(start.y, end.y) + radius);
+    return Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @param[in] radius brush radius in pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+BrushEngine::BrushEngine(float radius) : myColor(255, 255, 255), myRadius(radius), myOpacity(1.0f), myStroking(false), myLastRadius(radius),
+    myCoverageKey(0), myCoverageBlock(NULL)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the brush color
+ * @param[in] color color in the channel order of the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void BrushEngine::setColor(const Scalar &color)
+{
+    myColor = color;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the brush radius
+ * @param[in] radius radius in pixels, clamped to [BRUSH_MIN_RADIUS, BRUSH_MAX_RADIUS]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void BrushEngine::setRadius(float radius)
+{
+    myRadius = min(BRUSH_MAX_RADIUS, max(BRUSH_MIN_RADIUS, radius));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the brush opacity
+ * @param[in] opacity opacity in [0, 1]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void BrushEngine::setOpacity(float opacity)
+{
+    myOpacity = min(1.0f, max(0.0f, opacity));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the brush radius
+ * @return radius in pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+float BrushEngine::radius() const
+{
+    return myRadius;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Start a stroke
+ * @param[in] point first mouse sample
+ * @return a dab at the first sample
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+BrushSegment BrushEngine::beginStroke(const Point2f &point)
+{
+    myStroking = true;
+    myLastPoint = point;
+    myLastRadius = myRadius;
+    myCoverage.clear();
+    myCoverageBlock = NULL;
+
+    BrushSegment segment = {point, point, myRadius, myRadius};
+    return segment;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Extend the stroke to the next mouse sample
+ *
+ * The radius shrinks with the distance travelled since the previous sample, down to BRUSH_MIN_WIDTH_RATIO of the
+ * brush radius, and is low-pass filtered so the width changes smoothly.
+ *
+ * @param[in] point next mouse sample
+ * @return segment from the previous sample to this one
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+BrushSegment BrushEngine::continueStroke(const Point2f &point)
+{
+    if (!myStroking)
+    {
+        return beginStroke(point);
+    }
+
+    float dx = point.x - myLastPoint.x;
+    float dy = point.y - myLastPoint.y;
+    float speed = sqrt(dx * dx + dy * dy);
+    float targetRadius = myRadius * (1.0f - (1.0f - BRUSH_MIN_WIDTH_RATIO) * min(1.0f, speed / BRUSH_THINNING_SPEED));
+    float radius = myLastRadius + (targetRadius - myLastRadius) * BRUSH_RADIUS_SMOOTHING;
+
+    BrushSegment segment = {myLastPoint, point, myLastRadius, radius};
+    myLastPoint = point;
+    myLastRadius = radius;
+    return segment;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Finish the current stroke
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void BrushEngine::endStroke()
+{
+    myStroking = false;
+    myCoverage.clear();
+    myCoverageBlock = NULL;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether a stroke is in progress
+ * @return true between beginStroke() and endStroke()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool BrushEngine::isStroking() const
+{
+    return myStroking;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the stroke coverage of a pixel, allocating its block on first use
+ * @param[in] x pixel x coordinate in canvas coordinates
+ * @param[in] y pixel y coordinate in canvas coordinates
+ * @return coverage of the stroke so far, 0 to 255
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+uchar *BrushEngine::coverage(int x, int y)
+{
+    int blockX = (x >= 0 ? x : x - BRUSH_COVERAGE_BLOCK + 1) / BRUSH_COVERAGE_BLOCK;
+    int blockY = (y >= 0 ? y : y - BRUSH_COVERAGE_BLOCK + 1) / BRUSH_COVERAGE_BLOCK;
+    uint64_t key = ((uint64_t)(uint32_t)blockY << 32) | (uint32_t)blockX;
+
+    // consecutive pixels are almost always in the same block
+    if (myCoverageBlock == NULL || key != myCoverageKey)
+    {
+        Mat &block = myCoverage[key];
+        if (block.empty())
+        {
+            block = Mat::zeros(BRUSH_COVERAGE_BLOCK, BRUSH_COVERAGE_BLOCK, CV_8UC1);
+        }
+        myCoverageKey = key;
+        myCoverageBlock = block.data;
+    }
+    return myCoverageBlock + (y - blockY * BRUSH_COVERAGE_BLOCK) * BRUSH_COVERAGE_BLOCK + (x - blockX * BRUSH_COVERAGE_BLOCK);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Blend a pixel by the growth of its stroke coverage
+ *
+ * With opacity a, a pixel covered m so far holds p = p0 + (color - p0) * a * m. Raising its coverage to n takes a blend
+ * towards the color of a * (n - m) / (1 - a * m), which gives the same pixel as painting coverage n once.
+ *
+ * @param[in,out] pixel pixel to blend
+ * @param[in] channels number of channels
+ * @param[in] color brush color
+ * @param[in] coverageNew coverage of the pixel by the current segment, in [0, 1]
+ * @param[in,out] coverageOld coverage of the pixel by the stroke so far, raised to coverageNew
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void BrushEngine::blend(uchar *pixel, int channels, const uchar *color, float coverageNew, uchar &coverageOld) const
+{
+    uchar stored = saturate_cast<uchar>(coverageNew * 255.0f);
+    if (stored <= coverageOld)
+    {
+        return;
+    }
+
+    float previous = coverageOld / 255.0f;
+    float current = stored / 255.0f;
+    float remaining = 1.0f - myOpacity * previous;
+    float alpha = (remaining > 0.0f) ? myOpacity * (current - previous) / remaining : 1.0f;
+    for (int c = 0; c < channels; c++)
+    {
+        pixel[c] = saturate_cast<uchar>(pixel[c] + (color[c] - pixel[c]) * alpha);
+    }
+    coverageOld = stored;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Rasterize a segment into an 8-bit image
+ *
+ * For every row, the span of possible coverage (maximum radius + 0.5) and the span of full coverage (minimum radius
+ * - 0.5) are solved in closed form. The stretches of the full span the stroke has not touched yet are written as
+ * whole runs, and the fringes between the two spans, and pixels the stroke partly covered before, are blended per
+ * pixel by the growth of their coverage.
+ *
+ * @param[in,out] image 8-bit image with 1 to 4 channels
+ * @param[in] segment segment to draw, in image coordinates
+ * @param[in] origin position of the image in the canvas, so the tiles of a canvas share the stroke coverage
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void BrushEngine::draw(Mat &image, const BrushSegment &segment, const Point &origin)
+{
+    Rect clip = segment.bounds() & Rect(0, 0, image.cols, image.rows);
+    if (clip.empty() || image.depth() != CV_8U)
+    {
+        return;
+    }
+
+    const int channels = image.channels();
+    uchar color[4];
+    for (int c = 0; c < 4; c++)
+    {
+        color[c] = saturate_cast<uchar>(myColor[c]);
+    }
+
+    const float outerRadius = max(segment.startRadius, segment.endRadius) + 0.5f;
+    const float innerRadius = min(segment.startRadius, segment.endRadius) - 0.5f;
+
+    // a row of the brush color for translucent runs
+    Mat colorRun;
+    if (myOpacity < 1.0f)
+    {
+        colorRun = Mat(1, clip.width, image.type(), myColor);
+    }
+
+    for (int y = clip.y; y < clip.y + clip.height; y++)
+    {
+        float outerMin, outerMax;
+        if (!capsuleSpan(segment, outerRadius, (float)y, outerMin, outerMax))
+        {
+            continue;
+        }
+        int x0 = max(clip.x, (int)ceil(outerMin));
+        int x1 = min(clip.x + clip.width - 1, (int)floor(outerMax));
+        if (x0 > x1)
+        {
+            continue;
+        }
+
+        // full coverage run, empty when innerStart > innerEnd
+        int innerStart = x1 + 1;
+        int innerEnd = x1;
+        float innerMin, innerMax;
+        if (capsuleSpan(segment, innerRadius, (float)y, innerMin, innerMax))
+        {
+            innerStart = max(x0, (int)ceil(innerMin));
+            innerEnd = min(x1, (int)floor(innerMax));
+            if (innerStart > innerEnd)
+            {
+                innerStart = x1 + 1;
+                innerEnd = x1;
+            }
+        }
+
+        // anti-aliased fringes on both sides of the run
+        uchar *row = image.ptr<uchar>(y);
+        for (int x = x0; x <= x1; x++)
+        {
+            if (x == innerStart)
+            {
+                x = innerEnd;
+                continue;
+            }
+
+            float alpha = segmentCoverage(segment, (float)x, (float)y);
+            if (alpha > 0)
+            {
+                blend(row + x * channels, channels, color, alpha, *coverage(origin.x + x, origin.y + y));
+            }
+        }
+
+        // stretches of the run the stroke has not touched yet in one vectorized call each, the coverage being read a
+        // block row at a time
+        int untouchedStart = -1;
+        auto writeRun = [&](int end)
+        {
+            if (untouchedStart >= 0)
+            {
+                Mat run = image.row(y).colRange(untouchedStart, end);
+                if (myOpacity >= 1.0f)
+                {
+                    run.setTo(myColor);
+                }
+                else
+                {
+                    addWeighted(run, 1.0 - myOpacity, colorRun.colRange(0, run.cols), myOpacity, 0.0, run);
+                }
+                untouchedStart = -1;
+            }
+        };
+        for (int x = innerStart; x <= innerEnd;)
+        {
+            int blockX = ((origin.x + x) % BRUSH_COVERAGE_BLOCK + BRUSH_COVERAGE_BLOCK) % BRUSH_COVERAGE_BLOCK;
+            int length = min(innerEnd + 1 - x, BRUSH_COVERAGE_BLOCK - blockX);
+            uchar *covered = coverage(origin.x + x, origin.y + y);
+            for (int i = 0; i < length;)
+            {
+                if (covered[i] == 0)
+                {
+                    int end = (int)(find_if(covered + i, covered + length, [](uchar c) { return c != 0; }) - covered);
+                    memset(covered + i, 255, end - i);
+                    untouchedStart = (untouchedStart < 0) ? x + i : untouchedStart;
+                    i = end;
+                    continue;
+                }
+                writeRun(x + i);
+                blend(row + (x + i) * channels, channels, color, 1.0f, covered[i]);
+                i++;
+            }
+            x += length;
+        }
+        writeRun(innerEnd + 1);
+    }
+}
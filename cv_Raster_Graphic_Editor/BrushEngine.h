@@ -0,0 +1,116 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file BrushEngine.h
+ * @brief Header file for the BrushEngine class
+ *
+ * This class turns mouse samples into continuous, anti-aliased, variable-width brush strokes
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <unordered_map>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+using namespace cv;
+
+// default brush parameters
+#define BRUSH_DEFAULT_RADIUS 2.0f
+#define BRUSH_MIN_RADIUS 0.5f
+#define BRUSH_MAX_RADIUS 256.0f
+#define BRUSH_MIN_WIDTH_RATIO 0.5f
+#define BRUSH_THINNING_SPEED 60.0f
+#define BRUSH_RADIUS_SMOOTHING 0.3f
+
+// edge length of the blocks of the stroke coverage mask
+#define BRUSH_COVERAGE_BLOCK 64
+
+/*******************************************************************************************************************/ /**
+ * @brief A piece of a stroke between two mouse samples, a capsule whose radius changes linearly along its axis
+**********************************************************************************************************************/
+struct BrushSegment
+{
+    Point2f start;
+    Point2f end;
+    float startRadius;
+    float endRadius;
+
+    Rect bounds() const;
+};
+
+/*******************************************************************************************************************/ /**
+ * @class BrushEngine
+ *
+ * @brief Brush stroke generator and span-based rasterizer
+ *
+ * Successive mouse samples are connected by BrushSegments, so fast strokes have no gaps. The radius thins with the
+ * mouse speed and is smoothed between samples. Segments are rasterized row by row: for each row the exact spans of
+ * full and partial coverage are solved analytically, full-coverage runs are written as whole row runs with OpenCV's
+ * vectorized setTo / addWeighted kernels, and only the one or two pixel wide anti-aliased fringe is blended per pixel.
+ *
+ * Consecutive segments overlap at every joint. The coverage of the current stroke is kept in a sparse mask of small
+ * blocks, and a pixel is only blended by the amount its coverage grows, so the overlap is not painted twice and
+ * translucent strokes have no darker dots at the joints. Runs of pixels the stroke has not touched yet still go
+ * through the vectorized kernels, and pixels already fully covered are skipped.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class BrushEngine
+{
+private:
+
+    Scalar myColor;
+    float myRadius;
+    float myOpacity;
+    bool myStroking;
+    Point2f myLastPoint;
+    float myLastRadius;
+    unordered_map<uint64_t, Mat> myCoverage;
+    uint64_t myCoverageKey;
+    uchar *myCoverageBlock;
+
+    uchar *coverage(int x, int y);
+    void blend(uchar *pixel, int channels, const uchar *color, float coverageNew, uchar &coverageOld) const;
+
+public:
+
+    // constructors
+    BrushEngine(float radius=BRUSH_DEFAULT_RADIUS);
+
+    // brush settings
+    void setColor(const Scalar &color);
+    void setRadius(float radius);
+    void setOpacity(float opacity);
+    float radius() const;
+
+    // stroke generation
+    BrushSegment beginStroke(const Point2f &point);
+    BrushSegment continueStroke(const Point2f &point);
+    void endStroke();
+    bool isStroking() const;
+
+    // rasterization
+    void draw(Mat &image, const BrushSegment &segment, const Point &origin=Point());
+};
+
+#endif // BRUSHENGINE_H
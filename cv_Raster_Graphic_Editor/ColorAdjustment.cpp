@@ -0,0 +1,432 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file ColorAdjustment.cpp
+ * @brief Implementation of the ColorAdjustment class
+ *
+ * This class implements the levels, curves and hue / saturation color tools with lookup tables
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "ColorAdjustment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Evaluate a monotone cubic spline through the curve points at every channel value
+ *
+ * The tangents are limited as proposed by Fritsch and Carlson, so the curve does not overshoot between points.
+ *
+ * @param[in] points control points sorted by input value, with distinct input values
+ * @param[out] values curve output for the inputs 0 to 255
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static void evaluateCurve(const vector<Point2f> &points, vector<float> &values)
+{
+    values.resize(256);
+    const size_t n = points.size();
+    if (n < 2)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            values[i] = (float)i;
+        }
+        return;
+    }
+
+    // secant slopes and limited tangents
+    vector<float> secants(n - 1), tangents(n);
+    for (size_t k = 0; k + 1 < n; k++)
+    {
+        secants[k] = (points[k + 1].y - points[k].y) / (points[k + 1].x - points[k].x);
+    }
+    tangents[0] = secants[0];
+    tangents[n - 1] = secants[n - 2];
+    for (size_t k = 1; k + 1 < n; k++)
+    {
+        tangents[k] = (secants[k - 1] * secants[k] <= 0.0f) ? 0.0f : 0.5f * (secants[k - 1] + secants[k]);
+    }
+    for (size_t k = 0; k + 1 < n; k++)
+    {
+        if (secants[k] == 0.0f)
+        {
+            tangents[k] = tangents[k + 1] = 0.0f;
+            continue;
+        }
+        float a = tangents[k] / secants[k];
+        float b = tangents[k + 1] / secants[k];
+        float s = a * a + b * b;
+        if (s > 9.0f)
+        {
+            float t = 3.0f / sqrt(s);
+            tangents[k] = t * a * secants[k];
+            tangents[k + 1] = t * b * secants[k];
+        }
+    }
+
+    // cubic Hermite interpolation, constant outside the first and last point
+    size_t k = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        float x = (float)i;
+        if (x <= points[0].x)
+        {
+            values[i] = points[0].y;
+            continue;
+        }
+        if (x >= points[n - 1].x)
+        {
+            values[i] = points[n - 1].y;
+            continue;
+        }
+        while (x > points[k + 1].x)
+        {
+            k++;
+        }
+
+        float h = points[k + 1].x - points[k].x;
+        float t = (x - points[k].x) / h;
+        float t2 = t * t;
+        float t3 = t2 * t;
+        values[i] = (2.0f * t3 - 3.0f * t2 + 1.0f) * points[k].y + (t3 - 2.0f * t2 + t) * h * tangents[k] +
+                    (3.0f * t2 - 2.0f * t3) * points[k + 1].y + (t3 - t2) * h * tangents[k + 1];
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Parse a number
+ * @param[in] text text to parse
+ * @param[out] value parsed number
+ * @return false if the text is not a number
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static bool parseNumber(const string &text, float &value)
+{
+    istringstream input(text);
+    return (input >> value) && (input >> ws).eof();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor, the adjustment starts out as the identity
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+ColorAdjustment::ColorAdjustment()
+{
+    reset();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the levels
+ *
+ * Input values are stretched from [inputBlack, inputWhite] to [0, 1], raised to the power 1 / gamma and mapped to
+ * [outputBlack, outputWhite]. Levels are applied before the curve.
+ *
+ * @param[in] inputBlack input value mapped to the output black
+ * @param[in] inputWhite input value mapped to the output white
+ * @param[in] gamma midtone gamma, above 1 to brighten
+ * @param[in] outputBlack darkest output value
+ * @param[in] outputWhite brightest output value
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::setLevels(float inputBlack, float inputWhite, float gamma, float outputBlack, float outputWhite)
+{
+    myInputBlack = min(254.0f, max(0.0f, inputBlack));
+    myInputWhite = min(255.0f, max(myInputBlack + 1.0f, inputWhite));
+    myGamma = min(ADJUST_MAX_GAMMA, max(ADJUST_MIN_GAMMA, gamma));
+    myOutputBlack = min(255.0f, max(0.0f, outputBlack));
+    myOutputWhite = min(255.0f, max(0.0f, outputWhite));
+    buildTables();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the tone curve
+ *
+ * The curve passes through the control points and through (0, 0) and (255, 255) unless points with those inputs
+ * are given. Points are clipped to [0, 255], and of several points with the same input only the last is kept.
+ *
+ * @param[in] points control points (input, output), at most ADJUST_MAX_CURVE_POINTS, empty for the identity curve
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::setCurve(const vector<Point2f> &points)
+{
+    myCurve.clear();
+    for (size_t i = 0; i < points.size() && i < ADJUST_MAX_CURVE_POINTS; i++)
+    {
+        Point2f point(min(255.0f, max(0.0f, points[i].x)), min(255.0f, max(0.0f, points[i].y)));
+        vector<Point2f>::iterator same = find_if(myCurve.begin(), myCurve.end(), [&](const Point2f &other) { return other.x == point.x; });
+        if (same != myCurve.end())
+        {
+            *same = point;
+        }
+        else
+        {
+            myCurve.push_back(point);
+        }
+    }
+    sort(myCurve.begin(), myCurve.end(), [](const Point2f &a, const Point2f &b) { return a.x < b.x; });
+    buildTables();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the hue shift and the saturation and value factors
+ * @param[in] hue hue rotation in degrees
+ * @param[in] saturation saturation factor, 1 to keep the saturation
+ * @param[in] value value factor, 1 to keep the brightness
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::setHueSaturation(float hue, float saturation, float value)
+{
+    myHue = fmod(hue, 360.0f);
+    if (myHue < 0.0f)
+    {
+        myHue += 360.0f;
+    }
+    mySaturation = max(0.0f, saturation);
+    myValue = max(0.0f, value);
+    buildTables();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Reset all parameters to the identity
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::reset()
+{
+    myInputBlack = 0.0f;
+    myInputWhite = 255.0f;
+    myGamma = 1.0f;
+    myOutputBlack = 0.0f;
+    myOutputWhite = 255.0f;
+    myCurve.clear();
+    myHue = 0.0f;
+    mySaturation = 1.0f;
+    myValue = 1.0f;
+    buildTables();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether the adjustment leaves every pixel unchanged
+ * @return true if both lookup tables are the identity
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ColorAdjustment::isIdentity() const
+{
+    return myTableIdentity && myHsvIdentity;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Adjust an image
+ * @param[in] source BGR image, or BGRA image with premultiplied alpha
+ * @param[out] destination adjusted image of the same size and type, may be the source
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::apply(const Mat &source, Mat &destination) const
+{
+    CV_Assert(source.depth() == CV_8U && (source.channels() == 3 || source.channels() == 4));
+    if (isIdentity())
+    {
+        if (destination.data != source.data)
+        {
+            source.copyTo(destination);
+        }
+        return;
+    }
+    if (source.channels() == 3)
+    {
+        applyColor(source, destination);
+        return;
+    }
+
+    // adjust the straight color and premultiply it by the untouched alpha again
+    Mat straight, color;
+    cvtColor(source, straight, COLOR_mRGBA2RGBA);
+    cvtColor(straight, color, COLOR_BGRA2BGR);
+    applyColor(color, color);
+    const int fromTo[] = {0, 0, 1, 1, 2, 2};
+    mixChannels(&color, 1, &straight, 1, fromTo, 3);
+    cvtColor(straight, destination, COLOR_RGBA2mRGBA);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Write the parameters that differ from the identity as text
+ *
+ * The text has the form [levels <in black> <in white> <gamma> <out black> <out white>] [curve <in> <out> ...]
+ * [hsv <hue> <saturation> <value>], which read() parses.
+ *
+ * @param[in,out] output stream to write to
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::write(ostream &output) const
+{
+    const char *separator = "";
+    if (myInputBlack != 0.0f || myInputWhite != 255.0f || myGamma != 1.0f || myOutputBlack != 0.0f || myOutputWhite != 255.0f)
+    {
+        output << "levels " << myInputBlack << " " << myInputWhite << " " << myGamma << " " << myOutputBlack << " " << myOutputWhite;
+        separator = " ";
+    }
+    if (!myCurve.empty())
+    {
+        output << separator << "curve";
+        for (size_t i = 0; i < myCurve.size(); i++)
+        {
+            output << " " << myCurve[i].x << " " << myCurve[i].y;
+        }
+        separator = " ";
+    }
+    if (myHue != 0.0f || mySaturation != 1.0f || myValue != 1.0f)
+    {
+        output << separator << "hsv " << myHue << " " << mySaturation << " " << myValue;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the parameters from the text written by write(), parameters not mentioned are reset
+ * @param[in,out] input stream to read from, read to its end
+ * @return false if the text is invalid or empty
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ColorAdjustment::read(istream &input)
+{
+    vector<string> tokens;
+    string token;
+    while (input >> token)
+    {
+        tokens.push_back(token);
+    }
+
+    reset();
+    size_t i = 0;
+    float values[5];
+    while (i < tokens.size())
+    {
+        const string keyword = tokens[i++];
+        size_t count = (keyword == "levels") ? 5 : (keyword == "hsv") ? 3 : 0;
+        if (keyword == "curve")
+        {
+            // as many (input, output) pairs as follow
+            vector<Point2f> points;
+            Point2f point;
+            while (i + 1 < tokens.size() && parseNumber(tokens[i], point.x) && parseNumber(tokens[i + 1], point.y))
+            {
+                points.push_back(point);
+                i += 2;
+            }
+            if (points.empty())
+            {
+                return false;
+            }
+            setCurve(points);
+            continue;
+        }
+        if (count == 0)
+        {
+            return false;
+        }
+
+        for (size_t j = 0; j < count; j++, i++)
+        {
+            if (i >= tokens.size() || !parseNumber(tokens[i], values[j]))
+            {
+                return false;
+            }
+        }
+        if (keyword == "levels")
+        {
+            setLevels(values[0], values[1], values[2], values[3], values[4]);
+        }
+        else
+        {
+            setHueSaturation(values[0], values[1], values[2]);
+        }
+    }
+    return !tokens.empty();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Rebuild the lookup tables after a parameter change
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::buildTables()
+{
+    // the curve is anchored at black and white unless it has points there
+    vector<Point2f> points = myCurve;
+    if (!points.empty() && points.front().x > 0.0f)
+    {
+        points.insert(points.begin(), Point2f(0.0f, 0.0f));
+    }
+    if (!points.empty() && points.back().x < 255.0f)
+    {
+        points.push_back(Point2f(255.0f, 255.0f));
+    }
+    vector<float> curve;
+    evaluateCurve(points, curve);
+
+    // levels followed by the curve, the same for every channel
+    myTable.create(1, 256, CV_8UC3);
+    myTableIdentity = true;
+    for (int i = 0; i < 256; i++)
+    {
+        float level = min(1.0f, max(0.0f, (i - myInputBlack) / (myInputWhite - myInputBlack)));
+        level = myOutputBlack + pow(level, 1.0f / myGamma) * (myOutputWhite - myOutputBlack);
+        uchar value = saturate_cast<uchar>(curve[saturate_cast<uchar>(level)]);
+        myTable.at<Vec3b>(0, i) = Vec3b(value, value, value);
+        myTableIdentity = myTableIdentity && value == i;
+    }
+
+    // hue rotation and saturation and value scaling, the full range HSV hue covers 360 degrees in 256 steps
+    const int hueShift = cvRound(myHue * 256.0f / 360.0f) & 255;
+    myHsvTable.create(1, 256, CV_8UC3);
+    for (int i = 0; i < 256; i++)
+    {
+        myHsvTable.at<Vec3b>(0, i) = Vec3b((uchar)((i + hueShift) & 255), saturate_cast<uchar>(i * mySaturation), saturate_cast<uchar>(i * myValue));
+    }
+    myHsvIdentity = (hueShift == 0 && mySaturation == 1.0f && myValue == 1.0f);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Apply both tables to BGR pixels
+ * @param[in] source BGR image
+ * @param[out] destination adjusted image, may be the source
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ColorAdjustment::applyColor(const Mat &source, Mat &destination) const
+{
+    if (!myTableIdentity)
+    {
+        LUT(source, myTable, destination);
+    }
+    else if (destination.data != source.data)
+    {
+        source.copyTo(destination);
+    }
+
+    if (!myHsvIdentity)
+    {
+        Mat hsv;
+        cvtColor(destination, hsv, COLOR_BGR2HSV_FULL);
+        LUT(hsv, myHsvTable, hsv);
+        cvtColor(hsv, destination, COLOR_HSV2BGR_FULL);
+    }
+}
@@ -0,0 +1,106 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file ColorAdjustment.h
+ * @brief Header file for the ColorAdjustment class
+ *
+ * This class implements the levels, curves and hue / saturation color tools with lookup tables
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef COLORADJUSTMENT_H
+#define COLORADJUSTMENT_H
+
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+using namespace cv;
+
+// parameter ranges
+#define ADJUST_MIN_GAMMA 0.1f
+#define ADJUST_MAX_GAMMA 10.0f
+#define ADJUST_MAX_CURVE_POINTS 16
+
+/*******************************************************************************************************************/ /**
+ * @class ColorAdjustment
+ *
+ * @brief Levels, curves and hue / saturation / value adjustment
+ *
+ * Levels and curves map each channel value on its own, so both are folded into a single 256-entry table, rebuilt
+ * whenever a parameter changes, and applied with cv::LUT. The hue shift mixes the channels, so it is done in
+ * OpenCV's full range 8-bit HSV space, where rotating the hue and scaling saturation and value are again per-channel
+ * tables: the pixels are converted to HSV, looked up and converted back. Both steps are vectorized whole-image
+ * OpenCV kernels, and a step whose table is the identity is skipped.
+ *
+ * Premultiplied BGRA pixels, as stored in the layers, are converted to straight alpha around the lookups, so
+ * transparent pixels stay transparent.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class ColorAdjustment
+{
+private:
+
+    // levels
+    float myInputBlack;
+    float myInputWhite;
+    float myGamma;
+    float myOutputBlack;
+    float myOutputWhite;
+
+    // curve control points, in [0, 255], sorted by input value
+    vector<Point2f> myCurve;
+
+    // hue shift in degrees, saturation and value factors
+    float myHue;
+    float mySaturation;
+    float myValue;
+
+    // lookup tables, 1 x 256 CV_8UC3
+    Mat myTable;
+    Mat myHsvTable;
+    bool myTableIdentity;
+    bool myHsvIdentity;
+
+    void buildTables();
+    void applyColor(const Mat &source, Mat &destination) const;
+
+public:
+
+    // constructors
+    ColorAdjustment();
+
+    // parameters
+    void setLevels(float inputBlack, float inputWhite, float gamma, float outputBlack=0.0f, float outputWhite=255.0f);
+    void setCurve(const vector<Point2f> &points);
+    void setHueSaturation(float hue, float saturation=1.0f, float value=1.0f);
+    void reset();
+    bool isIdentity() const;
+
+    // application
+    void apply(const Mat &source, Mat &destination) const;
+
+    // text form, as used by scripts
+    void write(ostream &output) const;
+    bool read(istream &input);
+};
+
+#endif // COLORADJUSTMENT_H
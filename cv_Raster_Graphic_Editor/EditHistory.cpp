@@ -0,0 +1,567 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file EditHistory.cpp
+ * @brief Implementation of the EditHistory class
+ *
+ * This class provides a multi-level undo/redo stack that stores only the image tiles changed by each operation
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "EditHistory.h"
+
+#include <iostream>
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @param[in] maxOperations maximum number of undo levels kept
+ * @param[in] maxBytes memory budget of the undo stack, the oldest operations are dropped beyond it
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+EditHistory::EditHistory(size_t maxOperations, size_t maxBytes) : myBytes(0), myMaxOperations(maxOperations), myMaxBytes(maxBytes)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Start recording an operation
+ *
+ * An operation that is still being recorded is committed first.
+ *
+ * @param[in] canvas canvas the operation modifies, kept with the operation so undo finds it whichever layer is active
+ * @param[in] name operation name, for console output
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::begin(const Ptr<TiledCanvas> &canvas, const string &name)
+{
+    commit();
+
+    myTarget = canvas;
+    myPending = Operation();
+    myPending.name = name;
+    myPending.target = canvas;
+    myTouchedTiles.clear();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Declare that a region of the image is about to be modified
+ *
+ * Every tile overlapping the region that has not been touched by the current operation yet is copied before the
+ * caller writes to it. Must be called before the pixels change. With a mask, tiles of the region that the mask
+ * does not cover are skipped, so a fill only stores the tiles it actually changes.
+ *
+ * @param[in] region image region that will be modified
+ * @param[in] mask optional 8-bit mask the size of the region, nonzero where pixels will be modified
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::touch(const Rect &region, const Mat &mask)
+{
+    if (!myTarget)
+    {
+        return;
+    }
+
+    const Rect bounds(Point(0, 0), myTarget->size());
+    Rect clipped = region & bounds;
+    if (clipped.empty())
+    {
+        return;
+    }
+
+    const int tilesX = (bounds.width + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    const int firstX = clipped.x / HISTORY_TILE_SIZE;
+    const int firstY = clipped.y / HISTORY_TILE_SIZE;
+    const int lastX = (clipped.x + clipped.width - 1) / HISTORY_TILE_SIZE;
+    const int lastY = (clipped.y + clipped.height - 1) / HISTORY_TILE_SIZE;
+    for (int ty = firstY; ty <= lastY; ty++)
+    {
+        for (int tx = firstX; tx <= lastX; tx++)
+        {
+            Rect tileRegion = Rect(tx * HISTORY_TILE_SIZE, ty * HISTORY_TILE_SIZE, HISTORY_TILE_SIZE, HISTORY_TILE_SIZE) & bounds;
+            if (!mask.empty() && countNonZero(mask((tileRegion & clipped) - region.tl())) == 0)
+            {
+                continue;
+            }
+
+            // copy on first write only
+            if (!myTouchedTiles.insert(ty * tilesX + tx).second)
+            {
+                continue;
+            }
+
+            TileSnapshot tile;
+            tile.region = tileRegion;
+            myTarget->read(tile.region, tile.pixels);
+            myPending.tiles.push_back(tile);
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Finish the operation being recorded and push it on the undo stack
+ *
+ * Operations that did not touch any tile are discarded.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::commit()
+{
+    if (!myTarget)
+    {
+        return;
+    }
+
+    myTarget.reset();
+    myTouchedTiles.clear();
+    if (!myPending.tiles.empty())
+    {
+        push(myPending);
+    }
+    myPending = Operation();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Record an operation that replaced the whole canvas or the crop rectangle
+ *
+ * The previous canvas is referenced rather than copied, so the caller must have assigned a new canvas (for example
+ * from clone()) instead of writing into the old one. Operations that keep the canvas, such as a crop, pass an empty
+ * pointer and only the crop rectangle is recorded.
+ *
+ * @param[in] previousCanvas canvas before the operation, empty if it did not change
+ * @param[in] previousView crop rectangle before the operation
+ * @param[in] name operation name, for console output
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::commitReplacement(const Ptr<TiledCanvas> &previousCanvas, const Rect &previousView, const string &name)
+{
+    commit();
+
+    Operation operation;
+    operation.name = name;
+    operation.canvas = previousCanvas;
+    operation.view = previousView;
+    push(operation);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Record an operation that rewrote every pixel of a canvas
+ *
+ * The caller writes the new pixels into a separate canvas and exchanges it with the modified one with
+ * TiledCanvas::swap(), so the modified canvas keeps its identity, and with it the layer it belongs to and the
+ * operations recorded on it, while the other canvas holds the previous contents.
+ *
+ * @param[in] canvas canvas that was modified
+ * @param[in] previousContents canvas holding the contents before the operation
+ * @param[in] name operation name, for console output
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::commitSwap(const Ptr<TiledCanvas> &canvas, const Ptr<TiledCanvas> &previousContents, const string &name)
+{
+    commit();
+
+    Operation operation;
+    operation.name = name;
+    operation.target = canvas;
+    operation.canvas = previousContents;
+    push(operation);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether an operation is being recorded
+ * @return true between begin() and commit()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditHistory::isRecording() const
+{
+    return myTarget != NULL;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Revert the most recent operation
+ * @param[in,out] canvas canvas to restore, replaced by the previous canvas when undoing a reset
+ * @param[in,out] view crop rectangle, restored when undoing a crop or reset
+ * @param[out] region canvas region whose pixels changed
+ * @return false if there is nothing to undo
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditHistory::undo(Ptr<TiledCanvas> &canvas, Rect &view, Rect &region)
+{
+    commit();
+    if (myUndoStack.empty())
+    {
+        return false;
+    }
+
+    Operation &operation = myUndoStack.back();
+    myBytes -= operation.bytes;
+    region = swapOperation(operation, canvas, view);
+    cout << "Undo: " << operation.name << endl;
+
+    myRedoStack.push_back(Operation());
+    std::swap(myRedoStack.back(), operation);
+    myUndoStack.pop_back();
+    myBytes += myRedoStack.back().bytes;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Re-apply the most recently undone operation
+ * @param[in,out] canvas canvas to modify, replaced by the next canvas when redoing a reset
+ * @param[in,out] view crop rectangle, changed when redoing a crop or reset
+ * @param[out] region canvas region whose pixels changed
+ * @return false if there is nothing to redo
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditHistory::redo(Ptr<TiledCanvas> &canvas, Rect &view, Rect &region)
+{
+    commit();
+    if (myRedoStack.empty())
+    {
+        return false;
+    }
+
+    Operation &operation = myRedoStack.back();
+    myBytes -= operation.bytes;
+    region = swapOperation(operation, canvas, view);
+    cout << "Redo: " << operation.name << endl;
+
+    myUndoStack.push_back(Operation());
+    std::swap(myUndoStack.back(), operation);
+    myRedoStack.pop_back();
+    myBytes += myUndoStack.back().bytes;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Drop all recorded operations
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::clear()
+{
+    myTarget.reset();
+    myPending = Operation();
+    myTouchedTiles.clear();
+    myUndoStack.clear();
+    myRedoStack.clear();
+    myBytes = 0;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief List the canvases the recorded operations refer to
+ * @param[out] canvases tile targets and replaced canvases are appended, possibly more than once
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::canvases(vector<Ptr<TiledCanvas> > &canvases) const
+{
+    const deque<Operation> *stacks[] = {&myUndoStack, &myRedoStack};
+    for (int s = 0; s < 2; s++)
+    {
+        for (size_t i = 0; i < stacks[s]->size(); i++)
+        {
+            const Operation &operation = (*stacks[s])[i];
+            if (operation.target)
+            {
+                canvases.push_back(operation.target);
+            }
+            if (operation.canvas)
+            {
+                canvases.push_back(operation.canvas);
+            }
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Write the undo and redo stacks to a project
+ *
+ * The operation being recorded, if any, is not written.
+ *
+ * @param[in,out] file project being written
+ * @param[in] canvasIndex maps every canvas listed by canvases() to its index in the project
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::write(ProjectFile &file, const function<int(const Ptr<TiledCanvas> &canvas)> &canvasIndex) const
+{
+    const deque<Operation> *stacks[] = {&myUndoStack, &myRedoStack};
+    for (int s = 0; s < 2; s++)
+    {
+        file.write((uint32_t)stacks[s]->size());
+        for (size_t i = 0; i < stacks[s]->size(); i++)
+        {
+            writeOperation(file, (*stacks[s])[i], canvasIndex);
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Replace the history by the undo and redo stacks stored in a project
+ * @param[in,out] file project being read
+ * @param[in] canvases canvases of the project, by index
+ * @param[in] size document size, which every canvas, tile and crop rectangle of the history must fit
+ * @param[in] type pixel type of the layers
+ * @return false if the stored history is invalid, the history is then empty
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditHistory::read(ProjectFile &file, const vector<Ptr<TiledCanvas> > &canvases, Size size, int type)
+{
+    clear();
+    deque<Operation> *stacks[] = {&myUndoStack, &myRedoStack};
+    for (int s = 0; s < 2; s++)
+    {
+        uint32_t operations = 0;
+        if (!file.read(operations))
+        {
+            clear();
+            return false;
+        }
+        for (uint32_t i = 0; i < operations; i++)
+        {
+            Operation operation;
+            if (!readOperation(file, operation, canvases, size, type))
+            {
+                clear();
+                return false;
+            }
+            operation.bytes = operationBytes(operation);
+            myBytes += operation.bytes;
+            stacks[s]->push_back(Operation());
+            std::swap(stacks[s]->back(), operation);
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of operations that can be undone
+ * @return undo stack depth
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t EditHistory::undoLevels() const
+{
+    return myUndoStack.size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of operations that can be redone
+ * @return redo stack depth
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t EditHistory::redoLevels() const
+{
+    return myRedoStack.size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Memory held by the undo and redo stacks
+ * @return size of the stored pixels in bytes
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t EditHistory::memoryUsage() const
+{
+    return myBytes;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Push a finished operation, invalidating the redo stack and enforcing the history limits
+ * @param[in,out] operation operation to push, its contents are moved
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::push(Operation &operation)
+{
+    for (size_t i = 0; i < myRedoStack.size(); i++)
+    {
+        myBytes -= myRedoStack[i].bytes;
+    }
+    myRedoStack.clear();
+
+    operation.bytes = operationBytes(operation);
+    myUndoStack.push_back(Operation());
+    std::swap(myUndoStack.back(), operation);
+    myBytes += myUndoStack.back().bytes;
+
+    // drop the oldest operations, but always keep the newest one
+    while (myUndoStack.size() > 1 && (myUndoStack.size() > myMaxOperations || myBytes > myMaxBytes))
+    {
+        myBytes -= myUndoStack.front().bytes;
+        myUndoStack.pop_front();
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Exchange the contents stored in an operation with the canvas
+ *
+ * After the swap the operation holds exactly what is needed to reverse it again, so the same call implements both
+ * undo and redo.
+ *
+ * @param[in,out] operation operation to apply
+ * @param[in,out] canvas canvas slot swapped by replacement operations
+ * @param[in,out] view crop rectangle to modify
+ * @return canvas region whose pixels changed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect EditHistory::swapOperation(Operation &operation, Ptr<TiledCanvas> &canvas, Rect &view)
+{
+    Rect region;
+    if (operation.target && operation.canvas)
+    {
+        operation.target->swap(*operation.canvas);
+        region = Rect(Point(0, 0), operation.target->size());
+    }
+    else if (operation.canvas || !operation.view.empty())
+    {
+        if (operation.canvas)
+        {
+            std::swap(canvas, operation.canvas);
+            region = Rect(Point(0, 0), canvas->size());
+        }
+        std::swap(view, operation.view);
+    }
+    else
+    {
+        for (size_t i = 0; i < operation.tiles.size(); i++)
+        {
+            TileSnapshot &tile = operation.tiles[i];
+            Mat current;
+            operation.target->read(tile.region, current);
+            operation.target->write(tile.pixels, tile.region.tl());
+            tile.pixels = current;
+            region = region.empty() ? tile.region : (region | tile.region);
+        }
+    }
+    operation.bytes = operationBytes(operation);
+    return region;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Memory held by an operation
+ *
+ * Replaced canvases live in their scratch files and are not counted.
+ *
+ * @param[in] operation operation to measure
+ * @return size of the stored pixels in bytes
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t EditHistory::operationBytes(const Operation &operation)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < operation.tiles.size(); i++)
+    {
+        bytes += operation.tiles[i].pixels.total() * operation.tiles[i].pixels.elemSize();
+    }
+    return bytes;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Write one operation to a project
+ * @param[in,out] file project being written
+ * @param[in] operation operation to write
+ * @param[in] canvasIndex maps a canvas to its index in the project
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditHistory::writeOperation(ProjectFile &file, const Operation &operation, const function<int(const Ptr<TiledCanvas> &canvas)> &canvasIndex)
+{
+    file.writeString(operation.name);
+    file.write((int32_t)(operation.target ? canvasIndex(operation.target) : -1));
+    file.write((int32_t)(operation.canvas ? canvasIndex(operation.canvas) : -1));
+    file.write(operation.view);
+    file.write((uint32_t)operation.tiles.size());
+    for (size_t i = 0; i < operation.tiles.size(); i++)
+    {
+        const TileSnapshot &tile = operation.tiles[i];
+        Mat pixels = tile.pixels.isContinuous() ? tile.pixels : tile.pixels.clone();
+        file.write(tile.region);
+        file.write((int32_t)pixels.type());
+        file.writeBytes(pixels.data, pixels.total() * pixels.elemSize());
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Read one operation from a project
+ *
+ * Everything the operation refers to is checked before it is used: the canvases must exist and have the document
+ * size and layer type, and the tiles and the crop rectangle must lie inside the document, with tiles of the layer
+ * type, so undoing a corrupt history cannot write outside a canvas.
+ *
+ * @param[in,out] file project being read
+ * @param[out] operation operation read
+ * @param[in] canvases canvases of the project, by index
+ * @param[in] size document size
+ * @param[in] type pixel type of the layers
+ * @return false if the stored operation is invalid
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditHistory::readOperation(ProjectFile &file, Operation &operation, const vector<Ptr<TiledCanvas> > &canvases, Size size, int type)
+{
+    const Rect document(Point(0, 0), size);
+    int32_t target, canvas;
+    uint32_t tiles;
+    if (!file.readString(operation.name) || !file.read(target) || !file.read(canvas) || !file.read(operation.view) || !file.read(tiles))
+    {
+        return false;
+    }
+    if (target < -1 || target >= (int32_t)canvases.size() || canvas < -1 || canvas >= (int32_t)canvases.size() || (tiles > 0 && target < 0))
+    {
+        return false;
+    }
+    if (target >= 0)
+    {
+        operation.target = canvases[target];
+    }
+    if (canvas >= 0)
+    {
+        operation.canvas = canvases[canvas];
+    }
+    const Ptr<TiledCanvas> *used[] = {&operation.target, &operation.canvas};
+    for (int i = 0; i < 2; i++)
+    {
+        if (*used[i] && ((*used[i])->size() != size || (*used[i])->type() != type))
+        {
+            return false;
+        }
+    }
+    if (operation.view.width < 0 || operation.view.height < 0 || (!operation.view.empty() && (operation.view & document) != operation.view))
+    {
+        return false;
+    }
+
+    // every tile takes at least its rectangle and type, which bounds the count before allocating
+    if (tiles > file.remainingBytes() / (sizeof(Rect) + sizeof(int32_t)))
+    {
+        return false;
+    }
+    operation.tiles.resize(tiles);
+    for (uint32_t i = 0; i < tiles; i++)
+    {
+        TileSnapshot &tile = operation.tiles[i];
+        int32_t tileType;
+        if (!file.read(tile.region) || !file.read(tileType) || tile.region.width <= 0 || tile.region.height <= 0 || tile.region.width > HISTORY_TILE_SIZE || tile.region.height > HISTORY_TILE_SIZE ||
+            (tile.region & document) != tile.region || tileType != type)
+        {
+            return false;
+        }
+        tile.pixels.create(tile.region.size(), tileType);
+        if (!file.readBytes(tile.pixels.data, tile.pixels.total() * tile.pixels.elemSize()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,133 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file EditHistory.h
+ * @brief Header file for the EditHistory class
+ *
+ * This class provides a multi-level undo/redo stack that stores only the image tiles changed by each operation
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef EDITHISTORY_H
+#define EDITHISTORY_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "ProjectFile.h"
+#include "TiledCanvas.h"
+
+using namespace std;
+using namespace cv;
+
+// default history parameters
+#define HISTORY_TILE_SIZE 64
+#define HISTORY_MAX_OPERATIONS 100
+#define HISTORY_MAX_BYTES (512 * 1024 * 1024)
+
+/*******************************************************************************************************************/ /**
+ * @class EditHistory
+ *
+ * @brief Undo/redo stack with copy-on-write tile snapshots
+ *
+ * The image is divided into a grid of HISTORY_TILE_SIZE x HISTORY_TILE_SIZE tiles. While an operation is recorded,
+ * a tile is copied the first time the operation touches it, so an operation only stores the tiles it changes. Undo
+ * and redo swap the stored tiles with the image contents, which keeps a single copy per changed tile and makes both
+ * O(changed tiles). Operations that replace the whole canvas (reset) keep a reference to the previous canvas instead
+ * of copying it, which costs scratch file space but no memory, and operations that only change the crop rectangle
+ * (crop) store the previous rectangle, which makes them O(1). Operations that rewrite a whole layer (color
+ * adjustments) write into a new canvas and keep the previous contents in it, swapped with the layer on undo and redo
+ * with TiledCanvas::swap(), so they are O(1) as well.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class EditHistory
+{
+private:
+
+    // a stored tile, holding the contents the image does not currently have
+    struct TileSnapshot
+    {
+        Rect region;
+        Mat pixels;
+    };
+
+    // a recorded operation
+    struct Operation
+    {
+        string name;
+        vector<TileSnapshot> tiles;
+        Ptr<TiledCanvas> target;    // canvas the tiles belong to, such as one layer
+        Ptr<TiledCanvas> canvas;    // swapped with the canvas slot for replacement operations, with the contents of
+                                    // the target for swap operations
+        Rect view;                  // swapped with the crop rectangle for replacement operations
+        size_t bytes;
+    };
+
+    deque<Operation> myUndoStack;
+    deque<Operation> myRedoStack;
+    size_t myBytes;
+    size_t myMaxOperations;
+    size_t myMaxBytes;
+
+    // operation being recorded
+    Ptr<TiledCanvas> myTarget;
+    Operation myPending;
+    unordered_set<int> myTouchedTiles;
+
+    void push(Operation &operation);
+    Rect swapOperation(Operation &operation, Ptr<TiledCanvas> &canvas, Rect &view);
+    static size_t operationBytes(const Operation &operation);
+    static void writeOperation(ProjectFile &file, const Operation &operation, const function<int(const Ptr<TiledCanvas> &canvas)> &canvasIndex);
+    static bool readOperation(ProjectFile &file, Operation &operation, const vector<Ptr<TiledCanvas> > &canvases, Size size, int type);
+
+public:
+
+    // constructors
+    EditHistory(size_t maxOperations=HISTORY_MAX_OPERATIONS, size_t maxBytes=HISTORY_MAX_BYTES);
+
+    // recording
+    void begin(const Ptr<TiledCanvas> &canvas, const string &name);
+    void touch(const Rect &region, const Mat &mask=Mat());
+    void commit();
+    void commitReplacement(const Ptr<TiledCanvas> &previousCanvas, const Rect &previousView, const string &name);
+    void commitSwap(const Ptr<TiledCanvas> &canvas, const Ptr<TiledCanvas> &previousContents, const string &name);
+    bool isRecording() const;
+
+    // history navigation
+    bool undo(Ptr<TiledCanvas> &canvas, Rect &view, Rect &region);
+    bool redo(Ptr<TiledCanvas> &canvas, Rect &view, Rect &region);
+    void clear();
+
+    // persistence
+    void canvases(vector<Ptr<TiledCanvas> > &canvases) const;
+    void write(ProjectFile &file, const function<int(const Ptr<TiledCanvas> &canvas)> &canvasIndex) const;
+    bool read(ProjectFile &file, const vector<Ptr<TiledCanvas> > &canvases, Size size, int type);
+
+    // statistics
+    size_t undoLevels() const;
+    size_t redoLevels() const;
+    size_t memoryUsage() const;
+};
+
+#endif // EDITHISTORY_H
@@ -0,0 +1,1331 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file EditorCore.cpp
+ * @brief Implementation of the EditorCore class
+ *
+ * This class holds the editing state and operations of the raster editor, independent of any window
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "EditorCore.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @param[in] residentTiles number of canvas tiles kept in memory, see TiledCanvas
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+EditorCore::EditorCore(size_t residentTiles) : myResidentTiles(residentTiles), myColor(255, 255, 255), myRecorder(NULL)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Load an image or open a project, replacing the current document
+ * @param[in] fileName image file, or project file ending in EDITOR_PROJECT_EXTENSION
+ * @return false if the file could not be read
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::load(const string &fileName)
+{
+    return isProject(fileName) ? openProject(fileName) : loadImage(fileName);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Save the image, cut to the crop rectangle, or the whole document as a project
+ * @param[in] fileName image file, or project file ending in EDITOR_PROJECT_EXTENSION, {name} is replaced by the name
+ *                     of the loaded file
+ * @return false if the file could not be written
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::save(const string &fileName)
+{
+    return saveAsync(fileName) && waitForSave();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Start saving on a background thread
+ *
+ * The pixels inside the crop rectangle are gathered right away, which is a copy, and only the encoding, for example
+ * the PNG compression, runs on the background thread, so the document can be edited again as soon as this returns.
+ * Projects store raw tiles, which needs no encoding, and are saved before returning. A save still running is waited
+ * for first, and an adjustment preview is ended.
+ *
+ * @param[in] fileName image or project file, see save()
+ * @return false if nothing could be saved or writing a project failed, the image encoding result is returned by
+ *         waitForSave()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::saveAsync(const string &fileName)
+{
+    waitForSave();
+    if (empty())
+    {
+        return false;
+    }
+
+    // the saved composite must not contain a preview
+    endPreview();
+
+    string name = outputName(fileName);
+    if (isProject(name))
+    {
+        bool success = saveProject(name);
+        mySaveResult = async(launch::deferred, [success]() { return success; });
+        return success;
+    }
+
+    Mat image;
+    myLayers.composite().read(myView, image);
+    mySaveResult = async(launch::async, [image, name]()
+    {
+        if (!imwrite(name, image))
+        {
+            cout << "Error while writing file " << name << endl;
+            return false;
+        }
+        cout << "Saved " << name << endl;
+        return true;
+    });
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether a save started by saveAsync() is still running
+ * @return true until the background thread has finished
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::isSaving() const
+{
+    return mySaveResult.valid() && mySaveResult.wait_for(chrono::seconds(0)) == future_status::timeout;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Wait for the save started by saveAsync()
+ * @return false if the last save failed, true if it succeeded or there was none
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::waitForSave()
+{
+    return !mySaveResult.valid() || mySaveResult.get();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether an image is loaded
+ * @return true before a successful load()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::empty() const
+{
+    return myLayers.empty();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the composite of the layers, as it is displayed and saved
+ * @return composite canvas, including the pixels outside the crop rectangle
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+TiledCanvas &EditorCore::canvas()
+{
+    return myLayers.composite();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the image size
+ * @return image size, empty if no image is loaded
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Size EditorCore::size() const
+{
+    return empty() ? Size() : myView.size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the crop rectangle
+ * @return the part of the canvas being edited, in canvas coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect EditorCore::cropRect() const
+{
+    return myView;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the function notified of changed image regions
+ * @param[in] callback called with the changed region in canvas coordinates, which can lie outside the crop rectangle
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setChangeCallback(const function<void(const Rect &region)> &callback)
+{
+    myChangeCallback = callback;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the stream operations are recorded to as commands
+ * @param[in] recorder output stream, NULL to stop recording
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setRecorder(ostream *recorder)
+{
+    myRecorder = recorder;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Pick the current color from the image
+ * @param[in] point pixel to pick
+ * @return the current color, unchanged if the point is outside the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Vec3b EditorCore::eyedrop(const Point &point)
+{
+    if (empty() || !Rect(Point(0, 0), size()).contains(point))
+    {
+        return myColor;
+    }
+
+    myColor = *(const Vec3b *)myLayers.composite().pixel(myView.x + point.x, myView.y + point.y);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "eyedrop " << point.x << " " << point.y << endl;
+    }
+    return myColor;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Crop the image
+ *
+ * Only the crop rectangle changes, the canvas keeps the pixels around it.
+ *
+ * @param[in] region region to keep, may have a negative width or height (a drag to the top left), clipped to the image
+ * @return false if the region does not overlap the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::crop(const Rect &region)
+{
+    if (empty())
+    {
+        return false;
+    }
+
+    Point corner = region.tl() + Point(region.width, region.height);
+    Rect clipped = Rect(region.tl(), corner) & Rect(Point(0, 0), size());
+    if (clipped.empty())
+    {
+        return false;
+    }
+
+    replaceCanvas(Ptr<TiledCanvas>(), clipped + myView.tl(), "crop");
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "crop " << clipped.x << " " << clipped.y << " " << clipped.width << " " << clipped.height << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Start a brush stroke in the current color
+ * @param[in] point first stroke position, with pixel centers at integer coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::beginStroke(const Point2f &point)
+{
+    if (empty())
+    {
+        return;
+    }
+
+    endStroke();
+    myHistory.begin(myLayers.layer(myLayers.active()).pixels, "pencil stroke");
+    myBrush.setColor(Scalar(myColor[0], myColor[1], myColor[2], 255));
+    paintSegment(myBrush.beginStroke(point + Point2f((float)myView.x, (float)myView.y)));
+
+    myStrokeRecord.str("");
+    myStrokeRecord << "stroke " << point.x << " " << point.y;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Extend the current stroke
+ * @param[in] point next stroke position
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::continueStroke(const Point2f &point)
+{
+    if (!myBrush.isStroking())
+    {
+        return;
+    }
+
+    paintSegment(myBrush.continueStroke(point + Point2f((float)myView.x, (float)myView.y)));
+    myStrokeRecord << " " << point.x << " " << point.y;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Finish the current stroke and record it for undo
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::endStroke()
+{
+    if (!myBrush.isStroking())
+    {
+        return;
+    }
+
+    myBrush.endStroke();
+    myHistory.commit();
+    if (myRecorder != NULL)
+    {
+        *myRecorder << myStrokeRecord.str() << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Fill the area around a seed pixel with the current color
+ *
+ * The fill is computed on a window of at most EDITOR_FILL_WINDOW_SIZE x EDITOR_FILL_WINDOW_SIZE pixels around the
+ * seed, gathered from the canvas, so memory stays bounded on huge images. Images smaller than the window are filled
+ * as a whole.
+ *
+ * @param[in] seed seed pixel
+ * @return false if the seed is outside the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::fill(const Point &seed)
+{
+    if (empty() || !Rect(Point(0, 0), size()).contains(seed))
+    {
+        return false;
+    }
+
+    Point canvasSeed = seed + myView.tl();
+    Rect window = Rect(canvasSeed.x - EDITOR_FILL_WINDOW_SIZE / 2, canvasSeed.y - EDITOR_FILL_WINDOW_SIZE / 2, EDITOR_FILL_WINDOW_SIZE, EDITOR_FILL_WINDOW_SIZE) & myView;
+    Mat windowPixels;
+    myLayers.composite().read(window, windowPixels);
+
+    // Find the fill area as a mask first, so only the tiles it covers are saved for undo before filling
+    Mat fillMask;
+    Rect fillRegion = myBucket.compute(windowPixels, canvasSeed - window.tl(), fillMask);
+    windowPixels.release();
+    if (fillRegion.empty())
+    {
+        return false;
+    }
+
+    Rect region = fillRegion + window.tl();
+    Scalar color(myColor[0], myColor[1], myColor[2], 255);
+    Ptr<TiledCanvas> layer = myLayers.layer(myLayers.active()).pixels;
+    myHistory.begin(layer, "paint bucket");
+    myHistory.touch(region, fillMask(fillRegion));
+    layer->forEachTile(region, [&](Mat &pixels, const Rect &pixelsRegion)
+    {
+        pixels.setTo(color, fillMask(pixelsRegion - window.tl()));
+    });
+    myHistory.commit();
+    myLayers.markPainted(region);
+    changed(region);
+
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "fill " << seed.x << " " << seed.y << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Preview a color adjustment of the active layer
+ *
+ * The composite is recomputed with the adjustment applied to the active layer as it is blended, so the preview
+ * matches what adjust() gives, but the layer and the history are not modified. Only the painted part of the region the
+ * front end shows is recomputed, so the cost of a preview depends on the view rather than the image size, and the
+ * front end calls this again when the view moves. The preview follows the active layer and lasts until endPreview(),
+ * adjust() or a save, which restore the regions it was shown in.
+ *
+ * @param[in] adjustment color adjustment, an identity adjustment ends the preview
+ * @param[in] visibleRegion image region shown by the front end
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::previewAdjustment(const ColorAdjustment &adjustment, const Rect &visibleRegion)
+{
+    if (empty())
+    {
+        return;
+    }
+    if (adjustment.isIdentity())
+    {
+        endPreview();
+        return;
+    }
+
+    myPreviewVisible = (visibleRegion + myView.tl()) & myView;
+    myLayers.setPreview([adjustment](const Mat &source, Mat &destination) { adjustment.apply(source, destination); });
+    changed(myLayers.usedRegion(myLayers.active()) & myPreviewVisible);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Remove the adjustment preview and restore the composite
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::endPreview()
+{
+    if (empty() || !myLayers.hasPreview())
+    {
+        return;
+    }
+
+    Rect region = myLayers.previewRegion();
+    myLayers.setPreview(function<void(const Mat &source, Mat &destination)>());
+    changed(region);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Apply a color adjustment to the active layer
+ *
+ * The adjusted pixels are written into a new canvas, which is then swapped with the layer and keeps the previous
+ * pixels for undo, so the history stores no copy of the layer. The painted tiles are processed in batches of half
+ * the resident tile budget: the tiles of a batch are paged in on this thread, as the canvases are not thread safe,
+ * and then adjusted in parallel. Tiles never painted on stay transparent and are skipped.
+ *
+ * @param[in] adjustment color adjustment
+ * @return false if no image is loaded, the adjustment does nothing or no canvas could be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::adjust(const ColorAdjustment &adjustment)
+{
+    if (empty() || adjustment.isIdentity())
+    {
+        return false;
+    }
+
+    endStroke();
+    Rect previewRegion = myLayers.previewRegion();
+    myLayers.setPreview(function<void(const Mat &source, Mat &destination)>());
+    Layer &layer = myLayers.layer(myLayers.active());
+    const TiledCanvas &source = *layer.pixels;
+    Ptr<TiledCanvas> adjusted = makePtr<TiledCanvas>();
+    if (!adjusted->create(source.size(), source.type(), myResidentTiles))
+    {
+        return false;
+    }
+
+    vector<Point> tiles;
+    for (int ty = 0; ty < source.tilesY(); ty++)
+    {
+        for (int tx = 0; tx < source.tilesX(); tx++)
+        {
+            if (layer.usedTiles[ty * source.tilesX() + tx])
+            {
+                tiles.push_back(Point(tx, ty));
+            }
+        }
+    }
+
+    const size_t batchSize = max((size_t)1, myResidentTiles / 2);
+    vector<Mat> sourceTiles, adjustedTiles;
+    for (size_t first = 0; first < tiles.size(); first += batchSize)
+    {
+        size_t last = min(tiles.size(), first + batchSize);
+        sourceTiles.clear();
+        adjustedTiles.clear();
+        for (size_t i = first; i < last; i++)
+        {
+            sourceTiles.push_back(source.tile(tiles[i].x, tiles[i].y));
+            adjustedTiles.push_back(adjusted->tile(tiles[i].x, tiles[i].y, true));
+        }
+
+        parallel_for_(Range(0, (int)sourceTiles.size()), [&](const Range &range)
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                adjustment.apply(sourceTiles[i], adjustedTiles[i]);
+            }
+        });
+    }
+
+    layer.pixels->swap(*adjusted);
+    myHistory.commitSwap(layer.pixels, adjusted, "color adjustment");
+    changed(myLayers.usedRegion(myLayers.active()) | previewRegion);
+
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "adjust ";
+        adjustment.write(*myRecorder);
+        *myRecorder << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Restore the image as it was loaded
+ * @return false if no image is loaded
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::reset()
+{
+    if (empty())
+    {
+        return false;
+    }
+
+    Ptr<TiledCanvas> canvas = myCanvasReset->clone();
+    if (!canvas)
+    {
+        return false;
+    }
+
+    replaceCanvas(canvas, Rect(Point(0, 0), canvas->size()), "reset");
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "reset" << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Revert the most recent operation
+ * @return false if there is nothing to undo
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::undo()
+{
+    endStroke();
+    Rect region;
+    if (empty() || !myHistory.undo(myLayers.layer(0).pixels, myView, region))
+    {
+        return false;
+    }
+
+    // the region may lie outside the crop rectangle as well
+    changed(region);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "undo" << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Re-apply the most recently undone operation
+ * @return false if there is nothing to redo
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::redo()
+{
+    endStroke();
+    Rect region;
+    if (empty() || !myHistory.redo(myLayers.layer(0).pixels, myView, region))
+    {
+        return false;
+    }
+
+    changed(region);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "redo" << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Add a transparent layer above the active layer and make it active
+ * @param[in] name layer name, a numbered name if empty
+ * @return index of the new layer, -1 on failure
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int EditorCore::addLayer(const string &name)
+{
+    if (empty())
+    {
+        return -1;
+    }
+
+    endStroke();
+    ostringstream layerName;
+    if (name.empty())
+    {
+        layerName << "layer " << myLayers.count();
+    }
+    else
+    {
+        layerName << name;
+    }
+
+    int index = myLayers.addLayer(layerName.str());
+    if (index < 0)
+    {
+        cout << "Error: could not add a layer" << endl;
+        return -1;
+    }
+    if (myLayers.hasPreview())
+    {
+        // the preview moves to the new, still empty, active layer
+        changed(myLayers.previewRegion());
+    }
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "addlayer " << name << endl;
+    }
+    return index;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Remove the active layer
+ *
+ * Undo steps painted on the layer remain in the history but no longer show.
+ *
+ * @return false if the active layer is the background
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::removeLayer()
+{
+    if (empty())
+    {
+        return false;
+    }
+
+    endStroke();
+    Rect region = myLayers.usedRegion(myLayers.active());
+    if (!myLayers.removeLayer(myLayers.active()))
+    {
+        return false;
+    }
+    changed(myLayers.hasPreview() ? (region | (myLayers.usedRegion(myLayers.active()) & myPreviewVisible)) : region);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "removelayer" << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Select the layer strokes and fills paint into
+ * @param[in] index layer index, 0 for the background
+ * @return false if there is no such layer
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::selectLayer(int index)
+{
+    endStroke();
+    if (!myLayers.setActive(index))
+    {
+        return false;
+    }
+    if (myLayers.hasPreview())
+    {
+        // the preview follows the active layer, within the view it is shown in
+        changed(myLayers.previewRegion() | (myLayers.usedRegion(index) & myPreviewVisible));
+    }
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "selectlayer " << index << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the opacity of the active layer
+ * @param[in] opacity opacity in [0, 1]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setLayerOpacity(float opacity)
+{
+    if (empty())
+    {
+        return;
+    }
+
+    myLayers.setOpacity(myLayers.active(), opacity);
+    changed(myLayers.usedRegion(myLayers.active()));
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "layeropacity " << myLayers.layer(myLayers.active()).opacity << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set how the active layer is combined with the layers below
+ * @param[in] blendMode blend mode
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setLayerBlendMode(BlendMode blendMode)
+{
+    if (empty())
+    {
+        return;
+    }
+
+    myLayers.setBlendMode(myLayers.active(), blendMode);
+    changed(myLayers.usedRegion(myLayers.active()));
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "blend " << LayerStack::blendModeName(blendMode) << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Show or hide the active layer
+ * @param[in] visible true to show the layer
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setLayerVisible(bool visible)
+{
+    if (empty())
+    {
+        return;
+    }
+
+    myLayers.setVisible(myLayers.active(), visible);
+    changed(myLayers.usedRegion(myLayers.active()));
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "visible " << (visible ? 1 : 0) << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the layers
+ * @return the layer stack, for display of the layer settings
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const LayerStack &EditorCore::layers() const
+{
+    return myLayers;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the current color used by strokes and fills
+ * @param[in] color BGR color
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setColor(const Vec3b &color)
+{
+    myColor = color;
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "color " << (int)color[0] << " " << (int)color[1] << " " << (int)color[2] << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the brush radius
+ * @param[in] radius radius in pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setBrushRadius(float radius)
+{
+    myBrush.setRadius(radius);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "radius " << myBrush.radius() << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the brush opacity
+ * @param[in] opacity opacity in [0, 1]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setBrushOpacity(float opacity)
+{
+    myBrush.setOpacity(opacity);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "opacity " << opacity << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the fill tolerance
+ * @param[in] tolerance largest per-channel difference to the seed color
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setFillTolerance(int tolerance)
+{
+    myBucket.setTolerance(tolerance);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "tolerance " << myBucket.tolerance() << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the fill connectivity
+ * @param[in] connectivity 4 or 8
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setFillConnectivity(int connectivity)
+{
+    myBucket.setConnectivity(connectivity);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "connectivity " << myBucket.connectivity() << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the color space of the fill tolerance
+ * @param[in] colorSpace FILL_RGB or FILL_LAB
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setFillColorSpace(FillColorSpace colorSpace)
+{
+    myBucket.setColorSpace(colorSpace);
+    if (myRecorder != NULL)
+    {
+        *myRecorder << "colorspace " << ((colorSpace == FILL_LAB) ? "lab" : "rgb") << endl;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the current color
+ * @return BGR color
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Vec3b EditorCore::color() const
+{
+    return myColor;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the brush, for its settings
+ * @return brush engine
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const BrushEngine &EditorCore::brush() const
+{
+    return myBrush;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the fill engine, for its settings
+ * @return fill engine
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const FloodFill &EditorCore::bucket() const
+{
+    return myBucket;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Run one text command
+ * @param[in] command command line, see the class description
+ * @return false if the command is invalid or failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::execute(const string &command)
+{
+    istringstream input(command);
+    string operation;
+    if (!(input >> operation) || operation[0] == '#')
+    {
+        return true;
+    }
+    if (operation != "load" && empty())
+    {
+        cout << "Error: no image loaded for \"" << command << "\"" << endl;
+        return false;
+    }
+
+    bool success = false;
+    if (operation == "load" || operation == "save")
+    {
+        string fileName;
+        getline(input >> ws, fileName);
+        success = !fileName.empty() && ((operation == "load") ? load(fileName) : save(fileName));
+    }
+    else if (operation == "color")
+    {
+        int b, g, r;
+        if (input >> b >> g >> r)
+        {
+            setColor(Vec3b(saturate_cast<uchar>(b), saturate_cast<uchar>(g), saturate_cast<uchar>(r)));
+            success = true;
+        }
+    }
+    else if (operation == "eyedrop")
+    {
+        Point point;
+        success = (input >> point.x >> point.y) && Rect(Point(0, 0), size()).contains(point);
+        if (success)
+        {
+            eyedrop(point);
+        }
+    }
+    else if (operation == "crop")
+    {
+        Rect region;
+        success = (input >> region.x >> region.y >> region.width >> region.height) && crop(region);
+    }
+    else if (operation == "fill")
+    {
+        Point seed;
+        success = (input >> seed.x >> seed.y) && fill(seed);
+    }
+    else if (operation == "stroke")
+    {
+        Point2f point;
+        if (input >> point.x >> point.y)
+        {
+            beginStroke(point);
+            while (input >> point.x >> point.y)
+            {
+                continueStroke(point);
+            }
+            endStroke();
+            success = true;
+        }
+    }
+    else if (operation == "reset")
+    {
+        success = reset();
+    }
+    else if (operation == "undo" || operation == "redo")
+    {
+        // nothing to undo or redo is not an error
+        if (operation == "undo")
+        {
+            undo();
+        }
+        else
+        {
+            redo();
+        }
+        success = true;
+    }
+    else if (operation == "radius" || operation == "opacity")
+    {
+        float value;
+        if (input >> value)
+        {
+            if (operation == "radius")
+            {
+                setBrushRadius(value);
+            }
+            else
+            {
+                setBrushOpacity(value);
+            }
+            success = true;
+        }
+    }
+    else if (operation == "tolerance" || operation == "connectivity")
+    {
+        int value;
+        if (input >> value)
+        {
+            if (operation == "tolerance")
+            {
+                setFillTolerance(value);
+            }
+            else
+            {
+                setFillConnectivity(value);
+            }
+            success = true;
+        }
+    }
+    else if (operation == "addlayer")
+    {
+        string name;
+        getline(input >> ws, name);
+        success = addLayer(name) >= 0;
+    }
+    else if (operation == "removelayer")
+    {
+        success = removeLayer();
+    }
+    else if (operation == "selectlayer")
+    {
+        int index;
+        success = (input >> index) && selectLayer(index);
+    }
+    else if (operation == "layeropacity")
+    {
+        float value;
+        if (input >> value)
+        {
+            setLayerOpacity(value);
+            success = true;
+        }
+    }
+    else if (operation == "blend")
+    {
+        string value;
+        BlendMode blendMode;
+        if ((input >> value) && LayerStack::blendModeFromName(value, blendMode))
+        {
+            setLayerBlendMode(blendMode);
+            success = true;
+        }
+    }
+    else if (operation == "visible")
+    {
+        int value;
+        if (input >> value)
+        {
+            setLayerVisible(value != 0);
+            success = true;
+        }
+    }
+    else if (operation == "adjust")
+    {
+        ColorAdjustment adjustment;
+        success = adjustment.read(input) && adjust(adjustment);
+    }
+    else if (operation == "colorspace")
+    {
+        string value;
+        if ((input >> value) && (value == "rgb" || value == "lab"))
+        {
+            setFillColorSpace((value == "lab") ? FILL_LAB : FILL_RGB);
+            success = true;
+        }
+    }
+
+    if (!success)
+    {
+        cout << "Error: invalid command \"" << command << "\"" << endl;
+    }
+    return success;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Run text commands until the end of a stream or the first failing command
+ * @param[in] script stream of commands, one per line
+ * @return false if a command failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::runScript(istream &script)
+{
+    string line;
+    int lineNumber = 0;
+    while (getline(script, line))
+    {
+        lineNumber++;
+        if (!execute(line))
+        {
+            cout << "Error in line " << lineNumber << (empty() ? "" : " while editing " + myName) << endl;
+            return false;
+        }
+    }
+    endStroke();
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Load an image as the background of a new document, clearing the history
+ * @param[in] fileName image file
+ * @return false if the file could not be read
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::loadImage(const string &fileName)
+{
+    LayerStack layers;
+    {
+        // the decoded image is only needed to fill the layers
+        Mat image = imread(fileName, IMREAD_COLOR);
+        if (!image.data || !layers.create(image, myResidentTiles))
+        {
+            cout << "Error while opening file " << fileName << endl;
+            return false;
+        }
+    }
+
+    // keep an untouched copy of the background, in its own scratch file, for reset
+    Ptr<TiledCanvas> canvasReset = layers.layer(0).pixels->clone();
+    if (!canvasReset)
+    {
+        return false;
+    }
+
+    endStroke();
+    myHistory.clear();
+    myLayers = layers;
+    myCanvasReset = canvasReset;
+    myView = Rect(Point(0, 0), myLayers.size());
+    setName(fileName);
+    changed(myView);
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Open a project, restoring its layers, crop rectangle and history
+ *
+ * Only the project index is read here, the canvases read their tiles from the project file when first accessed.
+ *
+ * @param[in] fileName project file
+ * @return false if the file is not a valid project
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::openProject(const string &fileName)
+{
+    ProjectFile file;
+    if (!file.open(fileName))
+    {
+        return false;
+    }
+
+    vector<Ptr<TiledCanvas> > canvases;
+    for (int i = 0; i < file.canvasCount(); i++)
+    {
+        canvases.push_back(file.canvas(i, myResidentTiles));
+        if (!canvases.back())
+        {
+            return false;
+        }
+    }
+
+    // document settings, in the order saveProject() writes them
+    Rect view;
+    int32_t compositeIndex, resetIndex, layerCount, active;
+    bool success = file.read(view) && file.read(compositeIndex) && file.read(resetIndex) && file.read(layerCount) && file.read(active) &&
+                   compositeIndex >= 0 && compositeIndex < (int32_t)canvases.size() && resetIndex >= 0 && resetIndex < (int32_t)canvases.size() && layerCount > 0 && layerCount <= LAYER_MAX_LAYERS;
+
+    vector<Layer> layerList(success ? layerCount : 0);
+    for (int32_t i = 0; success && i < layerCount; i++)
+    {
+        Layer &layer = layerList[i];
+        int32_t pixelsIndex, blendMode;
+        uint8_t visible;
+        uint32_t usedTiles;
+        success = file.readString(layer.name) && file.read(pixelsIndex) && file.read(layer.opacity) && file.read(blendMode) && file.read(visible) && file.read(usedTiles) &&
+                  pixelsIndex >= 0 && pixelsIndex < (int32_t)canvases.size() && blendMode >= BLEND_NORMAL && blendMode <= BLEND_ADD;
+        if (success)
+        {
+            layer.pixels = canvases[pixelsIndex];
+            layer.blendMode = (BlendMode)blendMode;
+            layer.visible = (visible != 0);
+            success = usedTiles <= file.remainingBytes();
+        }
+        if (success)
+        {
+            layer.usedTiles.resize(usedTiles);
+            success = (usedTiles == 0) || file.readBytes(&layer.usedTiles[0], usedTiles);
+        }
+    }
+
+    LayerStack layers;
+    EditHistory history;
+    success = success && layers.assign(layerList, active, canvases[compositeIndex], myResidentTiles) &&
+              (view & Rect(Point(0, 0), layers.size())) == view && !view.empty() &&
+              canvases[resetIndex]->size() == layers.size() && canvases[resetIndex]->type() == layers.layer(0).pixels->type() &&
+              history.read(file, canvases, layers.size(), layers.layer(0).pixels->type());
+    if (!success)
+    {
+        cout << "Error: " << fileName << " is not a valid project file" << endl;
+        return false;
+    }
+
+    endStroke();
+    myHistory = history;
+    myLayers = layers;
+    myCanvasReset = canvases[resetIndex];
+    myView = view;
+    setName(fileName);
+    if (myChangeCallback)
+    {
+        // the stored composite is up to date, so there is nothing to recompute
+        myChangeCallback(Rect(Point(0, 0), myLayers.size()));
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Save the whole document as a project
+ *
+ * Every canvas the document and its history refer to is stored once, as raw tiles, followed by the document settings
+ * and the history, see ProjectFile.
+ *
+ * @param[in] fileName project file
+ * @return false if writing failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::saveProject(const string &fileName)
+{
+    endStroke();
+    ProjectFile file;
+    if (!file.create(fileName))
+    {
+        return false;
+    }
+
+    // store each canvas once, whatever refers to it
+    vector<const TiledCanvas *> stored;
+    auto store = [&](const TiledCanvas &canvas) -> int32_t
+    {
+        vector<const TiledCanvas *>::iterator found = find(stored.begin(), stored.end(), &canvas);
+        if (found != stored.end())
+        {
+            return (int32_t)(found - stored.begin());
+        }
+        if (file.addCanvas(canvas) < 0)
+        {
+            return -1;
+        }
+        stored.push_back(&canvas);
+        return (int32_t)stored.size() - 1;
+    };
+
+    vector<Ptr<TiledCanvas> > historyCanvases;
+    myHistory.canvases(historyCanvases);
+    bool success = store(myLayers.composite()) >= 0 && store(*myCanvasReset) >= 0;
+    for (int i = 0; success && i < myLayers.count(); i++)
+    {
+        success = store(*myLayers.layer(i).pixels) >= 0;
+    }
+    for (size_t i = 0; success && i < historyCanvases.size(); i++)
+    {
+        success = store(*historyCanvases[i]) >= 0;
+    }
+    if (!success)
+    {
+        return false;
+    }
+
+    // document settings
+    file.write(myView);
+    file.write(store(myLayers.composite()));
+    file.write(store(*myCanvasReset));
+    file.write((int32_t)myLayers.count());
+    file.write((int32_t)myLayers.active());
+    for (int i = 0; i < myLayers.count(); i++)
+    {
+        const Layer &layer = myLayers.layer(i);
+        file.writeString(layer.name);
+        file.write(store(*layer.pixels));
+        file.write(layer.opacity);
+        file.write((int32_t)layer.blendMode);
+        file.write((uint8_t)(layer.visible ? 1 : 0));
+        file.write((uint32_t)layer.usedTiles.size());
+        file.writeBytes(layer.usedTiles.data(), layer.usedTiles.size());
+    }
+    myHistory.write(file, [&](const Ptr<TiledCanvas> &canvas) { return store(*canvas); });
+
+    if (!file.finish())
+    {
+        return false;
+    }
+    cout << "Saved " << fileName << endl;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Substitute the name of the loaded file into an output file name
+ * @param[in] fileName file name, possibly containing EDITOR_NAME_PLACEHOLDER
+ * @return file name to write
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+string EditorCore::outputName(const string &fileName) const
+{
+    string name = fileName;
+    size_t position = name.find(EDITOR_NAME_PLACEHOLDER);
+    if (position != string::npos)
+    {
+        name.replace(position, string(EDITOR_NAME_PLACEHOLDER).size(), myName);
+    }
+    return name;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Remember the name of the loaded file, without directory and extension
+ * @param[in] fileName loaded file
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::setName(const string &fileName)
+{
+    size_t start = fileName.find_last_of("/\\");
+    myName = fileName.substr((start == string::npos) ? 0 : start + 1);
+    myName = myName.substr(0, myName.find_last_of('.'));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether a file name refers to a project
+ * @param[in] fileName file name
+ * @return true if the name ends in EDITOR_PROJECT_EXTENSION
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool EditorCore::isProject(const string &fileName)
+{
+    const string extension = EDITOR_PROJECT_EXTENSION;
+    return fileName.size() > extension.size() && fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Update the composite over a changed region and report it to the front end
+ * @param[in] region changed region in canvas coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::changed(const Rect &region)
+{
+    myLayers.update(region);
+    if (myChangeCallback)
+    {
+        myChangeCallback(region);
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Draw one brush segment into the canvas, recording it for undo
+ * @param[in] segment segment to draw
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::paintSegment(const BrushSegment &segment)
+{
+    Rect region = segment.bounds() & myView;
+    if (region.empty())
+    {
+        return;
+    }
+
+    // draw into every tile under the segment, in the tile's own coordinates
+    myHistory.touch(region);
+    myLayers.layer(myLayers.active()).pixels->forEachTile(region, [&](Mat &pixels, const Rect &pixelsRegion)
+    {
+        BrushSegment local = segment;
+        local.start -= Point2f((float)pixelsRegion.x, (float)pixelsRegion.y);
+        local.end -= Point2f((float)pixelsRegion.x, (float)pixelsRegion.y);
+        myBrush.draw(pixels, local, pixelsRegion.tl());
+    });
+    myLayers.markPainted(region);
+    changed(region);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Replace the background layer or the crop rectangle, recording the previous ones for undo
+ * @param[in] canvas new background pixels, empty to keep the current ones
+ * @param[in] view new crop rectangle, in canvas coordinates
+ * @param[in] name operation name, for the history
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void EditorCore::replaceCanvas(const Ptr<TiledCanvas> &canvas, const Rect &view, const string &name)
+{
+    endStroke();
+    Ptr<TiledCanvas> canvasPrevious;
+    if (canvas)
+    {
+        canvasPrevious = myLayers.layer(0).pixels;
+        myLayers.layer(0).pixels = canvas;
+    }
+    Rect viewPrevious = myView;
+    myView = view;
+    myHistory.commitReplacement(canvasPrevious, viewPrevious, name);
+    changed(canvas ? Rect(Point(0, 0), canvas->size()) : myView);
+}
@@ -0,0 +1,180 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file EditorCore.h
+ * @brief Header file for the EditorCore class
+ *
+ * This class holds the editing state and operations of the raster editor, independent of any window
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef EDITORCORE_H
+#define EDITORCORE_H
+
+#include <functional>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+#include "BrushEngine.h"
+#include "ColorAdjustment.h"
+#include "EditHistory.h"
+#include "FloodFill.h"
+#include "LayerStack.h"
+#include "ProjectFile.h"
+#include "TiledCanvas.h"
+
+using namespace std;
+using namespace cv;
+
+// default editor parameters
+#define EDITOR_FILL_WINDOW_SIZE 8192
+#define EDITOR_NAME_PLACEHOLDER "{name}"
+#define EDITOR_PROJECT_EXTENSION ".rge"
+
+/*******************************************************************************************************************/ /**
+ * @class EditorCore
+ *
+ * @brief Window-independent raster editor
+ *
+ * The editor is a set of operations on a LayerStack: eyedrop, crop, stroke, fill, adjust, reset, undo and redo, plus the
+ * brush, fill and layer settings. Strokes and fills paint into the active layer, while eyedrop and the fill area look
+ * at the composite, as the image is seen. The HighGUI front end translates mouse and key events into these operations, and the same
+ * operations can be driven by text commands, one per line:
+ *
+ *     load <file>                   save <file>
+ *     color <b> <g> <r>             eyedrop <x> <y>
+ *     crop <x> <y> <width> <height> fill <x> <y>
+ *     stroke <x> <y> [<x> <y> ...]  reset
+ *     radius <pixels>               opacity <0..1>
+ *     tolerance <0..255>            connectivity <4|8>
+ *     colorspace <rgb|lab>          undo / redo
+ *     addlayer [<name>]             removelayer
+ *     selectlayer <index>           layeropacity <0..1>
+ *     blend <normal|multiply|screen|add>
+ *     visible <0|1>
+ *     adjust [levels <in black> <in white> <gamma> <out black> <out white>] [curve <in> <out> ...] [hsv <hue> <s> <v>]
+ *
+ * Blank lines and lines starting with # are ignored, and {name} in file names is replaced by the name of the loaded
+ * file without directory and extension. Files ending in EDITOR_PROJECT_EXTENSION are projects (see ProjectFile)
+ * holding the layers, the crop rectangle and the undo history, all other files are images. When a recorder stream is set, every operation is also written to it as a
+ * command, so an interactive session can be replayed on other images. Changed canvas regions are reported through
+ * the change callback, which the front end uses to redraw.
+ *
+ * Crop is non-destructive: it only narrows the crop rectangle, a view into the canvas, so it costs O(1), keeps the
+ * pixels around it for undo and is only materialized by save(). All coordinates taken and reported by the editor are
+ * relative to the crop rectangle.
+ *
+ * Each EditorCore is independent, so several can run in parallel threads.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class EditorCore
+{
+private:
+
+    LayerStack myLayers;
+    Ptr<TiledCanvas> myCanvasReset;
+    Rect myView;                    // crop rectangle, in canvas coordinates
+    Rect myPreviewVisible;          // region the front end shows the adjustment preview in, in canvas coordinates
+    size_t myResidentTiles;
+    string myName;
+
+    EditHistory myHistory;
+    BrushEngine myBrush;
+    FloodFill myBucket;
+    Vec3b myColor;
+
+    function<void(const Rect &region)> myChangeCallback;
+    ostream *myRecorder;
+    ostringstream myStrokeRecord;
+    future<bool> mySaveResult;
+
+    void changed(const Rect &region);
+    void paintSegment(const BrushSegment &segment);
+    bool loadImage(const string &fileName);
+    bool openProject(const string &fileName);
+    bool saveProject(const string &fileName);
+    string outputName(const string &fileName) const;
+    void setName(const string &fileName);
+    static bool isProject(const string &fileName);
+    void replaceCanvas(const Ptr<TiledCanvas> &canvas, const Rect &view, const string &name);
+
+public:
+
+    // constructors
+    EditorCore(size_t residentTiles=CANVAS_MAX_RESIDENT_TILES);
+
+    // image
+    bool load(const string &fileName);
+    bool save(const string &fileName);
+    bool saveAsync(const string &fileName);
+    bool isSaving() const;
+    bool waitForSave();
+    bool empty() const;
+    TiledCanvas &canvas();
+    Size size() const;
+    Rect cropRect() const;
+
+    // front end hooks
+    void setChangeCallback(const function<void(const Rect &region)> &callback);
+    void setRecorder(ostream *recorder);
+
+    // operations
+    Vec3b eyedrop(const Point &point);
+    bool crop(const Rect &region);
+    void beginStroke(const Point2f &point);
+    void continueStroke(const Point2f &point);
+    void endStroke();
+    bool fill(const Point &seed);
+    bool adjust(const ColorAdjustment &adjustment);
+    void previewAdjustment(const ColorAdjustment &adjustment, const Rect &visibleRegion);
+    void endPreview();
+    bool reset();
+    bool undo();
+    bool redo();
+
+    // layers, the layer operations are not undoable
+    int addLayer(const string &name);
+    bool removeLayer();
+    bool selectLayer(int index);
+    void setLayerOpacity(float opacity);
+    void setLayerBlendMode(BlendMode blendMode);
+    void setLayerVisible(bool visible);
+    const LayerStack &layers() const;
+
+    // settings
+    void setColor(const Vec3b &color);
+    void setBrushRadius(float radius);
+    void setBrushOpacity(float opacity);
+    void setFillTolerance(int tolerance);
+    void setFillConnectivity(int connectivity);
+    void setFillColorSpace(FillColorSpace colorSpace);
+    Vec3b color() const;
+    const BrushEngine &brush() const;
+    const FloodFill &bucket() const;
+
+    // scripting
+    bool execute(const string &command);
+    bool runScript(istream &script);
+};
+
+#endif // EDITORCORE_H
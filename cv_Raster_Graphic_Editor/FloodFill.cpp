@@ -0,0 +1,317 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file FloodFill.cpp
+ * @brief Implementation of the FloodFill class
+ *
+ * This class computes paint bucket fill areas with a color tolerance
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "FloodFill.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @param[in] tolerance largest per-channel difference to the seed color
+ * @param[in] connectivity 4 or 8
+ * @param[in] colorSpace color space in which the tolerance is measured
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+FloodFill::FloodFill(int tolerance, int connectivity, FillColorSpace colorSpace) : myTolerance(FILL_DEFAULT_TOLERANCE), myConnectivity(FILL_DEFAULT_CONNECTIVITY), myColorSpace(colorSpace), myParallelMinPixels(FILL_PARALLEL_MIN_PIXELS)
+{
+    setTolerance(tolerance);
+    setConnectivity(connectivity);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the color tolerance
+ * @param[in] tolerance largest per-channel difference to the seed color, clamped to [0, FILL_MAX_TOLERANCE]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void FloodFill::setTolerance(int tolerance)
+{
+    myTolerance = min(FILL_MAX_TOLERANCE, max(0, tolerance));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the pixel connectivity
+ * @param[in] connectivity 8 for 8-connected fills, anything else for 4-connected fills
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void FloodFill::setConnectivity(int connectivity)
+{
+    myConnectivity = (connectivity == 8) ? 8 : 4;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the color space in which the tolerance is measured
+ * @param[in] colorSpace FILL_RGB or FILL_LAB, Lab applies to 3 channel images only
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void FloodFill::setColorSpace(FillColorSpace colorSpace)
+{
+    myColorSpace = colorSpace;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the fill size above which the parallel fill is used
+ * @param[in] pixels number of filled pixels, 0 to always use the parallel fill
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void FloodFill::setParallelThreshold(size_t pixels)
+{
+    myParallelMinPixels = pixels;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the color tolerance
+ * @return largest per-channel difference to the seed color
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int FloodFill::tolerance() const
+{
+    return myTolerance;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the pixel connectivity
+ * @return 4 or 8
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int FloodFill::connectivity() const
+{
+    return myConnectivity;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the color space in which the tolerance is measured
+ * @return FILL_RGB or FILL_LAB
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+FillColorSpace FloodFill::colorSpace() const
+{
+    return myColorSpace;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Compute the area filled from a seed pixel
+ * @param[in] image 8-bit image with 1 to 4 channels
+ * @param[in] seed seed pixel
+ * @param[out] mask 8-bit mask the size of the image, 255 inside the fill area
+ * @return bounding box of the fill area, empty if the seed is outside the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect FloodFill::compute(const Mat &image, const Point &seed, Mat &mask)
+{
+    mask.create(image.size(), CV_8UC1);
+    mask.setTo(Scalar(0));
+    if (image.empty() || image.depth() != CV_8U || !Rect(0, 0, image.cols, image.rows).contains(seed))
+    {
+        return Rect();
+    }
+
+    // compare colors in Lab if requested, converting once for the whole fill
+    Mat source = image;
+    if (myColorSpace == FILL_LAB && image.channels() == 3)
+    {
+        cvtColor(image, source, COLOR_BGR2Lab);
+    }
+
+    Scalar lower, upper;
+    matchRange(source, seed, lower, upper);
+
+    Rect region;
+    if (!spanFill(source, seed, lower, upper, mask, region))
+    {
+        parallelFill(source, seed, lower, upper, mask, region);
+    }
+    return region;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Range of channel values that belong to the fill
+ * @param[in] source image in the comparison color space
+ * @param[in] seed seed pixel
+ * @param[out] lower smallest value per channel
+ * @param[out] upper largest value per channel
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void FloodFill::matchRange(const Mat &source, const Point &seed, Scalar &lower, Scalar &upper) const
+{
+    const int channels = source.channels();
+    const uchar *pixel = source.ptr<uchar>(seed.y) + seed.x * channels;
+    for (int c = 0; c < channels; c++)
+    {
+        lower[c] = max(0, pixel[c] - myTolerance);
+        upper[c] = min(255, pixel[c] + myTolerance);
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Scanline fill with a span stack
+ *
+ * Each popped seed is grown into the longest matching run of its row, the run is written to the mask in one go, and
+ * one seed is pushed per matching run on the rows above and below. The fill is abandoned once it grows past the
+ * parallel threshold.
+ *
+ * @param[in] source image in the comparison color space
+ * @param[in] seed seed pixel
+ * @param[in] lower smallest value per channel
+ * @param[in] upper largest value per channel
+ * @param[in,out] mask cleared mask, 255 inside the fill area on return
+ * @param[out] region bounding box of the fill area
+ * @return false if the fill was abandoned, the mask then holds a partial fill
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool FloodFill::spanFill(const Mat &source, const Point &seed, const Scalar &lower, const Scalar &upper, Mat &mask, Rect &region)
+{
+    const int channels = source.channels();
+    const int reach = (myConnectivity == 8) ? 1 : 0;
+    uchar lo[4], hi[4];
+    for (int c = 0; c < channels; c++)
+    {
+        lo[c] = (uchar)lower[c];
+        hi[c] = (uchar)upper[c];
+    }
+
+    // unfilled pixel within the tolerance
+    auto matches = [&](const uchar *row, const uchar *maskRow, int x) -> bool
+    {
+        if (maskRow[x] != 0)
+        {
+            return false;
+        }
+        const uchar *pixel = row + x * channels;
+        for (int c = 0; c < channels; c++)
+        {
+            if (pixel[c] < lo[c] || pixel[c] > hi[c])
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    size_t filled = 0;
+    int minX = seed.x, maxX = seed.x, minY = seed.y, maxY = seed.y;
+    mySeeds.clear();
+    mySeeds.push_back(seed);
+    while (!mySeeds.empty())
+    {
+        Point point = mySeeds.back();
+        mySeeds.pop_back();
+
+        const uchar *row = source.ptr<uchar>(point.y);
+        uchar *maskRow = mask.ptr<uchar>(point.y);
+        if (!matches(row, maskRow, point.x))
+        {
+            continue;
+        }
+
+        // grow the seed into a run
+        int left = point.x;
+        int right = point.x;
+        while (left > 0 && matches(row, maskRow, left - 1))
+        {
+            left--;
+        }
+        while (right < source.cols - 1 && matches(row, maskRow, right + 1))
+        {
+            right++;
+        }
+        memset(maskRow + left, 255, right - left + 1);
+
+        filled += right - left + 1;
+        if (filled > myParallelMinPixels)
+        {
+            return false;
+        }
+        minX = min(minX, left);
+        maxX = max(maxX, right);
+        minY = min(minY, point.y);
+        maxY = max(maxY, point.y);
+
+        // one seed per matching run on the neighboring rows
+        for (int y = point.y - 1; y <= point.y + 1; y += 2)
+        {
+            if (y < 0 || y >= source.rows)
+            {
+                continue;
+            }
+
+            const uchar *neighborRow = source.ptr<uchar>(y);
+            const uchar *neighborMask = mask.ptr<uchar>(y);
+            bool inRun = false;
+            for (int x = max(0, left - reach); x <= min(source.cols - 1, right + reach); x++)
+            {
+                if (matches(neighborRow, neighborMask, x))
+                {
+                    if (!inRun)
+                    {
+                        mySeeds.push_back(Point(x, y));
+                    }
+                    inRun = true;
+                }
+                else
+                {
+                    inRun = false;
+                }
+            }
+        }
+    }
+
+    region = Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Data-parallel fill for large areas
+ *
+ * All pixels within the tolerance are marked with inRange, then labeled with OpenCV's parallel two-pass connected
+ * component algorithm, and the component containing the seed becomes the fill area.
+ *
+ * @param[in] source image in the comparison color space
+ * @param[in] seed seed pixel
+ * @param[in] lower smallest value per channel
+ * @param[in] upper largest value per channel
+ * @param[out] mask 255 inside the fill area
+ * @param[out] region bounding box of the fill area
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void FloodFill::parallelFill(const Mat &source, const Point &seed, const Scalar &lower, const Scalar &upper, Mat &mask, Rect &region) const
+{
+    Mat candidates;
+    inRange(source, lower, upper, candidates);
+
+    Mat labels, stats, centroids;
+    connectedComponentsWithStats(candidates, labels, stats, centroids, myConnectivity, CV_32S, CCL_DEFAULT);
+
+    int label = labels.at<int>(seed.y, seed.x);
+    region = Rect(stats.at<int>(label, CC_STAT_LEFT), stats.at<int>(label, CC_STAT_TOP), stats.at<int>(label, CC_STAT_WIDTH), stats.at<int>(label, CC_STAT_HEIGHT));
+
+    mask.setTo(Scalar(0));
+    Mat maskRegion = mask(region);
+    compare(labels(region), Scalar(label), maskRegion, CMP_EQ);
+}
@@ -0,0 +1,98 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file FloodFill.h
+ * @brief Header file for the FloodFill class
+ *
+ * This class computes paint bucket fill areas with a color tolerance
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+using namespace cv;
+
+// default fill parameters
+#define FILL_DEFAULT_TOLERANCE 0
+#define FILL_DEFAULT_CONNECTIVITY 4
+#define FILL_MAX_TOLERANCE 255
+#define FILL_PARALLEL_MIN_PIXELS (2 * 1024 * 1024)
+
+// color space in which the tolerance is measured
+enum FillColorSpace
+{
+    FILL_RGB,
+    FILL_LAB
+};
+
+/*******************************************************************************************************************/ /**
+ * @class FloodFill
+ *
+ * @brief Paint bucket fill engine
+ *
+ * A pixel belongs to the fill if every channel differs from the seed pixel by at most the tolerance, measured in the
+ * image color space or in CIE Lab, and it is 4- or 8-connected to the seed through such pixels.
+ *
+ * Fills are computed with a scanline span stack, which visits each filled row run once. When the fill grows past
+ * the parallel threshold the span fill is abandoned and the area is recomputed in two data-parallel passes: a
+ * per-pixel tolerance test (inRange) and OpenCV's parallel two-pass connected component labeling, keeping the
+ * component of the seed. Small fills thus never pay for a full image pass, and huge fills use every core.
+ *
+ * The result is a mask the size of the image, which is used both to paint and to save only the tiles it covers.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class FloodFill
+{
+private:
+
+    int myTolerance;
+    int myConnectivity;
+    FillColorSpace myColorSpace;
+    size_t myParallelMinPixels;
+    vector<Point> mySeeds;
+
+    void matchRange(const Mat &source, const Point &seed, Scalar &lower, Scalar &upper) const;
+    bool spanFill(const Mat &source, const Point &seed, const Scalar &lower, const Scalar &upper, Mat &mask, Rect &region);
+    void parallelFill(const Mat &source, const Point &seed, const Scalar &lower, const Scalar &upper, Mat &mask, Rect &region) const;
+
+public:
+
+    // constructors
+    FloodFill(int tolerance=FILL_DEFAULT_TOLERANCE, int connectivity=FILL_DEFAULT_CONNECTIVITY, FillColorSpace colorSpace=FILL_RGB);
+
+    // fill settings
+    void setTolerance(int tolerance);
+    void setConnectivity(int connectivity);
+    void setColorSpace(FillColorSpace colorSpace);
+    void setParallelThreshold(size_t pixels);
+    int tolerance() const;
+    int connectivity() const;
+    FillColorSpace colorSpace() const;
+
+    // fill computation
+    Rect compute(const Mat &image, const Point &seed, Mat &mask);
+};
+
+#endif // FLOODFILL_H
@@ -0,0 +1,578 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file LayerStack.cpp
+ * @brief Implementation of the LayerStack class
+ *
+ * This class holds the layers of the edited document and their composite
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "LayerStack.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+// names of the blend modes, in BlendMode order
+static const char *const blendModeNames[] = {"normal", "multiply", "screen", "add"};
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor, creates an empty stack
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+LayerStack::LayerStack() : myActive(0), myResidentTiles(CANVAS_MAX_RESIDENT_TILES)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Replace the stack by a single opaque background layer, the composite has to be updated afterwards
+ * @param[in] image BGR image the background is created from
+ * @param[in] residentTiles number of tiles kept in memory per layer, see TiledCanvas
+ * @return false if the scratch files could not be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::create(const Mat &image, size_t residentTiles)
+{
+    Layer background;
+    background.name = LAYER_BACKGROUND_NAME;
+    background.pixels = makePtr<TiledCanvas>();
+    background.opacity = 1.0f;
+    background.blendMode = BLEND_NORMAL;
+    background.visible = true;
+
+    Ptr<TiledCanvas> composite = makePtr<TiledCanvas>();
+    if (!background.pixels->create(image.size(), CV_8UC4, residentTiles) || !composite->create(image.size(), CV_8UC3, residentTiles))
+    {
+        return false;
+    }
+
+    // convert tile by tile, so no second full size copy of the image is made
+    Rect bounds(Point(0, 0), image.size());
+    background.pixels->forEachTile(bounds, [&](Mat &pixels, const Rect &pixelsRegion)
+    {
+        cvtColor(image(pixelsRegion), pixels, COLOR_BGR2BGRA);
+    });
+    background.usedTiles.assign(background.pixels->tilesX() * background.pixels->tilesY(), 1);
+
+    myLayers.clear();
+    myLayers.push_back(background);
+    myActive = 0;
+    myComposite = composite;
+    myResidentTiles = residentTiles;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Replace the stack by existing layers and their composite, such as the ones stored in a project
+ * @param[in] layers layers, bottom first, all BGRA and the size of the composite
+ * @param[in] active index of the active layer
+ * @param[in] composite up to date BGR composite of the layers
+ * @param[in] residentTiles number of tiles kept in memory by layers added later, see TiledCanvas
+ * @return false if the layers do not match the composite
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::assign(const vector<Layer> &layers, int active, const Ptr<TiledCanvas> &composite, size_t residentTiles)
+{
+    if (layers.empty() || (int)layers.size() > LAYER_MAX_LAYERS || active < 0 || active >= (int)layers.size() || !composite || composite->type() != CV_8UC3)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const Layer &layer = layers[i];
+        if (!layer.pixels || layer.pixels->size() != composite->size() || layer.pixels->type() != CV_8UC4 || (int)layer.usedTiles.size() != composite->tilesX() * composite->tilesY())
+        {
+            return false;
+        }
+    }
+
+    myLayers = layers;
+    myActive = active;
+    myComposite = composite;
+    myResidentTiles = residentTiles;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether the stack has been created
+ * @return true before a successful create()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::empty() const
+{
+    return myLayers.empty();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the document size
+ * @return size shared by all layers
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Size LayerStack::size() const
+{
+    return empty() ? Size() : myComposite->size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Add a transparent layer above the active layer and make it active
+ * @param[in] name layer name
+ * @return index of the new layer, -1 if the layer limit is reached or its scratch file could not be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int LayerStack::addLayer(const string &name)
+{
+    if (empty() || (int)myLayers.size() >= LAYER_MAX_LAYERS)
+    {
+        return -1;
+    }
+
+    // a new scratch file reads as zeros, which is transparent black
+    Layer layer;
+    layer.name = name;
+    layer.pixels = makePtr<TiledCanvas>();
+    layer.opacity = 1.0f;
+    layer.blendMode = BLEND_NORMAL;
+    layer.visible = true;
+    if (!layer.pixels->create(size(), CV_8UC4, myResidentTiles))
+    {
+        return -1;
+    }
+    layer.usedTiles.assign(layer.pixels->tilesX() * layer.pixels->tilesY(), 0);
+
+    myActive++;
+    myLayers.insert(myLayers.begin() + myActive, layer);
+    return myActive;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Remove a layer, the composite has to be updated over its usedRegion() taken before
+ * @param[in] index layer index
+ * @return false if the index is invalid or the background
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::removeLayer(int index)
+{
+    if (index <= 0 || index >= (int)myLayers.size())
+    {
+        return false;
+    }
+
+    myLayers.erase(myLayers.begin() + index);
+    if (myActive >= index && myActive > 0)
+    {
+        myActive--;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of layers
+ * @return number of layers, 0 before create()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int LayerStack::count() const
+{
+    return (int)myLayers.size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Access a layer
+ * @param[in] index layer index, 0 for the background
+ * @return the layer
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Layer &LayerStack::layer(int index)
+{
+    return myLayers[index];
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Access a layer
+ * @param[in] index layer index, 0 for the background
+ * @return the layer
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const Layer &LayerStack::layer(int index) const
+{
+    return myLayers[index];
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Select the layer tools paint into
+ * @param[in] index layer index
+ * @return false if the index is invalid
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::setActive(int index)
+{
+    if (index < 0 || index >= (int)myLayers.size())
+    {
+        return false;
+    }
+    myActive = index;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the layer tools paint into
+ * @return active layer index
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int LayerStack::active() const
+{
+    return myActive;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Region a layer has been painted on
+ * @param[in] index layer index
+ * @return bounding box of the used tiles, where changing the layer affects the composite
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect LayerStack::usedRegion(int index) const
+{
+    const Layer &layer = myLayers[index];
+    Rect region;
+    for (int ty = 0; ty < layer.pixels->tilesY(); ty++)
+    {
+        for (int tx = 0; tx < layer.pixels->tilesX(); tx++)
+        {
+            if (layer.usedTiles[ty * layer.pixels->tilesX() + tx])
+            {
+                Rect tileRegion = layer.pixels->tileRect(tx, ty);
+                region = region.empty() ? tileRegion : (region | tileRegion);
+            }
+        }
+    }
+    return region;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the opacity of a layer
+ * @param[in] index layer index
+ * @param[in] opacity opacity in [0, 1]
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::setOpacity(int index, float opacity)
+{
+    myLayers[index].opacity = min(1.0f, max(0.0f, opacity));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the blend mode of a layer
+ * @param[in] index layer index
+ * @param[in] blendMode how the layer is combined with the layers below
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::setBlendMode(int index, BlendMode blendMode)
+{
+    myLayers[index].blendMode = blendMode;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Show or hide a layer
+ * @param[in] index layer index
+ * @param[in] visible true to include the layer in the composite
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::setVisible(int index, bool visible)
+{
+    myLayers[index].visible = visible;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Mark the tiles of the active layer under a region as painted on
+ *
+ * Must be called for every region a tool writes to, before update().
+ *
+ * @param[in] region painted region
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::markPainted(const Rect &region)
+{
+    Layer &layer = myLayers[myActive];
+    Rect clipped = region & Rect(Point(0, 0), size());
+    if (clipped.empty())
+    {
+        return;
+    }
+
+    for (int ty = clipped.y / CANVAS_TILE_SIZE; ty <= (clipped.y + clipped.height - 1) / CANVAS_TILE_SIZE; ty++)
+    {
+        for (int tx = clipped.x / CANVAS_TILE_SIZE; tx <= (clipped.x + clipped.width - 1) / CANVAS_TILE_SIZE; tx++)
+        {
+            layer.usedTiles[ty * layer.pixels->tilesX() + tx] = 1;
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the filter previewed on the active layer, the composite has to be updated afterwards over the regions to
+ *        show it in, or over previewRegion() when it is removed
+ * @param[in] preview called with the active layer pixels of each composited piece, writing the previewed pixels of
+ *                    the same size and type, empty for none
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::setPreview(const function<void(const Mat &source, Mat &destination)> &preview)
+{
+    myPreview = preview;
+    if (!myPreview)
+    {
+        myPreviewRegion = Rect();
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether a preview filter is set
+ * @return true while the composite shows a preview of the active layer
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::hasPreview() const
+{
+    return (bool)myPreview;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the composite region updated since the preview filter was set
+ * @return bounding box of the regions that may show the preview, empty without a preview
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect LayerStack::previewRegion() const
+{
+    return myPreviewRegion;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Recompute the composite over a region
+ * @param[in] region changed region, clipped to the document
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::update(const Rect &region)
+{
+    if (empty())
+    {
+        return;
+    }
+
+    Rect clipped = region & Rect(Point(0, 0), size());
+    if (clipped.empty())
+    {
+        return;
+    }
+    if (myPreview)
+    {
+        myPreviewRegion |= clipped;
+    }
+
+    vector<Point> tiles;
+    for (int ty = clipped.y / CANVAS_TILE_SIZE; ty <= (clipped.y + clipped.height - 1) / CANVAS_TILE_SIZE; ty++)
+    {
+        for (int tx = clipped.x / CANVAS_TILE_SIZE; tx <= (clipped.x + clipped.width - 1) / CANVAS_TILE_SIZE; tx++)
+        {
+            tiles.push_back(Point(tx, ty));
+        }
+    }
+
+    // the tiles of a batch are paged in on this thread, then blended in parallel
+    const size_t batchSize = max((size_t)1, myResidentTiles / 2);
+    vector<Piece> pieces;
+    for (size_t first = 0; first < tiles.size(); first += batchSize)
+    {
+        size_t last = min(tiles.size(), first + batchSize);
+        pieces.resize(last - first);
+        for (size_t i = first; i < last; i++)
+        {
+            Rect tileRegion = myComposite->tileRect(tiles[i].x, tiles[i].y);
+            gatherPiece(tiles[i].x, tiles[i].y, tileRegion & clipped, pieces[i - first]);
+        }
+
+        parallel_for_(Range(0, (int)pieces.size()), [&](const Range &range)
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                compositePiece(pieces[i]);
+            }
+        });
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the composite of the visible layers
+ * @return BGR canvas the size of the document
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+TiledCanvas &LayerStack::composite()
+{
+    return *myComposite;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the composite of the visible layers
+ * @return BGR canvas the size of the document
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const TiledCanvas &LayerStack::composite() const
+{
+    return *myComposite;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the name of a blend mode
+ * @param[in] blendMode blend mode
+ * @return lower case name
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const char *LayerStack::blendModeName(BlendMode blendMode)
+{
+    return blendModeNames[blendMode];
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Look up a blend mode by name
+ * @param[in] name lower case name
+ * @param[out] blendMode blend mode, unchanged if the name is unknown
+ * @return false if the name is unknown
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool LayerStack::blendModeFromName(const string &name, BlendMode &blendMode)
+{
+    for (int i = BLEND_NORMAL; i <= BLEND_ADD; i++)
+    {
+        if (name == blendModeNames[i])
+        {
+            blendMode = (BlendMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Page in the composite and the contributing layers over a piece of one tile
+ * @param[in] tx tile column
+ * @param[in] ty tile row
+ * @param[in] region piece region, inside the tile
+ * @param[out] piece composite pixels and contributing layers of the piece
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::gatherPiece(int tx, int ty, const Rect &region, Piece &piece)
+{
+    const int tileIndex = ty * myComposite->tilesX() + tx;
+    const Rect pieceRegion = region - myComposite->tileRect(tx, ty).tl();
+
+    piece.destination = myComposite->tile(tx, ty, true)(pieceRegion);
+    piece.layers.clear();
+    piece.layerPixels.clear();
+    for (int i = 0; i < (int)myLayers.size(); i++)
+    {
+        const Layer &layer = myLayers[i];
+        if (layer.visible && layer.opacity > 0.0f && layer.usedTiles[tileIndex])
+        {
+            piece.layers.push_back(i);
+            piece.layerPixels.push_back(static_cast<const TiledCanvas &>(*layer.pixels).tile(tx, ty)(pieceRegion));
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Blend the layers over a piece of one tile
+ *
+ * The layers are accumulated bottom up over black in premultiplied floating point, with Cs the layer color and As its
+ * alpha, both already scaled by the layer opacity, and D the accumulated color:
+ *
+ *     normal:   D = Cs + D (1 - As)
+ *     multiply: D = D (1 - As + Cs)
+ *     screen:   D = Cs + D (1 - Cs)
+ *     add:      D = Cs + D
+ *
+ * The active layer goes through the preview filter first when one is set. Only the pixels gathered by gatherPiece()
+ * are accessed, so pieces can be blended in parallel.
+ *
+ * @param[in,out] piece composite pixels and contributing layers of the piece
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void LayerStack::compositePiece(Piece &piece) const
+{
+    Mat &destination = piece.destination;
+    const vector<int> &contributing = piece.layers;
+    if (contributing.empty())
+    {
+        destination.setTo(Scalar::all(0));
+        return;
+    }
+
+    // pixels of a contributing layer, through the preview filter for the active layer
+    Mat previewed;
+    auto layerPiece = [&](size_t i) -> Mat
+    {
+        if (contributing[i] != myActive || !myPreview)
+        {
+            return piece.layerPixels[i];
+        }
+        myPreview(piece.layerPixels[i], previewed);
+        return previewed;
+    };
+
+    // a single normal layer over black is its premultiplied color
+    const Layer &bottom = myLayers[contributing[0]];
+    if (contributing.size() == 1 && bottom.blendMode == BLEND_NORMAL && bottom.opacity >= 1.0f)
+    {
+        cvtColor(layerPiece(0), destination, COLOR_BGRA2BGR);
+        return;
+    }
+
+    Mat accumulated(destination.size(), CV_32FC3, Scalar::all(0));
+    Mat layerPixels, color(destination.size(), CV_32FC3), alpha(destination.size(), CV_32FC3), weight;
+    for (size_t i = 0; i < contributing.size(); i++)
+    {
+        const Layer &layer = myLayers[contributing[i]];
+        layerPiece(i).convertTo(layerPixels, CV_32F, layer.opacity / 255.0);
+
+        // split into the color and the alpha repeated in all three channels
+        Mat outputs[] = {color, alpha};
+        const int fromTo[] = {0, 0, 1, 1, 2, 2, 3, 3, 3, 4, 3, 5};
+        mixChannels(&layerPixels, 1, outputs, 2, fromTo, 6);
+
+        switch (layer.blendMode)
+        {
+            case BLEND_MULTIPLY:
+                subtract(Scalar::all(1.0), alpha, weight);
+                add(weight, color, weight);
+                multiply(accumulated, weight, accumulated);
+                break;
+            case BLEND_SCREEN:
+                subtract(Scalar::all(1.0), color, weight);
+                multiply(accumulated, weight, accumulated);
+                add(accumulated, color, accumulated);
+                break;
+            case BLEND_ADD:
+                add(accumulated, color, accumulated);
+                break;
+            default:
+                subtract(Scalar::all(1.0), alpha, weight);
+                multiply(accumulated, weight, accumulated);
+                add(accumulated, color, accumulated);
+                break;
+        }
+    }
+
+    accumulated.convertTo(destination, CV_8U, 255.0);
+}
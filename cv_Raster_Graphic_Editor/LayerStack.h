@@ -0,0 +1,150 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file LayerStack.h
+ * @brief Header file for the LayerStack class
+ *
+ * This class holds the layers of the edited document and their composite
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef LAYERSTACK_H
+#define LAYERSTACK_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "TiledCanvas.h"
+
+using namespace std;
+using namespace cv;
+
+// default layer parameters
+#define LAYER_MAX_LAYERS 64
+#define LAYER_BACKGROUND_NAME "background"
+
+// how a layer is combined with the layers below it
+enum BlendMode {BLEND_NORMAL, BLEND_MULTIPLY, BLEND_SCREEN, BLEND_ADD};
+
+/*******************************************************************************************************************/ /**
+ * @brief One layer of the document
+ *
+ * The pixels are BGRA with premultiplied alpha, so painting an opaque color over them is the same linear blend as on
+ * a BGR image. usedTiles marks the canvas tiles the layer has ever been painted on, all other tiles are transparent.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+struct Layer
+{
+    string name;
+    Ptr<TiledCanvas> pixels;
+    float opacity;
+    BlendMode blendMode;
+    bool visible;
+    vector<uchar> usedTiles;
+};
+
+/*******************************************************************************************************************/ /**
+ * @class LayerStack
+ *
+ * @brief Layers of the document, bottom first, and their composite
+ *
+ * The background layer is created opaque from the loaded image and new layers start out transparent. Tools paint
+ * into the active layer and the stack keeps a BGR composite of all visible layers, a TiledCanvas of its own, which is
+ * what the viewport shows and what is saved.
+ *
+ * The composite is only recomputed over the regions passed to update(). Each composite tile piece is blended from
+ * the layers in premultiplied alpha with whole-tile OpenCV arithmetic (convertTo, mixChannels, multiply, add), which
+ * runs vectorized, and layers that are hidden or have never been painted on that tile are skipped, so adding layers
+ * costs nothing where they are empty. A piece covered by a single normal layer is a plain channel copy. The tiles of
+an update are paged in on the calling thread, as the canvases are not thread safe, in batches of half the resident
+tile budget, and the pieces of a batch are then blended in parallel.
+ *
+ * A preview filter, such as a color adjustment being tuned, can be set for the active layer. It is applied to the
+ * active layer's pixels of each piece as they are blended, so the composite shows exactly what applying the filter
+ * to the layer would give, while the layer itself is not modified. The stack remembers the region updated with a
+ * preview, so a front end can preview only what it shows and restore exactly that region afterwards.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class LayerStack
+{
+private:
+
+    vector<Layer> myLayers;
+    int myActive;
+    Ptr<TiledCanvas> myComposite;
+    size_t myResidentTiles;
+    function<void(const Mat &source, Mat &destination)> myPreview;
+    Rect myPreviewRegion;
+
+    // a composite tile piece and the pixels of the layers contributing to it, bottom first
+    struct Piece
+    {
+        Mat destination;
+        vector<int> layers;
+        vector<Mat> layerPixels;
+    };
+
+    void gatherPiece(int tx, int ty, const Rect &region, Piece &piece);
+    void compositePiece(Piece &piece) const;
+
+public:
+
+    // constructors
+    LayerStack();
+
+    // creation
+    bool create(const Mat &image, size_t residentTiles=CANVAS_MAX_RESIDENT_TILES);
+    bool assign(const vector<Layer> &layers, int active, const Ptr<TiledCanvas> &composite, size_t residentTiles=CANVAS_MAX_RESIDENT_TILES);
+    bool empty() const;
+    Size size() const;
+
+    // layers
+    int addLayer(const string &name);
+    bool removeLayer(int index);
+    int count() const;
+    Layer &layer(int index);
+    const Layer &layer(int index) const;
+    bool setActive(int index);
+    int active() const;
+    Rect usedRegion(int index) const;
+
+    // layer properties, the composite has to be updated over usedRegion() afterwards
+    void setOpacity(int index, float opacity);
+    void setBlendMode(int index, BlendMode blendMode);
+    void setVisible(int index, bool visible);
+
+    // compositing
+    void setPreview(const function<void(const Mat &source, Mat &destination)> &preview);
+    bool hasPreview() const;
+    Rect previewRegion() const;
+    void markPainted(const Rect &region);
+    void update(const Rect &region);
+    TiledCanvas &composite();
+    const TiledCanvas &composite() const;
+
+    // blend mode names, as used by scripts
+    static const char *blendModeName(BlendMode blendMode);
+    static bool blendModeFromName(const string &name, BlendMode &blendMode);
+};
+
+#endif // LAYERSTACK_H
@@ -0,0 +1,202 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file MipPyramid.cpp
+ * @brief Implementation of the MipPyramid class
+ *
+ * This class keeps lazily built, downsampled copies of a canvas for zoomed out display
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "MipPyramid.h"
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor, creates a pyramid without source
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+MipPyramid::MipPyramid() : mySource(NULL)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set up the levels for a canvas, all of them stale
+ * @param[in] source canvas forming level 0, must outlive the pyramid or the next reset()
+ * @param[in] smallestSize no more levels are added once a level fits inside this size
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void MipPyramid::reset(const TiledCanvas &source, Size smallestSize)
+{
+    mySource = &source;
+    mySourceSize = source.size();
+    myLevels.clear();
+    myValidTiles.clear();
+
+    Size size = mySourceSize;
+    while ((int)myLevels.size() + 1 < PYRAMID_MAX_LEVELS && (size.width > smallestSize.width || size.height > smallestSize.height))
+    {
+        size = Size((size.width + 1) / 2, (size.height + 1) / 2);
+        Ptr<TiledCanvas> level = makePtr<TiledCanvas>();
+        if (!level->create(size, source.type(), PYRAMID_RESIDENT_TILES))
+        {
+            break;
+        }
+        myLevels.push_back(level);
+        myValidTiles.push_back(vector<uchar>(level->tilesX() * level->tilesY(), 0));
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the canvas the pyramid was built for
+ * @return level 0 canvas, NULL before reset()
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const TiledCanvas *MipPyramid::source() const
+{
+    return mySource;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Mark the level tiles above a changed canvas region as stale
+ * @param[in] region changed region in level 0 coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void MipPyramid::invalidate(const Rect &region)
+{
+    int x0 = region.x;
+    int y0 = region.y;
+    int x1 = region.x + region.width;
+    int y1 = region.y + region.height;
+    for (size_t i = 0; i < myLevels.size(); i++)
+    {
+        // a level pixel depends on the 2x2 pixels below it
+        x0 = x0 / 2;
+        y0 = y0 / 2;
+        x1 = (x1 + 1) / 2;
+        y1 = (y1 + 1) / 2;
+
+        Rect levelRegion = Rect(Point(x0, y0), Point(x1, y1)) & Rect(Point(0, 0), myLevels[i]->size());
+        if (levelRegion.empty())
+        {
+            return;
+        }
+        for (int ty = levelRegion.y / CANVAS_TILE_SIZE; ty <= (levelRegion.y + levelRegion.height - 1) / CANVAS_TILE_SIZE; ty++)
+        {
+            for (int tx = levelRegion.x / CANVAS_TILE_SIZE; tx <= (levelRegion.x + levelRegion.width - 1) / CANVAS_TILE_SIZE; tx++)
+            {
+                myValidTiles[i][ty * myLevels[i]->tilesX() + tx] = 0;
+            }
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Mark every level tile as stale
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void MipPyramid::invalidateAll()
+{
+    for (size_t i = 0; i < myValidTiles.size(); i++)
+    {
+        myValidTiles[i].assign(myValidTiles[i].size(), 0);
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of levels, including the canvas itself
+ * @return number of levels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int MipPyramid::levels() const
+{
+    return (mySource == NULL) ? 0 : (int)myLevels.size() + 1;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the size of a level
+ * @param[in] level level index, 0 for the canvas
+ * @return level size in pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Size MipPyramid::levelSize(int level) const
+{
+    return (level == 0) ? mySourceSize : myLevels[level - 1]->size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Gather a region of a level, generating its stale tiles first
+ * @param[in] level level index, 0 for the canvas
+ * @param[in] region region in level coordinates, must lie inside the level
+ * @param[out] destination pixels of the region
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void MipPyramid::read(int level, const Rect &region, Mat &destination)
+{
+    if (level == 0)
+    {
+        mySource->read(region, destination);
+        return;
+    }
+
+    update(level, region);
+    myLevels[level - 1]->read(region, destination);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Regenerate the stale tiles of a level region from the level below
+ * @param[in] level level index, at least 1
+ * @param[in] region region in level coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void MipPyramid::update(int level, const Rect &region)
+{
+    TiledCanvas &canvas = *myLevels[level - 1];
+    vector<uchar> &valid = myValidTiles[level - 1];
+    const Rect below(Point(0, 0), levelSize(level - 1));
+
+    Rect clipped = region & Rect(Point(0, 0), canvas.size());
+    if (clipped.empty())
+    {
+        return;
+    }
+
+    for (int ty = clipped.y / CANVAS_TILE_SIZE; ty <= (clipped.y + clipped.height - 1) / CANVAS_TILE_SIZE; ty++)
+    {
+        for (int tx = clipped.x / CANVAS_TILE_SIZE; tx <= (clipped.x + clipped.width - 1) / CANVAS_TILE_SIZE; tx++)
+        {
+            int index = ty * canvas.tilesX() + tx;
+            if (valid[index])
+            {
+                continue;
+            }
+
+            // average the region of the level below covering this tile
+            Rect tileRegion = canvas.tileRect(tx, ty);
+            Rect source = Rect(tileRegion.x * 2, tileRegion.y * 2, tileRegion.width * 2, tileRegion.height * 2) & below;
+            Mat pixels;
+            read(level - 1, source, pixels);
+
+            Mat tile = canvas.tile(tx, ty, true);
+            resize(pixels, tile, tile.size(), 0, 0, INTER_AREA);
+            valid[index] = 1;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file MipPyramid.h
+ * @brief Header file for the MipPyramid class
+ *
+ * This class keeps lazily built, downsampled copies of a canvas for zoomed out display
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "TiledCanvas.h"
+
+using namespace std;
+using namespace cv;
+
+// default pyramid parameters
+#define PYRAMID_MAX_LEVELS 16
+#define PYRAMID_RESIDENT_TILES 256
+
+/*******************************************************************************************************************/ /**
+ * @class MipPyramid
+ *
+ * @brief Mipmap pyramid over a TiledCanvas
+ *
+ * Level 0 is the canvas itself and every further level halves the resolution of the previous one, down to the first
+ * level that fits the given size. Each level is a TiledCanvas of its own, so the pyramid lives in scratch files and
+ * adds no more than its resident tile budget to memory.
+ *
+ * Nothing is computed up front. A level tile is generated from the four tiles below it, with area averaging, the
+ * first time it is read, and invalidate() only marks the tiles above an edited region as stale, so after an edit
+ * only the few tiles covering it are regenerated, and only when they are displayed again.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class MipPyramid
+{
+private:
+
+    const TiledCanvas *mySource;
+    Size mySourceSize;
+    vector<Ptr<TiledCanvas> > myLevels;     // levels 1 and up
+    vector<vector<uchar> > myValidTiles;
+
+    void update(int level, const Rect &region);
+
+public:
+
+    // constructors
+    MipPyramid();
+
+    // setup
+    void reset(const TiledCanvas &source, Size smallestSize);
+    const TiledCanvas *source() const;
+
+    // invalidation
+    void invalidate(const Rect &region);
+    void invalidateAll();
+
+    // level access
+    int levels() const;
+    Size levelSize(int level) const;
+    void read(int level, const Rect &region, Mat &destination);
+};
+
+#endif // MIPPYRAMID_H
@@ -0,0 +1,352 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file ProjectFile.cpp
+ * @brief Implementation of the ProjectFile class
+ *
+ * This class reads and writes the native project format of the editor
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "ProjectFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace cv;
+
+// suffix of the file a project is written to before it replaces the old one
+static const char *const temporarySuffix = ".part";
+
+/*******************************************************************************************************************/ /**
+ * @brief Header at the start of a project file
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+struct ProjectHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+};
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+ProjectFile::ProjectFile() : myFile(-1), myDataEnd(PROJECT_HEADER_BYTES), myIndexBytes(0)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Class destructor, abandons a project that was not finished
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+ProjectFile::~ProjectFile()
+{
+    if (myFile >= 0)
+    {
+        close();
+        unlink((myFileName + temporarySuffix).c_str());
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Start writing a project
+ * @param[in] fileName project file, replaced by finish()
+ * @return false if the file could not be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ProjectFile::create(const string &fileName)
+{
+    close();
+    myFileName = fileName;
+    myFile = ::open((fileName + temporarySuffix).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (myFile < 0)
+    {
+        cout << "Error while creating file " << fileName << endl;
+        return false;
+    }
+
+    myDataEnd = PROJECT_HEADER_BYTES;
+    myCanvases.clear();
+    myIndex.str("");
+    myIndex.clear();
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Store the tiles of a canvas
+ * @param[in] canvas canvas to store
+ * @return index of the canvas in the project, -1 if writing failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int ProjectFile::addCanvas(const TiledCanvas &canvas)
+{
+    if (myFile < 0 || canvas.empty())
+    {
+        return -1;
+    }
+
+    CanvasEntry entry;
+    entry.offset = myDataEnd;
+    entry.stride = canvas.tileBytes();
+    entry.width = canvas.size().width;
+    entry.height = canvas.size().height;
+    entry.type = canvas.type();
+    if (!canvas.store(myFile, (off_t)entry.offset))
+    {
+        return -1;
+    }
+
+    myDataEnd += entry.stride * canvas.tilesX() * canvas.tilesY();
+    myCanvases.push_back(entry);
+    return (int)myCanvases.size() - 1;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Write the index and header and replace the project file
+ * @return false if writing failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ProjectFile::finish()
+{
+    if (myFile < 0)
+    {
+        return false;
+    }
+
+    // the canvas table goes in front of the caller's values
+    ostringstream index;
+    uint32_t canvases = (uint32_t)myCanvases.size();
+    index.write((const char *)&canvases, sizeof(canvases));
+    for (size_t i = 0; i < myCanvases.size(); i++)
+    {
+        const CanvasEntry &entry = myCanvases[i];
+        index.write((const char *)&entry.offset, sizeof(entry.offset));
+        index.write((const char *)&entry.stride, sizeof(entry.stride));
+        index.write((const char *)&entry.width, sizeof(entry.width));
+        index.write((const char *)&entry.height, sizeof(entry.height));
+        index.write((const char *)&entry.type, sizeof(entry.type));
+    }
+    index << myIndex.str();
+    const string indexBytes = index.str();
+
+    ProjectHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROJECT_MAGIC, sizeof(header.magic));
+    header.version = PROJECT_VERSION;
+    header.indexOffset = myDataEnd;
+    header.indexBytes = indexBytes.size();
+
+    bool success = pwrite(myFile, indexBytes.data(), indexBytes.size(), (off_t)myDataEnd) == (ssize_t)indexBytes.size() &&
+                   pwrite(myFile, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                   fsync(myFile) == 0;
+    close();
+
+    const string temporaryName = myFileName + temporarySuffix;
+    if (!success || rename(temporaryName.c_str(), myFileName.c_str()) != 0)
+    {
+        cout << "Error while writing file " << myFileName << endl;
+        unlink(temporaryName.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Open a project and read its index
+ * @param[in] fileName project file
+ * @return false if the file is not a project or could not be read
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ProjectFile::open(const string &fileName)
+{
+    close();
+    myFileName = fileName;
+    int file = ::open(fileName.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        cout << "Error while opening file " << fileName << endl;
+        return false;
+    }
+
+    // the index must lie after the header and inside the file
+    ProjectHeader header;
+    string indexBytes;
+    struct stat status;
+    bool success = fstat(file, &status) == 0 &&
+                   pread(file, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                   memcmp(header.magic, PROJECT_MAGIC, sizeof(header.magic)) == 0 &&
+                   header.version == PROJECT_VERSION &&
+                   header.indexOffset >= PROJECT_HEADER_BYTES && header.indexOffset <= (uint64_t)status.st_size &&
+                   header.indexBytes <= (uint64_t)status.st_size - header.indexOffset;
+    if (success)
+    {
+        indexBytes.resize(header.indexBytes);
+        success = indexBytes.empty() || pread(file, &indexBytes[0], indexBytes.size(), (off_t)header.indexOffset) == (ssize_t)indexBytes.size();
+    }
+    ::close(file);
+
+    myIndex.str(indexBytes);
+    myIndex.clear();
+    myIndexBytes = indexBytes.size();
+    myCanvases.clear();
+    uint32_t canvases = 0;
+    success = success && read(canvases);
+    for (uint32_t i = 0; success && i < canvases; i++)
+    {
+        CanvasEntry entry;
+        success = read(entry.offset) && read(entry.stride) && read(entry.width) && read(entry.height) && read(entry.type);
+        if (success)
+        {
+            // 8-bit pixels with 1 to 4 channels, and every tile between the header and the index, checked by
+            // division so corrupt sizes cannot overflow
+            const uint64_t tileBytes = (uint64_t)CANVAS_TILE_SIZE * CANVAS_TILE_SIZE * CV_ELEM_SIZE(entry.type);
+            const uint64_t tiles = (uint64_t)((entry.width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE) * ((entry.height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE);
+            success = entry.type == CV_MAT_TYPE(entry.type) && CV_MAT_DEPTH(entry.type) == CV_8U && CV_MAT_CN(entry.type) <= 4 &&
+                      entry.width > 0 && entry.height > 0 && entry.stride >= tileBytes &&
+                      entry.offset >= PROJECT_HEADER_BYTES && entry.offset <= header.indexOffset &&
+                      tiles <= (header.indexOffset - entry.offset) / entry.stride;
+        }
+        myCanvases.push_back(entry);
+    }
+
+    if (!success)
+    {
+        cout << "Error: " << fileName << " is not a valid project file" << endl;
+        myCanvases.clear();
+    }
+    return success;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of canvases stored in the opened project
+ * @return number of canvases
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int ProjectFile::canvasCount() const
+{
+    return (int)myCanvases.size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Open a stored canvas, its tiles are read when first accessed
+ * @param[in] index index of the canvas in the project
+ * @param[in] maxResidentTiles number of tiles kept in memory, see TiledCanvas
+ * @return the canvas, empty on error
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Ptr<TiledCanvas> ProjectFile::canvas(int index, size_t maxResidentTiles) const
+{
+    if (index < 0 || index >= (int)myCanvases.size())
+    {
+        return Ptr<TiledCanvas>();
+    }
+
+    const CanvasEntry &entry = myCanvases[index];
+    Ptr<TiledCanvas> canvas = makePtr<TiledCanvas>();
+    if (!canvas->open(myFileName, (off_t)entry.offset, (size_t)entry.stride, Size(entry.width, entry.height), entry.type, maxResidentTiles))
+    {
+        return Ptr<TiledCanvas>();
+    }
+    return canvas;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Append a string to the index
+ * @param[in] value string
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ProjectFile::writeString(const string &value)
+{
+    write((uint32_t)value.size());
+    writeBytes(value.data(), value.size());
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Append raw bytes to the index
+ * @param[in] data bytes to append
+ * @param[in] bytes number of bytes
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ProjectFile::writeBytes(const void *data, size_t bytes)
+{
+    myIndex.write((const char *)data, bytes);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Read the next string from the index
+ * @param[out] value string
+ * @return false past the end of the index
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ProjectFile::readString(string &value)
+{
+    uint32_t size = 0;
+    if (!read(size) || size > remainingBytes())
+    {
+        return false;
+    }
+    value.resize(size);
+    return size == 0 || readBytes(&value[0], size);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Read the next raw bytes from the index
+ * @param[out] data destination
+ * @param[in] bytes number of bytes
+ * @return false past the end of the index
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool ProjectFile::readBytes(void *data, size_t bytes)
+{
+    myIndex.read((char *)data, bytes);
+    return (size_t)myIndex.gcount() == bytes;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of index bytes left to read, to bound counts read from the index before allocating for them
+ * @return bytes after the read position, 0 once a read failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t ProjectFile::remainingBytes()
+{
+    streampos position = myIndex.tellg();
+    return (position < 0 || (size_t)position > myIndexBytes) ? 0 : myIndexBytes - (size_t)position;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Close the file being written
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void ProjectFile::close()
+{
+    if (myFile >= 0)
+    {
+        ::close(myFile);
+        myFile = -1;
+    }
+}
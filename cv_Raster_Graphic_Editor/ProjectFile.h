@@ -0,0 +1,139 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file ProjectFile.h
+ * @brief Header file for the ProjectFile class
+ *
+ * This class reads and writes the native project format of the editor
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+#include "TiledCanvas.h"
+
+using namespace std;
+using namespace cv;
+
+// project format parameters
+#define PROJECT_MAGIC "CVRGEPRJ"
+#define PROJECT_VERSION 2
+#define PROJECT_HEADER_BYTES 4096
+
+/*******************************************************************************************************************/ /**
+ * @class ProjectFile
+ *
+ * @brief Container of raw canvas tiles and an index
+ *
+ * A project file starts with a header of PROJECT_HEADER_BYTES bytes holding PROJECT_MAGIC, the version and the
+ * position of the index. It is followed by the canvases, each stored as its raw, page aligned tiles exactly as they
+ * lie in the TiledCanvas scratch files, and ends with the index: a table of the stored canvases and a stream of
+ * values written by the caller, such as the layer settings and the undo history. The canvas table is written field by
+ * field, so it holds no padding bytes, and open() rejects entries whose pixel type is not 8-bit or whose tiles do not
+ * lie between the header and the index.
+ *
+ * Writing copies the tiles without any encoding. Reading only parses the index, and the canvases are opened on the
+ * file with TiledCanvas::open(), which reads each tile the first time it is accessed, so reopening a project takes
+ * about as long as reading its index however large the images are. Values are stored in native byte order, so
+ * project files are meant to be reopened on the same kind of machine.
+ *
+ * A new project file is written to a temporary name and renamed over the old one once complete, so canvases still
+ * reading from a previous version of the file keep their data.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class ProjectFile
+{
+private:
+
+    // a stored canvas
+    struct CanvasEntry
+    {
+        uint64_t offset;
+        uint64_t stride;
+        int32_t width;
+        int32_t height;
+        int32_t type;
+    };
+
+    string myFileName;
+    int myFile;
+    uint64_t myDataEnd;
+    vector<CanvasEntry> myCanvases;
+    stringstream myIndex;
+    size_t myIndexBytes;
+
+    void close();
+
+    ProjectFile(const ProjectFile &) = delete;
+    ProjectFile &operator=(const ProjectFile &) = delete;
+
+public:
+
+    // constructors
+    ProjectFile();
+    ~ProjectFile();
+
+    // writing
+    bool create(const string &fileName);
+    int addCanvas(const TiledCanvas &canvas);
+    bool finish();
+
+    // reading
+    bool open(const string &fileName);
+    int canvasCount() const;
+    Ptr<TiledCanvas> canvas(int index, size_t maxResidentTiles=CANVAS_MAX_RESIDENT_TILES) const;
+
+    // index values
+    void writeString(const string &value);
+    void writeBytes(const void *data, size_t bytes);
+    bool readString(string &value);
+    bool readBytes(void *data, size_t bytes);
+    size_t remainingBytes();
+
+    /***************************************************************************************************************/ /**
+     * @brief Append a plain value to the index
+     * @param[in] value value of a trivially copyable type
+     * @author Viraj V. Sabhaya
+    ******************************************************************************************************************/
+    template <typename T> void write(const T &value)
+    {
+        writeBytes(&value, sizeof(T));
+    }
+
+    /***************************************************************************************************************/ /**
+     * @brief Read the next plain value from the index
+     * @param[out] value value of a trivially copyable type
+     * @return false past the end of the index
+     * @author Viraj V. Sabhaya
+    ******************************************************************************************************************/
+    template <typename T> bool read(T &value)
+    {
+        return readBytes(&value, sizeof(T));
+    }
+};
+
+#endif // PROJECTFILE_H
@@ -0,0 +1,575 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file TiledCanvas.cpp
+ * @brief Implementation of the TiledCanvas class
+ *
+ * This class stores the edited image as tiles in a memory-mapped scratch file
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "TiledCanvas.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+using namespace cv;
+
+// tile state flags
+static const uchar TILE_RESIDENT = 1;
+static const uchar TILE_DIRTY = 2;
+static const uchar TILE_LOADED = 4;
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor, creates an empty canvas
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+TiledCanvas::TiledCanvas() : myType(CV_8UC3), myTilesX(0), myTilesY(0), myTileBytes(0), myMaxResidentTiles(CANVAS_MAX_RESIDENT_TILES), myFile(-1), myMapping(NULL), myMappingSize(0), mySourceFile(-1), mySourceOffset(0), mySourceStride(0)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Class destructor, unmaps the scratch file, which is deleted with its last file descriptor
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+TiledCanvas::~TiledCanvas()
+{
+    close();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Allocate a canvas in a new scratch file, with all pixels set to zero
+ * @param[in] size image size
+ * @param[in] type OpenCV pixel type, for example CV_8UC3
+ * @param[in] maxResidentTiles number of tiles kept in memory before the least recently used ones are released
+ * @return false if the scratch file could not be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool TiledCanvas::create(Size size, int type, size_t maxResidentTiles)
+{
+    close();
+    if (size.width <= 0 || size.height <= 0)
+    {
+        return false;
+    }
+
+    // tiles are padded to whole pages so they can be released independently
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t pixelBytes = CV_ELEM_SIZE(type);
+    myTileBytes = ((CANVAS_TILE_SIZE * CANVAS_TILE_SIZE * pixelBytes + pageSize - 1) / pageSize) * pageSize;
+    myTilesX = (size.width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    myTilesY = (size.height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+    myMappingSize = myTileBytes * myTilesX * myTilesY;
+
+    // the scratch file is unlinked right away, the OS deletes it when the canvas is closed or the program exits
+    char fileName[] = CANVAS_SCRATCH_TEMPLATE;
+    myFile = mkstemp(fileName);
+    if (myFile < 0)
+    {
+        cout << "Error while creating the scratch file " << fileName << endl;
+        return false;
+    }
+    unlink(fileName);
+
+    if (ftruncate(myFile, myMappingSize) != 0)
+    {
+        cout << "Error while allocating " << myMappingSize << " bytes of scratch space" << endl;
+        close();
+        return false;
+    }
+
+    void *mapping = mmap(NULL, myMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, myFile, 0);
+    if (mapping == MAP_FAILED)
+    {
+        cout << "Error while mapping the scratch file" << endl;
+        close();
+        return false;
+    }
+
+    myMapping = (uchar *)mapping;
+    mySize = size;
+    myType = type;
+    myMaxResidentTiles = max((size_t)1, maxResidentTiles);
+    myResidentTiles.clear();
+    myResidentPosition.assign(myTilesX * myTilesY, myResidentTiles.end());
+    myTileState.assign(myTilesX * myTilesY, 0);
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Allocate a canvas holding a copy of an image
+ * @param[in] image image to copy, can be released afterwards
+ * @param[in] maxResidentTiles number of tiles kept in memory before the least recently used ones are released
+ * @return false if the scratch file could not be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool TiledCanvas::import(const Mat &image, size_t maxResidentTiles)
+{
+    if (!create(image.size(), image.type(), maxResidentTiles))
+    {
+        return false;
+    }
+    write(image, Point(0, 0));
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Allocate a canvas whose tiles are read from a file on first access
+ *
+ * The file holds the tiles one after the other, row by row, as written by store(). The file is kept open and
+ * nothing is read up front. Modified tiles go to the scratch file, the source file is never written.
+ *
+ * @param[in] fileName file holding the tiles
+ * @param[in] offset position of the first tile in the file
+ * @param[in] stride distance between two tiles in the file, tileBytes() of the stored canvas
+ * @param[in] size image size
+ * @param[in] type OpenCV pixel type
+ * @param[in] maxResidentTiles number of tiles kept in memory before the least recently used ones are released
+ * @return false if the file could not be opened or the scratch file could not be created
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool TiledCanvas::open(const string &fileName, off_t offset, size_t stride, Size size, int type, size_t maxResidentTiles)
+{
+    if (!create(size, type, maxResidentTiles))
+    {
+        return false;
+    }
+
+    mySourceFile = ::open(fileName.c_str(), O_RDONLY);
+    if (mySourceFile < 0)
+    {
+        cout << "Error while opening file " << fileName << endl;
+        close();
+        return false;
+    }
+    mySourceOffset = offset;
+    mySourceStride = stride;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Copy a region into a new canvas
+ * @param[in] region region to copy, clipped to the canvas
+ * @return the new canvas, empty on error
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Ptr<TiledCanvas> TiledCanvas::crop(const Rect &region) const
+{
+    Rect clipped = region & Rect(Point(0, 0), mySize);
+    Ptr<TiledCanvas> canvas = makePtr<TiledCanvas>();
+    if (!canvas->create(clipped.size(), myType, myMaxResidentTiles))
+    {
+        return Ptr<TiledCanvas>();
+    }
+
+    // fill the new canvas tile by tile, gathering each tile straight into its mapped memory
+    for (int ty = 0; ty < canvas->tilesY(); ty++)
+    {
+        for (int tx = 0; tx < canvas->tilesX(); tx++)
+        {
+            Mat destination = canvas->tile(tx, ty, true);
+            read(canvas->tileRect(tx, ty) + clipped.tl(), destination);
+        }
+    }
+    return canvas;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Copy the whole canvas into a new canvas
+ * @return the new canvas, empty on error
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Ptr<TiledCanvas> TiledCanvas::clone() const
+{
+    return crop(Rect(Point(0, 0), mySize));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Exchange the contents of two canvases
+ *
+ * Only the scratch files and the bookkeeping change hands, so this is O(1) however large the canvases are. Mat
+ * headers handed out earlier keep pointing at the pixels they were taken from.
+ *
+ * @param[in,out] other canvas to exchange contents with
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::swap(TiledCanvas &other)
+{
+    std::swap(mySize, other.mySize);
+    std::swap(myType, other.myType);
+    std::swap(myTilesX, other.myTilesX);
+    std::swap(myTilesY, other.myTilesY);
+    std::swap(myTileBytes, other.myTileBytes);
+    std::swap(myMaxResidentTiles, other.myMaxResidentTiles);
+    std::swap(myFile, other.myFile);
+    std::swap(myMapping, other.myMapping);
+    std::swap(myMappingSize, other.myMappingSize);
+    std::swap(mySourceFile, other.mySourceFile);
+    std::swap(mySourceOffset, other.mySourceOffset);
+    std::swap(mySourceStride, other.mySourceStride);
+    myResidentTiles.swap(other.myResidentTiles);
+    myResidentPosition.swap(other.myResidentPosition);
+    myTileState.swap(other.myTileState);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether the canvas holds an image
+ * @return true before create() succeeded
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool TiledCanvas::empty() const
+{
+    return myMapping == NULL;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the image size
+ * @return image size in pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Size TiledCanvas::size() const
+{
+    return mySize;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the pixel type
+ * @return OpenCV pixel type
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int TiledCanvas::type() const
+{
+    return myType;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the number of tile columns
+ * @return number of tiles across the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int TiledCanvas::tilesX() const
+{
+    return myTilesX;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the number of tile rows
+ * @return number of tiles down the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int TiledCanvas::tilesY() const
+{
+    return myTilesY;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Image region covered by a tile
+ * @param[in] tx tile column
+ * @param[in] ty tile row
+ * @return tile region, smaller than CANVAS_TILE_SIZE along the right and bottom image borders
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect TiledCanvas::tileRect(int tx, int ty) const
+{
+    return Rect(tx * CANVAS_TILE_SIZE, ty * CANVAS_TILE_SIZE, CANVAS_TILE_SIZE, CANVAS_TILE_SIZE) & Rect(Point(0, 0), mySize);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get a tile
+ * @param[in] tx tile column
+ * @param[in] ty tile row
+ * @param[in] write true if the caller modifies the pixels
+ * @return Mat header over the mapped tile memory, the size of tileRect(tx, ty)
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Mat TiledCanvas::tile(int tx, int ty, bool write)
+{
+    int index = ty * myTilesX + tx;
+    useTile(index, write);
+
+    Rect region = tileRect(tx, ty);
+    return Mat(CANVAS_TILE_SIZE, CANVAS_TILE_SIZE, myType, myMapping + index * myTileBytes)(Rect(Point(0, 0), region.size()));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get a tile for reading
+ * @param[in] tx tile column
+ * @param[in] ty tile row
+ * @return Mat header over the mapped tile memory, which must not be modified
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Mat TiledCanvas::tile(int tx, int ty) const
+{
+    int index = ty * myTilesX + tx;
+    useTile(index, false);
+
+    Rect region = tileRect(tx, ty);
+    return Mat(CANVAS_TILE_SIZE, CANVAS_TILE_SIZE, myType, myMapping + index * myTileBytes)(Rect(Point(0, 0), region.size()));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Visit the tile pieces covering a region
+ * @param[in] region image region, clipped to the canvas
+ * @param[in] visit called with the pixels of each tile piece and the image region they cover
+ * @param[in] write true if the visitor modifies the pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::forEachTile(const Rect &region, const function<void(Mat &pixels, const Rect &pixelsRegion)> &visit, bool write)
+{
+    Rect clipped = region & Rect(Point(0, 0), mySize);
+    if (clipped.empty())
+    {
+        return;
+    }
+
+    for (int ty = clipped.y / CANVAS_TILE_SIZE; ty <= (clipped.y + clipped.height - 1) / CANVAS_TILE_SIZE; ty++)
+    {
+        for (int tx = clipped.x / CANVAS_TILE_SIZE; tx <= (clipped.x + clipped.width - 1) / CANVAS_TILE_SIZE; tx++)
+        {
+            Rect tileRegion = tileRect(tx, ty);
+            Rect pieceRegion = tileRegion & clipped;
+            Mat pixels = tile(tx, ty, write)(pieceRegion - tileRegion.tl());
+            visit(pixels, pieceRegion);
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Gather a region into a contiguous image
+ * @param[in] region image region, must lie inside the canvas
+ * @param[out] destination pixels of the region, allocated if it does not already have the region size and type
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::read(const Rect &region, Mat &destination) const
+{
+    destination.create(region.size(), myType);
+    Rect clipped = region & Rect(Point(0, 0), mySize);
+    if (clipped.empty())
+    {
+        return;
+    }
+
+    for (int ty = clipped.y / CANVAS_TILE_SIZE; ty <= (clipped.y + clipped.height - 1) / CANVAS_TILE_SIZE; ty++)
+    {
+        for (int tx = clipped.x / CANVAS_TILE_SIZE; tx <= (clipped.x + clipped.width - 1) / CANVAS_TILE_SIZE; tx++)
+        {
+            Rect tileRegion = tileRect(tx, ty);
+            Rect pieceRegion = tileRegion & clipped;
+            tile(tx, ty)(pieceRegion - tileRegion.tl()).copyTo(destination(pieceRegion - region.tl()));
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Scatter a contiguous image into the canvas
+ * @param[in] source pixels to write, of the canvas type
+ * @param[in] origin image position of the top left pixel of the source, pixels outside the canvas are ignored
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::write(const Mat &source, const Point &origin)
+{
+    Rect region(origin, source.size());
+    forEachTile(region, [&](Mat &pixels, const Rect &pixelsRegion)
+    {
+        source(pixelsRegion - origin).copyTo(pixels);
+    });
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get a pixel for reading
+ * @param[in] x column, must lie inside the canvas
+ * @param[in] y row, must lie inside the canvas
+ * @return pointer to the first channel of the pixel
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+const uchar *TiledCanvas::pixel(int x, int y) const
+{
+    int tx = x / CANVAS_TILE_SIZE;
+    int ty = y / CANVAS_TILE_SIZE;
+    int index = ty * myTilesX + tx;
+    useTile(index, false);
+
+    const size_t pixelBytes = CV_ELEM_SIZE(myType);
+    return myMapping + index * myTileBytes + ((y - ty * CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE + (x - tx * CANVAS_TILE_SIZE)) * pixelBytes;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Start writing all modified tiles back to the scratch file
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::flush()
+{
+    if (myMapping != NULL)
+    {
+        msync(myMapping, myMappingSize, MS_ASYNC);
+        for (size_t i = 0; i < myTileState.size(); i++)
+        {
+            myTileState[i] &= ~TILE_DIRTY;
+        }
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Number of tiles currently counted as resident
+ * @return number of tiles accessed since they were last released
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t TiledCanvas::residentTiles() const
+{
+    return myResidentTiles.size();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Size of a tile in the scratch file
+ * @return bytes per tile, a whole number of pages
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+size_t TiledCanvas::tileBytes() const
+{
+    return myTileBytes;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Write all tiles to a file, in the layout open() reads
+ *
+ * The tiles are written as they are laid out in the scratch file, tileBytes() apart, so with a page aligned offset
+ * the stored tiles are page aligned as well.
+ *
+ * @param[in] file file descriptor to write to
+ * @param[in] offset position of the first tile in the file
+ * @return false if writing failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool TiledCanvas::store(int file, off_t offset) const
+{
+    for (int index = 0; index < myTilesX * myTilesY; index++)
+    {
+        useTile(index, false);
+        if (pwrite(file, myMapping + index * myTileBytes, myTileBytes, offset + (off_t)index * myTileBytes) != (ssize_t)myTileBytes)
+        {
+            cout << "Error while storing the canvas tiles" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Record an access to a tile and release the least recently used tiles beyond the budget
+ * @param[in] index tile index
+ * @param[in] write true if the tile is modified
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::useTile(int index, bool write) const
+{
+    // tiles of an opened canvas are read on first access, see open()
+    if (mySourceFile >= 0 && !(myTileState[index] & TILE_LOADED))
+    {
+        const size_t bytes = CANVAS_TILE_SIZE * CANVAS_TILE_SIZE * CV_ELEM_SIZE(myType);
+        if (pread(mySourceFile, myMapping + index * myTileBytes, bytes, mySourceOffset + (off_t)index * mySourceStride) != (ssize_t)bytes)
+        {
+            cout << "Error while reading tile " << index << " from the source file" << endl;
+        }
+        myTileState[index] |= TILE_LOADED;
+    }
+
+    if (myTileState[index] & TILE_RESIDENT)
+    {
+        myResidentTiles.splice(myResidentTiles.begin(), myResidentTiles, myResidentPosition[index]);
+    }
+    else
+    {
+        myResidentTiles.push_front(index);
+        myResidentPosition[index] = myResidentTiles.begin();
+        myTileState[index] |= TILE_RESIDENT;
+    }
+
+    if (write)
+    {
+        myTileState[index] |= TILE_DIRTY;
+    }
+
+    if (myResidentTiles.size() > myMaxResidentTiles)
+    {
+        releaseTiles();
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Release the least recently used tiles down to three quarters of the budget
+ *
+ * Modified tiles are scheduled for write back first, then their pages are dropped. The data is kept by the shared
+ * file mapping and paged back in on the next access.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::releaseTiles() const
+{
+    const size_t target = max((size_t)1, myMaxResidentTiles * 3 / 4);
+    while (myResidentTiles.size() > target)
+    {
+        int index = myResidentTiles.back();
+        myResidentTiles.pop_back();
+        myResidentPosition[index] = myResidentTiles.end();
+
+        uchar *tileMemory = myMapping + index * myTileBytes;
+        if (myTileState[index] & TILE_DIRTY)
+        {
+            msync(tileMemory, myTileBytes, MS_ASYNC);
+        }
+        madvise(tileMemory, myTileBytes, MADV_DONTNEED);
+        myTileState[index] &= TILE_LOADED;
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Unmap and close the scratch file
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void TiledCanvas::close()
+{
+    if (myMapping != NULL)
+    {
+        munmap(myMapping, myMappingSize);
+        myMapping = NULL;
+    }
+    if (myFile >= 0)
+    {
+        ::close(myFile);
+        myFile = -1;
+    }
+    if (mySourceFile >= 0)
+    {
+        ::close(mySourceFile);
+        mySourceFile = -1;
+    }
+
+    mySize = Size();
+    myTilesX = 0;
+    myTilesY = 0;
+    myMappingSize = 0;
+    myResidentTiles.clear();
+    myResidentPosition.clear();
+    myTileState.clear();
+}
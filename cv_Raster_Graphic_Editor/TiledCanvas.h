@@ -0,0 +1,140 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file TiledCanvas.h
+ * @brief Header file for the TiledCanvas class
+ *
+ * This class stores the edited image as tiles in a memory-mapped scratch file
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef TILEDCANVAS_H
+#define TILEDCANVAS_H
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <sys/types.h>
+
+using namespace std;
+using namespace cv;
+
+// default canvas parameters
+#define CANVAS_TILE_SIZE 256
+#define CANVAS_MAX_RESIDENT_TILES 1024
+#define CANVAS_SCRATCH_TEMPLATE "/tmp/cv_Raster_Graphic_Editor.XXXXXX"
+
+/*******************************************************************************************************************/ /**
+ * @class TiledCanvas
+ *
+ * @brief Image storage for images larger than memory
+ *
+ * The image is split into CANVAS_TILE_SIZE x CANVAS_TILE_SIZE tiles stored one after the other in an unlinked scratch
+ * file, each tile padded to a whole number of pages. The file is memory mapped, so tiles are paged in by the OS the
+ * first time they are accessed and edits are written back by the OS page cache rather than by the editor.
+ *
+ * All access goes through the tile API: tile() returns a Mat header over one tile, forEachTile() visits the tile
+ * pieces of a region, and read() / write() gather and scatter a region. Every access moves the tile to the front of
+ * an LRU list. Once more than the resident tile budget has been used, the least recently used tiles are released
+ * with madvise(MADV_DONTNEED), after an asynchronous write back if they were modified, so resident memory stays
+ * bounded however large the image is. Released tiles remain mapped, so Mat headers handed out earlier stay valid and
+ * simply page the tile back in.
+ *
+ * A canvas can also be opened on tiles stored in a file, such as a project file, in which case each tile is read
+ * into the scratch file the first time it is accessed, so opening costs nothing however large the image is.
+ *
+ * The canvas is not thread safe.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class TiledCanvas
+{
+private:
+
+    Size mySize;
+    int myType;
+    int myTilesX;
+    int myTilesY;
+    size_t myTileBytes;
+    size_t myMaxResidentTiles;
+
+    // scratch file mapping
+    int myFile;
+    uchar *myMapping;
+    size_t myMappingSize;
+
+    // file the tiles are read from on first access, see open()
+    int mySourceFile;
+    off_t mySourceOffset;
+    size_t mySourceStride;
+
+    // residency of the tiles, most recently used first
+    mutable list<int> myResidentTiles;
+    mutable vector<list<int>::iterator> myResidentPosition;
+    mutable vector<uchar> myTileState;
+
+    void useTile(int index, bool write) const;
+    void releaseTiles() const;
+    void close();
+
+    TiledCanvas(const TiledCanvas &) = delete;
+    TiledCanvas &operator=(const TiledCanvas &) = delete;
+
+public:
+
+    // constructors
+    TiledCanvas();
+    ~TiledCanvas();
+
+    // creation
+    bool create(Size size, int type, size_t maxResidentTiles=CANVAS_MAX_RESIDENT_TILES);
+    bool import(const Mat &image, size_t maxResidentTiles=CANVAS_MAX_RESIDENT_TILES);
+    bool open(const string &fileName, off_t offset, size_t stride, Size size, int type, size_t maxResidentTiles=CANVAS_MAX_RESIDENT_TILES);
+    Ptr<TiledCanvas> crop(const Rect &region) const;
+    Ptr<TiledCanvas> clone() const;
+    void swap(TiledCanvas &other);
+
+    // geometry
+    bool empty() const;
+    Size size() const;
+    int type() const;
+    int tilesX() const;
+    int tilesY() const;
+    Rect tileRect(int tx, int ty) const;
+
+    // tile access
+    Mat tile(int tx, int ty, bool write=true);
+    Mat tile(int tx, int ty) const;
+    void forEachTile(const Rect &region, const function<void(Mat &pixels, const Rect &pixelsRegion)> &visit, bool write=true);
+    void read(const Rect &region, Mat &destination) const;
+    void write(const Mat &source, const Point &origin);
+    const uchar *pixel(int x, int y) const;
+
+    // residency
+    void flush();
+    size_t residentTiles() const;
+
+    // storage
+    size_t tileBytes() const;
+    bool store(int file, off_t offset) const;
+};
+
+#endif // TILEDCANVAS_H
@@ -0,0 +1,325 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file Viewport.cpp
+ * @brief Implementation of the Viewport class
+ *
+ * This class shows the canvas with pan and zoom, keeping a viewport-sized display buffer and redrawing only the
+ * regions invalidated by edits
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "Viewport.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @param[in] windowName name of the HighGUI window to present to
+ * @param[in] maxSize largest size of the display buffer
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Viewport::Viewport(const string &windowName, Size maxSize) : myWindowName(windowName), myMaxSize(maxSize), myFullRedraw(true), myOrigin(0, 0), myZoom(1.0)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Mark an image region as changed
+ * @param[in] region changed region in canvas coordinates, inside or outside the view
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::invalidate(const Rect &region)
+{
+    if (region.empty())
+    {
+        return;
+    }
+    myDirty = myDirty.empty() ? region : (myDirty | region);
+    myPyramid.invalidate(region);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Mark the whole image as changed, for example after its size changed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::invalidateAll()
+{
+    myFullRedraw = true;
+    myPyramid.invalidateAll();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether a redraw is pending
+ * @return true if present() has something to draw
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool Viewport::isDirty() const
+{
+    return myFullRedraw || !myDirty.empty();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Redraw the dirty part of the view into the display buffer and show it
+ *
+ * Only the tiles under the visible region, at the pyramid level matching the zoom, are paged in.
+ *
+ * @param[in] canvas canvas being edited
+ * @param[in] view region of the canvas to show, such as a crop rectangle
+ * @return true if the window was updated
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool Viewport::present(const TiledCanvas &canvas, const Rect &view)
+{
+    Rect clipped = view & Rect(Point(0, 0), canvas.size());
+    if (canvas.empty() || clipped.empty())
+    {
+        return false;
+    }
+
+    // a new canvas, after a reset, gets a new pyramid, a new view of the same canvas keeps it
+    if (&canvas != myPyramid.source() || canvas.size() != myPyramid.levelSize(0))
+    {
+        myPyramid.reset(canvas, myMaxSize);
+        myFullRedraw = true;
+    }
+    if (clipped != myView)
+    {
+        myView = clipped;
+        myImageSize = clipped.size();
+        myFullRedraw = true;
+    }
+    if (!isDirty())
+    {
+        return false;
+    }
+
+    clampView();
+    Size size = displaySize();
+    if (myDisplay.size() != size || myDisplay.type() != canvas.type())
+    {
+        myDisplay.create(size, canvas.type());
+        myFullRedraw = true;
+    }
+
+    Rect region = myFullRedraw ? Rect(Point(0, 0), size) : (toDisplay(myDirty - myView.tl()) & Rect(Point(0, 0), size));
+    if (!region.empty())
+    {
+        render(region);
+    }
+
+    imshow(myWindowName, myDisplay);
+    myDirty = Rect();
+    myFullRedraw = false;
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Move the view
+ * @param[in] displayOffset distance to move the view by, in display pixels
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::pan(const Point2d &displayOffset)
+{
+    myOrigin += displayOffset * (1.0 / myZoom);
+    clampView();
+    myFullRedraw = true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Change the zoom, keeping the image point under a display position in place
+ * @param[in] factor zoom multiplier, above 1 to zoom in
+ * @param[in] displayPoint display position that stays fixed, typically the mouse position
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::zoomAt(double factor, const Point &displayPoint)
+{
+    Point2f anchor = toImage(displayPoint);
+    myZoom = min(VIEWPORT_MAX_ZOOM, max(minZoom(), myZoom * factor));
+    myOrigin.x = anchor.x + 0.5 - (displayPoint.x + 0.5) / myZoom;
+    myOrigin.y = anchor.y + 0.5 - (displayPoint.y + 0.5) / myZoom;
+    clampView();
+    myFullRedraw = true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Zoom out until the whole image fits the display buffer, or to 1:1 if it already does
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::zoomToFit()
+{
+    myZoom = minZoom();
+    myOrigin = Point2d(0, 0);
+    myFullRedraw = true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Set the zoom, keeping the center of the view in place
+ * @param[in] zoom display pixels per image pixel
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::setZoom(double zoom)
+{
+    Size size = displaySize();
+    zoomAt(zoom / myZoom, Point(size.width / 2, size.height / 2));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Get the zoom
+ * @return display pixels per image pixel
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+double Viewport::zoom() const
+{
+    return myZoom;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Map a display position, such as a mouse position, to the image
+ * @param[in] displayPoint display pixel
+ * @return image position, with pixel centers at integer coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Point2f Viewport::toImage(const Point &displayPoint) const
+{
+    return Point2f((float)(myOrigin.x + (displayPoint.x + 0.5) / myZoom - 0.5), (float)(myOrigin.y + (displayPoint.y + 0.5) / myZoom - 0.5));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Image region covered by the view
+ * @return the visible region in image coordinates
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect Viewport::visibleRegion() const
+{
+    Size size = displaySize();
+    Point topLeft(cvFloor(myOrigin.x), cvFloor(myOrigin.y));
+    Point bottomRight(cvCeil(myOrigin.x + size.width / myZoom), cvCeil(myOrigin.y + size.height / myZoom));
+    return Rect(topLeft, bottomRight) & Rect(Point(0, 0), myImageSize);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Smallest zoom, at which the whole image fits the display buffer
+ * @return display pixels per image pixel, at most 1
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+double Viewport::minZoom() const
+{
+    if (myImageSize.width <= 0 || myImageSize.height <= 0)
+    {
+        return 1.0;
+    }
+    return min(1.0, min((double)myMaxSize.width / myImageSize.width, (double)myMaxSize.height / myImageSize.height));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Size of the display buffer for the current zoom
+ * @return the scaled image size, limited to the maximum display size
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Size Viewport::displaySize() const
+{
+    return Size(max(1, min(myMaxSize.width, cvCeil(myImageSize.width * myZoom))), max(1, min(myMaxSize.height, cvCeil(myImageSize.height * myZoom))));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Keep the zoom in range and the view inside the image
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::clampView()
+{
+    myZoom = min(VIEWPORT_MAX_ZOOM, max(minZoom(), myZoom));
+
+    Size size = displaySize();
+    myOrigin.x = max(0.0, min(myOrigin.x, myImageSize.width - size.width / myZoom));
+    myOrigin.y = max(0.0, min(myOrigin.y, myImageSize.height - size.height / myZoom));
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Pyramid level the view is drawn from
+ * @return the coarsest level that is still at least as detailed as the display
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+int Viewport::pyramidLevel() const
+{
+    int level = 0;
+    double levelZoom = myZoom;
+    while (level + 1 < myPyramid.levels() && levelZoom <= 0.5)
+    {
+        level++;
+        levelZoom *= 2.0;
+    }
+    return level;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Display region affected by a change of an image region
+ * @param[in] region changed region in image coordinates
+ * @return display region, including the footprint of the pyramid level and of the interpolation
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+Rect Viewport::toDisplay(const Rect &region) const
+{
+    const int margin = 2 << pyramidLevel();
+    Point topLeft(cvFloor((region.x - margin - myOrigin.x) * myZoom), cvFloor((region.y - margin - myOrigin.y) * myZoom));
+    Point bottomRight(cvCeil((region.x + region.width + margin - myOrigin.x) * myZoom), cvCeil((region.y + region.height + margin - myOrigin.y) * myZoom));
+    return Rect(topLeft, bottomRight);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Draw a display region from the pyramid
+ *
+ * The level pixels under the region are gathered and mapped to the display with one affine warp, nearest neighbor
+ * when zoomed in so pixels stay sharp, bilinear within a pyramid level otherwise.
+ *
+ * @param[in] displayRegion region of the display buffer to draw
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void Viewport::render(const Rect &displayRegion)
+{
+    const int level = pyramidLevel();
+    const double levelScale = (double)(1 << level);
+    const double levelZoom = myZoom * levelScale;
+
+    // level position of the first display pixel of the region, level pixel centers at integer coordinates
+    const double x0 = (myView.x + myOrigin.x + (displayRegion.x + 0.5) / myZoom) / levelScale - 0.5;
+    const double y0 = (myView.y + myOrigin.y + (displayRegion.y + 0.5) / myZoom) / levelScale - 0.5;
+    Point topLeft(cvFloor(x0) - 1, cvFloor(y0) - 1);
+    Point bottomRight(cvCeil(x0 + displayRegion.width / levelZoom) + 2, cvCeil(y0 + displayRegion.height / levelZoom) + 2);
+
+    // stay inside the view, so the border is replicated from its edge rather than from the cropped away pixels
+    Point viewTopLeft(myView.x >> level, myView.y >> level);
+    Point viewBottomRight((myView.x + myView.width + (1 << level) - 1) >> level, (myView.y + myView.height + (1 << level) - 1) >> level);
+    Rect patch = Rect(topLeft, bottomRight) & Rect(viewTopLeft, viewBottomRight) & Rect(Point(0, 0), myPyramid.levelSize(level));
+    if (patch.empty())
+    {
+        return;
+    }
+
+    Mat pixels;
+    myPyramid.read(level, patch, pixels);
+
+    Mat transform = (Mat_<double>(2, 3) << 1.0 / levelZoom, 0.0, x0 - patch.x, 0.0, 1.0 / levelZoom, y0 - patch.y);
+    Mat target = myDisplay(displayRegion);
+    int interpolation = (levelZoom > 1.0) ? INTER_NEAREST : INTER_LINEAR;
+    warpAffine(pixels, target, transform, target.size(), interpolation | WARP_INVERSE_MAP, BORDER_REPLICATE);
+}
@@ -0,0 +1,108 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file Viewport.h
+ * @brief Header file for the Viewport class
+ *
+ * This class shows the canvas with pan and zoom, keeping a viewport-sized display buffer and redrawing only the
+ * regions invalidated by edits
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <string>
+#include <opencv2/opencv.hpp>
+
+#include "MipPyramid.h"
+#include "TiledCanvas.h"
+
+using namespace std;
+using namespace cv;
+
+// largest display buffer, bigger views are panned
+#define VIEWPORT_MAX_WIDTH 1600
+#define VIEWPORT_MAX_HEIGHT 1000
+#define VIEWPORT_MAX_ZOOM 32.0
+
+/*******************************************************************************************************************/ /**
+ * @class Viewport
+ *
+ * @brief Pan and zoom view with a display buffer and dirty rectangle tracking
+ *
+ * The view shows a region of the canvas, the crop rectangle, scaled by the zoom factor, starting at an image position that can be panned. Views zoomed
+ * out by 2x or more are drawn from the matching level of a MipPyramid, so the pixels read per frame stay close to the
+ * display size however large the image is, and the rest of the scale is applied with a single warpAffine.
+ *
+ * Edits only record the image region they changed with invalidate(), which also marks the pyramid tiles above it as
+ * stale. The main loop calls present() once per display refresh, which redraws the display area covering the union
+ * of the dirty regions and shows it. Any number of mouse events between two refreshes is coalesced into a single
+ * presentation whose cost depends on the viewport size and the edited area, not on the image size.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class Viewport
+{
+private:
+
+    string myWindowName;
+    Size myMaxSize;
+    Mat myDisplay;
+    Rect myDirty;
+    bool myFullRedraw;
+
+    // view transform, display = (image - origin) * zoom, image = canvas - view.tl()
+    Rect myView;
+    Size myImageSize;
+    Point2d myOrigin;
+    double myZoom;
+    MipPyramid myPyramid;
+
+    double minZoom() const;
+    Size displaySize() const;
+    void clampView();
+    int pyramidLevel() const;
+    Rect toDisplay(const Rect &region) const;
+    void render(const Rect &displayRegion);
+
+public:
+
+    // constructors
+    Viewport(const string &windowName, Size maxSize=Size(VIEWPORT_MAX_WIDTH, VIEWPORT_MAX_HEIGHT));
+
+    // redraw mechanics
+    void invalidate(const Rect &region);
+    void invalidateAll();
+    bool isDirty() const;
+    bool present(const TiledCanvas &canvas, const Rect &view);
+
+    // view transform
+    void pan(const Point2d &displayOffset);
+    void zoomAt(double factor, const Point &displayPoint);
+    void zoomToFit();
+    void setZoom(double zoom);
+    double zoom() const;
+    Point2f toImage(const Point &displayPoint) const;
+
+    // misc
+    Rect visibleRegion() const;
+};
+
+#endif // VIEWPORT_H
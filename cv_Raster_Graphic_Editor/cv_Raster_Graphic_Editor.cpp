@@ -22,9 +22,14 @@
 **********************************************************************************************************************/
 
 // include necessary dependencies
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <opencv2/opencv.hpp>
 
+#include "EditorCore.h"
+#include "Viewport.h"
+
 // Global variables
 using namespace std;
 using namespace cv;
@@ -42,21 +47,118 @@ Point mouse_X_Y_Coordinates;
 
 Point crop_start_point;
 Point crop_end_point;
+Point pan_last_point;
 
 // bool is_drawing_rect = false;
+bool is_cropping = false;
 bool is_drawing_line = false;
 bool is_filling_color = false;
 
 // configuration parameters
 #define NUM_COMMAND_LINE_ARGUMENTS 1
 #define DISPLAY_WINDOW_NAME "Raster Graphic Editor! @Viraj V. Sabhaya"
+#define DISPLAY_REFRESH_MS 16
+#define KEY_ESCAPE 27
+#define KEY_ENTER 13
+#define KEY_RETURN 10
+#define KEY_CTRL_Y 25
+#define KEY_CTRL_Z 26
+#define KEY_SAVE_IMAGE 'e'
+#define KEY_SAVE_PROJECT 'p'
+#define SAVE_IMAGE_NAME "{name}_edited.png"
+#define SAVE_PROJECT_NAME "{name}" EDITOR_PROJECT_EXTENSION
+#define BRUSH_RADIUS_STEP 1.0f
+#define FILL_TOLERANCE_STEP 4
+#define VIEW_ZOOM_STEP 1.25
+#define VIEW_PAN_STEP 200
+#define LAYER_OPACITY_STEP 0.1f
+#define ADJUST_WINDOW_NAME "Color Adjustment"
+
+// Editing state and operations, shared with the headless batch mode
+EditorCore editor;
+
+// Display buffer, redrawn from the main loop
+Viewport viewport(DISPLAY_WINDOW_NAME);
+
+// Recorded edit script, when --record is given
+ofstream recording;
+
+// Color adjustment previewed on the display while the adjustment window is open, set from its trackbars
+ColorAdjustment adjustment;
+bool is_adjusting = false;
+Rect adjustment_view;
+int levels_black, levels_white, levels_gamma_percent;
+int curve_shadows, curve_midtones, curve_highlights;
+int hue_shift_degrees, saturation_percent, value_percent;
+
+/*******************************************************************************************************************/ /**
+ * @brief handler for the trackbars of the adjustment window, rebuilds the adjustment and its preview
+ * @param[in] position trackbar position (unused, all trackbar values are read)
+ * @param[in] param user data (unused)
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static void adjustCallback(int position, void *param)
+{
+    adjustment.setLevels((float)levels_black, (float)levels_white, max(1, levels_gamma_percent) / 100.0f);
+
+    // the curve bends the quarter, half and three quarter tones, it is the identity at its initial positions
+    vector<Point2f> curve;
+    if (curve_shadows != 64 || curve_midtones != 128 || curve_highlights != 192)
+    {
+        curve.push_back(Point2f(64.0f, (float)curve_shadows));
+        curve.push_back(Point2f(128.0f, (float)curve_midtones));
+        curve.push_back(Point2f(192.0f, (float)curve_highlights));
+    }
+    adjustment.setCurve(curve);
+    adjustment.setHueSaturation((float)(hue_shift_degrees - 180), saturation_percent / 100.0f, value_percent / 100.0f);
+
+    // the composite shows the adjusted active layer over the visible region, the layer itself is only changed when
+    // the adjustment is applied
+    adjustment_view = viewport.visibleRegion();
+    editor.previewAdjustment(adjustment, adjustment_view);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Open the adjustment window, with every trackbar at its identity position
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static void openAdjustment()
+{
+    levels_black = 0;
+    levels_white = 255;
+    levels_gamma_percent = 100;
+    curve_shadows = 64;
+    curve_midtones = 128;
+    curve_highlights = 192;
+    hue_shift_degrees = 180;
+    saturation_percent = 100;
+    value_percent = 100;
 
-// EYEDROPPER
-Vec3b eyeDropperValue(255, 255, 255); // initialized default value of WHITE
+    namedWindow(ADJUST_WINDOW_NAME, WINDOW_AUTOSIZE);
+    createTrackbar("Black", ADJUST_WINDOW_NAME, &levels_black, 255, adjustCallback);
+    createTrackbar("White", ADJUST_WINDOW_NAME, &levels_white, 255, adjustCallback);
+    createTrackbar("Gamma %", ADJUST_WINDOW_NAME, &levels_gamma_percent, 400, adjustCallback);
+    createTrackbar("Shadows", ADJUST_WINDOW_NAME, &curve_shadows, 255, adjustCallback);
+    createTrackbar("Midtones", ADJUST_WINDOW_NAME, &curve_midtones, 255, adjustCallback);
+    createTrackbar("Highlights", ADJUST_WINDOW_NAME, &curve_highlights, 255, adjustCallback);
+    createTrackbar("Hue + 180", ADJUST_WINDOW_NAME, &hue_shift_degrees, 360, adjustCallback);
+    createTrackbar("Saturation %", ADJUST_WINDOW_NAME, &saturation_percent, 300, adjustCallback);
+    createTrackbar("Value %", ADJUST_WINDOW_NAME, &value_percent, 300, adjustCallback);
+    adjustCallback(0, NULL);
+    is_adjusting = true;
+    cout << "USAGE: drag the trackbars to preview, Enter to apply to the active layer, k to cancel" << endl;
+}
 
-// Input image and Reset image
-Mat imageIn;
-Mat imageReset;
+/*******************************************************************************************************************/ /**
+ * @brief Close the adjustment window and remove the preview
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static void closeAdjustment()
+{
+    destroyWindow(ADJUST_WINDOW_NAME);
+    editor.endPreview();
+    is_adjusting = false;
+}
 
 /*******************************************************************************************************************/ /**
  * @brief handler for image click callbacks
@@ -64,13 +166,44 @@ Mat imageReset;
  * @param[in] x x coordinate of event
  * @param[in] y y coordinate of event
  * @param[in] flags additional event flags
- * @param[in] param user data passed as void* (in this case, the input image)
+ * @param[in] param user data passed as void* (in this case, the editor)
  * @author Viraj V. Sabhaya
 **********************************************************************************************************************/
 static void clickCallback(int event, int x, int y, int flags, void *param)
 {
-    // cast userdata to a Mat
-    Mat &imageIn = *(Mat *)param;
+    // cast userdata to the editor
+    EditorCore &editor = *(EditorCore *)param;
+
+    // VIEW *********************************************************************************************************
+    // the mouse wheel zooms around the cursor and middle button drags pan, both in display coordinates
+    if (event == EVENT_MOUSEWHEEL)
+    {
+        viewport.zoomAt((getMouseWheelDelta(flags) > 0) ? VIEW_ZOOM_STEP : 1.0 / VIEW_ZOOM_STEP, Point(x, y));
+        return;
+    }
+    else if (event == EVENT_MBUTTONDOWN)
+    {
+        pan_last_point = Point(x, y);
+        return;
+    }
+    else if (event == EVENT_MOUSEMOVE && (flags & EVENT_FLAG_MBUTTON))
+    {
+        viewport.pan(Point2d(pan_last_point.x - x, pan_last_point.y - y));
+        pan_last_point = Point(x, y);
+        return;
+    }
+
+    // the tools work in image coordinates
+    Point2f imagePoint = viewport.toImage(Point(x, y));
+    x = cvRound(imagePoint.x);
+    y = cvRound(imagePoint.y);
+
+    // clicks must land on the image, drags may leave it and are clipped by the tools
+    if (event == EVENT_LBUTTONDOWN && !Rect(Point(0, 0), editor.size()).contains(Point(x, y)))
+    {
+        is_cropping = false;
+        return;
+    }
 
     // EYEDROPPER ****************************************************************************************************
     if (event == EVENT_LBUTTONDOWN && selectedTools == EYEDROPPER)
@@ -78,30 +211,30 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
         cout << "LEFT CLICK (" << x << ", " << y << ")" << endl;
 
         // get the color value at the clicked pixel location and print to console
-        Vec3b pixel = imageIn.at<Vec3b>(y, x);
+        // and update the color value
+        Vec3b pixel = editor.eyedrop(Point(x, y));
         // display the color value B, G, R
         cout << "B: " << static_cast<int>(pixel[0]) << endl;
         cout << "G: " << static_cast<int>(pixel[1]) << endl;
         cout << "R: " << static_cast<int>(pixel[2]) << endl;
-
-        // updating the color value
-        eyeDropperValue = pixel;
     }
 
     // CROP *********************************************************************************************************
     else if (event == EVENT_LBUTTONDOWN && selectedTools == CROP)
     {
         cout << "Crop selected ---" << endl;
+        is_cropping = true;
         crop_start_point = Point(x, y);
     }
-    else if (event == EVENT_LBUTTONUP && selectedTools == CROP)
+    else if (event == EVENT_LBUTTONUP && selectedTools == CROP && is_cropping)
     {
+        // only drags that started on the image crop, from their own start point
+        is_cropping = false;
         crop_end_point = Point(x, y);
 
         Rect region(crop_start_point, crop_end_point);
         // rectangle(imageIn, region, Scalar(0, 0, 0), 5);
-        imageIn = imageIn(region).clone();
-        imshow(DISPLAY_WINDOW_NAME, imageIn);
+        editor.crop(region);
     }
 
     // PENCIL *******************************************************************************************************
@@ -110,23 +243,18 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
         cout << "Pencil selected --- " << endl;
         is_drawing_line = true;
 
-        // Change the color of the target pixel to the eyedropper value
-        imageIn.at<Vec3b>(y, x) = eyeDropperValue;
-        line(imageIn, Point(x, y), Point(x, y), eyeDropperValue, 2);
-        imshow(DISPLAY_WINDOW_NAME, imageIn);
+        // Start a stroke in the eyedropper color
+        editor.beginStroke(imagePoint);
     }
     else if (event == EVENT_MOUSEMOVE && selectedTools == PENCIL && is_drawing_line)
     {
-        cout << "Pencil drawing ... " << endl;
-
-        // Change the color of the target pixel to the eyedropper value
-        imageIn.at<Vec3b>(y, x) = eyeDropperValue;
-        line(imageIn, Point(x, y), Point(x, y), eyeDropperValue, 2);
-        imshow(DISPLAY_WINDOW_NAME, imageIn);
+        // Connect the previous mouse sample to this one, so fast strokes have no gaps
+        editor.continueStroke(imagePoint);
     }
     else if (event == EVENT_LBUTTONUP && selectedTools == PENCIL)
     {
         is_drawing_line = false;
+        editor.endStroke();
         cout << "Pencil drawing finished." << endl;
     }
 
@@ -135,13 +263,7 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
     {
         is_filling_color = true;
 
-        // Get the current color value of the clicked pixel
-        Vec3b targetColor = imageIn.at<Vec3b>(y, x);
-
-        // Fill color using the floodFill algorithm. SOURCE: https://docs.opencv.org/4.x/d1/d17/samples_2cpp_2ffilldemo_8cpp-example.html
-        floodFill(imageIn, Point(x, y), eyeDropperValue, 0, Scalar(0, 0, 0), Scalar(0, 0, 0), 4);
-
-        imshow(DISPLAY_WINDOW_NAME, imageIn);
+        editor.fill(Point(x, y));
     }
     else if (event == EVENT_LBUTTONUP && selectedTools == PAINT_BUCKET)
     {
@@ -153,8 +275,7 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
     else if (event == EVENT_LBUTTONDBLCLK && selectedTools == RESET)
     {
         // Reset functionality: Restore original image
-        imageIn = imageReset.clone();
-        imshow(DISPLAY_WINDOW_NAME, imageIn);
+        editor.reset();
     }
 
     // RIGHT CLICK ***************************************************************************************************
@@ -162,6 +283,7 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
     {
         cout << "RIGHT CLICK (" << x << ", " << y << ")" << endl;
         // Handle right-click event
+        is_cropping = false;
         selectedTools = static_cast<Tools>((selectedTools + 1) % (RESET + 1));
 
         switch (selectedTools)
@@ -176,10 +298,11 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
             break;
         case PENCIL:
             cout << "Tool: Pencil selected" << endl;
-            cout << "USAGE: Left click/drag on the image to draw a line" << endl;
+            cout << "USAGE: Left click/drag on the image to draw a line, + / - to change the brush size" << endl;
             break;
         case PAINT_BUCKET:
             cout << "Tool: Paint Bucket selected" << endl;
+            cout << "USAGE: Left click to fill, [ / ] to change the tolerance, c to toggle 4/8-connectivity, l to toggle Lab" << endl;
             break;
         case RESET:
             cout << "Tool: Reset selected" << endl;
@@ -189,6 +312,76 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
     }
 }
 
+/*******************************************************************************************************************/ /**
+ * @brief Apply an edit script to a list of images without opening a window
+ *
+ * Every image gets its own EditorCore, and the images are processed in parallel. Without images, the script runs
+ * once and must load its own image.
+ *
+ * @param[in] scriptFile script file, - for standard input
+ * @param[in] imageFiles images to edit
+ * @param[in] threads number of images edited at once, 0 for the OpenCV default
+ * @return number of images that failed
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+static int runBatch(const string &scriptFile, const vector<string> &imageFiles, int threads)
+{
+    // read the script once, it is replayed for every image
+    stringstream script;
+    if (scriptFile == "-")
+    {
+        script << cin.rdbuf();
+    }
+    else
+    {
+        ifstream input(scriptFile.c_str());
+        if (!input)
+        {
+            cout << "Error while opening file " << scriptFile << endl;
+            return 1;
+        }
+        script << input.rdbuf();
+    }
+    const string commands = script.str();
+
+    if (imageFiles.empty())
+    {
+        EditorCore core;
+        istringstream input(commands);
+        return core.runScript(input) ? 0 : 1;
+    }
+
+    // share the resident tile budget between the images edited at once
+    if (threads > 0)
+    {
+        setNumThreads(threads);
+    }
+    const size_t residentTiles = max((size_t)16, (size_t)CANVAS_MAX_RESIDENT_TILES / max(1, getNumThreads()));
+
+    vector<uchar> succeeded(imageFiles.size(), 0);
+    parallel_for_(Range(0, (int)imageFiles.size()), [&](const Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            EditorCore core(residentTiles);
+            istringstream input(commands);
+            succeeded[i] = core.load(imageFiles[i]) && core.runScript(input);
+        }
+    }, (double)imageFiles.size());
+
+    int failures = 0;
+    for (size_t i = 0; i < imageFiles.size(); i++)
+    {
+        if (!succeeded[i])
+        {
+            cout << "Failed: " << imageFiles[i] << endl;
+            failures++;
+        }
+    }
+    cout << "Edited " << imageFiles.size() - failures << " of " << imageFiles.size() << " images" << endl;
+    return failures;
+}
+
 /*******************************************************************************************************************/ /**
  * @brief program entry point
  * @param[in] argc number of command line arguments
@@ -198,38 +391,188 @@ static void clickCallback(int event, int x, int y, int flags, void *param)
 **********************************************************************************************************************/
 int main(int argc, char *argv[])
 {
-    if (argc != NUM_COMMAND_LINE_ARGUMENTS + 1)
+    // headless batch mode: --script <script_file|-> [--threads <count>] [<image_file> ...]
+    if (argc >= 3 && string(argv[1]) == "--script")
     {
-        printf("Usage: %s <image_file>\n", argv[0]);
+        vector<string> imageFiles;
+        int threads = 0;
+        for (int i = 3; i < argc; i++)
+        {
+            if (string(argv[i]) == "--threads" && i + 1 < argc)
+            {
+                threads = atoi(argv[++i]);
+            }
+            else
+            {
+                imageFiles.push_back(argv[i]);
+            }
+        }
+        return (runBatch(argv[2], imageFiles, threads) == 0) ? 0 : 1;
+    }
+
+    bool recordScript = (argc == NUM_COMMAND_LINE_ARGUMENTS + 3 && string(argv[2]) == "--record");
+    if (argc != NUM_COMMAND_LINE_ARGUMENTS + 1 && !recordScript)
+    {
+        printf("Usage: %s <image_file|project_file> [--record <script_file>]\n", argv[0]);
+        printf("       %s --script <script_file|-> [--threads <count>] [<image_file> ...]\n", argv[0]);
         return 0;
     }
     else
     {
-        // Mat imageIn;                             // input image
-        imageIn = imread(argv[1], IMREAD_COLOR); // read the input image
+        // redraw whatever the editor changes
+        editor.setChangeCallback([](const Rect &region)
+        {
+            viewport.invalidate(region);
+        });
 
-        // check for file error
-        if (!imageIn.data)
+        // read the input image into the tiled canvas, check for file error
+        if (!editor.load(argv[1]))
         {
-            cout << "Error while opening file " << argv[1] << endl;
             return 0;
         }
         else
         {
-            // Cloning the image to use later for reset functionality
-            imageReset = imageIn.clone();
+            // record the edits as a script that --script can replay on other images
+            if (recordScript)
+            {
+                recording.open(argv[3]);
+                editor.setRecorder(&recording);
+            }
 
-            imshow(DISPLAY_WINDOW_NAME, imageIn);
+            viewport.present(editor.canvas(), editor.cropRect());
 
             // display the Image size (Width, Height) and channels
-            cout << "Image size: " << imageIn.size().width << endl;
-            cout << "Image size: " << imageIn.size().height << endl;
-            cout << "Image channels: " << imageIn.channels() << endl;
+            cout << "Image size: " << editor.size().width << endl;
+            cout << "Image size: " << editor.size().height << endl;
+            cout << "Image channels: " << CV_MAT_CN(editor.canvas().type()) << endl;
 
             // set the mouse callback function
-            setMouseCallback(DISPLAY_WINDOW_NAME, clickCallback, &imageIn);
+            setMouseCallback(DISPLAY_WINDOW_NAME, clickCallback, &editor);
+            cout << "USAGE: z / Ctrl+Z to undo, y / Ctrl+Y to redo, q / Esc to quit" << endl;
+            cout << "USAGE: e to save the image as " << SAVE_IMAGE_NAME << ", p to save the project as " << SAVE_PROJECT_NAME << endl;
+            cout << "USAGE: mouse wheel or i / o to zoom, middle drag or w / a / s / d to pan, 0 to fit, 1 for 1:1" << endl;
+            cout << "USAGE: n for a new layer, , / . to select the layer below / above, v to show / hide it, b to change its blend mode, < / > for its opacity" << endl;
+            cout << "USAGE: k to adjust the levels, curve and hue / saturation of the active layer" << endl;
+
+            // handle keys and redraw the edited regions once per display refresh until the window is closed,
+            // mouse events arriving between two refreshes only edit the image and mark what they changed
+            while (getWindowProperty(DISPLAY_WINDOW_NAME, WND_PROP_VISIBLE) >= 1)
+            {
+                int key = waitKey(DISPLAY_REFRESH_MS);
+                if (key == KEY_ESCAPE || key == 'q')
+                {
+                    break;
+                }
+                else if (key == KEY_SAVE_IMAGE || key == KEY_SAVE_PROJECT)
+                {
+                    // plain keys, since most HighGUI backends drop the Ctrl modifier and Ctrl+S would arrive as 's'
+                    // and pan; a preview is never saved, so an open adjustment is cancelled first, and the image is
+                    // encoded in the background, editing can continue meanwhile
+                    if (is_adjusting)
+                    {
+                        closeAdjustment();
+                    }
+                    editor.saveAsync((key == KEY_SAVE_IMAGE) ? SAVE_IMAGE_NAME : SAVE_PROJECT_NAME);
+                }
+                else if (key == 'k')
+                {
+                    if (is_adjusting)
+                    {
+                        closeAdjustment();
+                    }
+                    else
+                    {
+                        openAdjustment();
+                    }
+                }
+                else if ((key == KEY_ENTER || key == KEY_RETURN) && is_adjusting)
+                {
+                    editor.adjust(adjustment);
+                    closeAdjustment();
+                }
+                else if (key == 'z' || key == KEY_CTRL_Z)
+                {
+                    editor.undo();
+                }
+                else if (key == 'y' || key == KEY_CTRL_Y)
+                {
+                    editor.redo();
+                }
+                else if (key == '+' || key == '=' || key == '-')
+                {
+                    editor.setBrushRadius(editor.brush().radius() + ((key == '-') ? -BRUSH_RADIUS_STEP : BRUSH_RADIUS_STEP));
+                    cout << "Brush radius: " << editor.brush().radius() << endl;
+                }
+                else if (key == '[' || key == ']')
+                {
+                    editor.setFillTolerance(editor.bucket().tolerance() + ((key == '[') ? -FILL_TOLERANCE_STEP : FILL_TOLERANCE_STEP));
+                    cout << "Fill tolerance: " << editor.bucket().tolerance() << endl;
+                }
+                else if (key == 'c')
+                {
+                    editor.setFillConnectivity((editor.bucket().connectivity() == 4) ? 8 : 4);
+                    cout << "Fill connectivity: " << editor.bucket().connectivity() << endl;
+                }
+                else if (key == 'l')
+                {
+                    editor.setFillColorSpace((editor.bucket().colorSpace() == FILL_RGB) ? FILL_LAB : FILL_RGB);
+                    cout << "Fill tolerance color space: " << ((editor.bucket().colorSpace() == FILL_LAB) ? "Lab" : "RGB") << endl;
+                }
+                else if (key == 'n')
+                {
+                    editor.addLayer("");
+                }
+                else if (key == ',' || key == '.')
+                {
+                    editor.selectLayer(editor.layers().active() + ((key == ',') ? -1 : 1));
+                }
+                else if (key == 'v')
+                {
+                    editor.setLayerVisible(!editor.layers().layer(editor.layers().active()).visible);
+                }
+                else if (key == 'b')
+                {
+                    editor.setLayerBlendMode((BlendMode)((editor.layers().layer(editor.layers().active()).blendMode + 1) % (BLEND_ADD + 1)));
+                }
+                else if (key == '<' || key == '>')
+                {
+                    editor.setLayerOpacity(editor.layers().layer(editor.layers().active()).opacity + ((key == '<') ? -LAYER_OPACITY_STEP : LAYER_OPACITY_STEP));
+                }
+                else if (key == 'i' || key == 'o')
+                {
+                    viewport.setZoom(viewport.zoom() * ((key == 'i') ? VIEW_ZOOM_STEP : 1.0 / VIEW_ZOOM_STEP));
+                }
+                else if (key == '0')
+                {
+                    viewport.zoomToFit();
+                }
+                else if (key == '1')
+                {
+                    viewport.setZoom(1.0);
+                }
+                else if (key == 'w' || key == 'a' || key == 's' || key == 'd')
+                {
+                    viewport.pan(Point2d((key == 'a') ? -VIEW_PAN_STEP : (key == 'd') ? VIEW_PAN_STEP : 0, (key == 'w') ? -VIEW_PAN_STEP : (key == 's') ? VIEW_PAN_STEP : 0));
+                }
+
+                // a pan or zoom while adjusting previews the adjustment over the new view
+                if (is_adjusting && viewport.visibleRegion() != adjustment_view)
+                {
+                    adjustCallback(0, NULL);
+                }
+
+                // show the active layer whenever the layer settings change
+                if (key == 'n' || key == ',' || key == '.' || key == 'v' || key == 'b' || key == '<' || key == '>')
+                {
+                    const Layer &layer = editor.layers().layer(editor.layers().active());
+                    cout << "Layer " << editor.layers().active() << " of " << editor.layers().count() << ": " << layer.name << ", " << LayerStack::blendModeName(layer.blendMode) << ", opacity " << layer.opacity << (layer.visible ? "" : ", hidden") << endl;
+                }
+
+                viewport.present(editor.canvas(), editor.cropRect());
+            }
 
-            waitKey();
+            // let a save still running in the background finish
+            editor.waitForSave();
         }
     }
     return 0;
@@ -0,0 +1,359 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file CoinCache.cpp
+ * @brief Implementation of the CoinCache class
+ *
+ * This class provides a persistent, memory-mapped cache of coin detection results keyed by the content hash of the
+ * encoded image file
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#include "CoinCache.h"
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// cache file identification
+#define COIN_CACHE_MAGIC "COINCACH"
+#define COIN_CACHE_VERSION 2
+
+// content hash constants
+static const uint64_t HASH_PRIME1 = 11400714785074694791ULL;
+static const uint64_t HASH_PRIME2 = 14029467366897019727ULL;
+static const uint64_t HASH_PRIME3 = 1609587929392839161ULL;
+static const uint64_t HASH_PRIME4 = 9650029242287828579ULL;
+static const uint64_t HASH_PRIME5 = 2870177450012600261ULL;
+
+// content hash helpers
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint64_t read64(const unsigned char *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+static inline uint32_t read32(const unsigned char *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+static inline uint64_t hashRound(uint64_t acc, uint64_t input) { return rotl64(acc + input * HASH_PRIME2, 31) * HASH_PRIME1; }
+static inline uint64_t hashMerge(uint64_t acc, uint64_t value) { return (acc ^ hashRound(0, value)) * HASH_PRIME1 + HASH_PRIME4; }
+
+// file header
+struct CoinCache::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity;
+    uint64_t clock;     // incremented on every access, used as the LRU stamp
+};
+
+// key table entry, a slot is empty while lastUsed is 0
+struct CoinCache::Key
+{
+    uint64_t hash;
+    uint64_t fileSize;
+    uint64_t configHash;
+    uint64_t lastUsed;
+};
+
+// result slot
+struct CoinCache::Slot
+{
+    int32_t coinCount;
+    int32_t reserved;
+    CoinRecord coins[COIN_CACHE_MAX_COINS];
+};
+
+/*******************************************************************************************************************/ /**
+ * @brief Class constructor
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+CoinCache::CoinCache() : myFile(-1), myMapping(NULL), myMappingSize(0), myHeader(NULL), myKeys(NULL), mySlots(NULL)
+{
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Class destructor, unmaps and closes the cache file
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+CoinCache::~CoinCache()
+{
+    close();
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Open or create the cache file
+ *
+ * A new file is sized for the given capacity. An existing file keeps the capacity it was created with, unless its
+ * header does not match this version, in which case it is reinitialized.
+ *
+ * @param[in] fileName path of the cache file
+ * @param[in] capacity maximum number of cached images for a new file
+ * @return false if the file could not be opened or mapped
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool CoinCache::open(const string &fileName, uint32_t capacity)
+{
+    close();
+
+    myFile = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (myFile < 0)
+    {
+        cout << "Error while opening cache file " << fileName << endl;
+        return false;
+    }
+    flock(myFile, LOCK_EX);
+
+    // reuse the capacity of a valid existing file
+    Header header;
+    struct stat fileStat;
+    bool valid = false;
+    if (fstat(myFile, &fileStat) == 0 && fileStat.st_size >= (off_t)sizeof(Header) && pread(myFile, &header, sizeof(Header), 0) == (ssize_t)sizeof(Header))
+    {
+        size_t expectedSize = sizeof(Header) + header.capacity * (sizeof(Key) + sizeof(Slot));
+        valid = memcmp(header.magic, COIN_CACHE_MAGIC, sizeof(header.magic)) == 0 && header.version == COIN_CACHE_VERSION && header.capacity > 0 && (size_t)fileStat.st_size == expectedSize;
+    }
+    if (!valid)
+    {
+        memcpy(header.magic, COIN_CACHE_MAGIC, sizeof(header.magic));
+        header.version = COIN_CACHE_VERSION;
+        header.capacity = capacity;
+        header.clock = 0;
+        size_t fileSize = sizeof(Header) + capacity * (sizeof(Key) + sizeof(Slot));
+        if (ftruncate(myFile, 0) != 0 || ftruncate(myFile, fileSize) != 0 || pwrite(myFile, &header, sizeof(Header), 0) != (ssize_t)sizeof(Header))
+        {
+            cout << "Error while initializing cache file " << fileName << endl;
+            flock(myFile, LOCK_UN);
+            close();
+            return false;
+        }
+    }
+
+    myMappingSize = sizeof(Header) + header.capacity * (sizeof(Key) + sizeof(Slot));
+    void *mapping = mmap(NULL, myMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, myFile, 0);
+    flock(myFile, LOCK_UN);
+    if (mapping == MAP_FAILED)
+    {
+        cout << "Error while mapping cache file " << fileName << endl;
+        myMappingSize = 0;
+        close();
+        return false;
+    }
+
+    myMapping = static_cast<unsigned char *>(mapping);
+    myHeader = reinterpret_cast<Header *>(myMapping);
+    myKeys = reinterpret_cast<Key *>(myMapping + sizeof(Header));
+    mySlots = reinterpret_cast<Slot *>(myMapping + sizeof(Header) + header.capacity * sizeof(Key));
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Check whether a cache file is mapped
+ * @return true if the cache can be used
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool CoinCache::isOpen() const
+{
+    return myMapping != NULL;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Unmap and close the cache file
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void CoinCache::close()
+{
+    if (myMapping != NULL)
+    {
+        munmap(myMapping, myMappingSize);
+    }
+    if (myFile >= 0)
+    {
+        ::close(myFile);
+    }
+    myFile = -1;
+    myMapping = NULL;
+    myMappingSize = 0;
+    myHeader = NULL;
+    myKeys = NULL;
+    mySlots = NULL;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Look up the results of an image
+ * @param[in] hash content hash of the encoded image file
+ * @param[in] fileSize size of the encoded image file in bytes
+ * @param[in] configHash hash of the detector and classifier parameters the results must have been computed with
+ * @param[out] coins cached coin results
+ * @return true on a cache hit
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool CoinCache::lookup(uint64_t hash, uint64_t fileSize, uint64_t configHash, vector<CoinRecord> &coins)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    bool hit = false;
+    flock(myFile, LOCK_EX);
+    for (uint32_t i = 0; i < myHeader->capacity; i++)
+    {
+        Key &key = myKeys[i];
+        if (key.lastUsed != 0 && key.hash == hash && key.fileSize == fileSize && key.configHash == configHash)
+        {
+            // a count out of range comes from a torn write or a foreign file, so the slot is dropped as a miss
+            const Slot &slot = mySlots[i];
+            if (slot.coinCount < 0 || slot.coinCount > COIN_CACHE_MAX_COINS)
+            {
+                key.lastUsed = 0;
+                break;
+            }
+            coins.assign(slot.coins, slot.coins + slot.coinCount);
+            key.lastUsed = ++myHeader->clock;
+            hit = true;
+            break;
+        }
+    }
+    flock(myFile, LOCK_UN);
+    return hit;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Store the results of an image
+ *
+ * Reuses the slot of the same image, an empty slot, or evicts the least recently used slot, in that order. The slot
+ * of the same image computed with other parameters is reused too, so stale results are replaced rather than kept.
+ * Results beyond COIN_CACHE_MAX_COINS coins are not cached.
+ *
+ * @param[in] hash content hash of the encoded image file
+ * @param[in] fileSize size of the encoded image file in bytes
+ * @param[in] configHash hash of the detector and classifier parameters the results were computed with
+ * @param[in] coins coin results to store
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void CoinCache::insert(uint64_t hash, uint64_t fileSize, uint64_t configHash, const vector<CoinRecord> &coins)
+{
+    if (!isOpen() || coins.size() > COIN_CACHE_MAX_COINS)
+    {
+        return;
+    }
+
+    flock(myFile, LOCK_EX);
+    uint32_t target = 0;
+    for (uint32_t i = 0; i < myHeader->capacity; i++)
+    {
+        const Key &key = myKeys[i];
+        if (key.lastUsed != 0 && key.hash == hash && key.fileSize == fileSize)
+        {
+            target = i;
+            break;
+        }
+        if (key.lastUsed < myKeys[target].lastUsed)
+        {
+            target = i;
+        }
+    }
+
+    // invalidate the key while the slot is rewritten
+    Key &key = myKeys[target];
+    key.lastUsed = 0;
+    Slot &slot = mySlots[target];
+    slot.coinCount = (int32_t)coins.size();
+    slot.reserved = 0;
+    if (!coins.empty())
+    {
+        memcpy(slot.coins, &coins[0], coins.size() * sizeof(CoinRecord));
+    }
+    key.hash = hash;
+    key.fileSize = fileSize;
+    key.configHash = configHash;
+    key.lastUsed = ++myHeader->clock;
+    flock(myFile, LOCK_UN);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Fast 64 bit content hash (XXH64 with seed 0)
+ * @param[in] data bytes to hash
+ * @param[in] size number of bytes
+ * @return the hash value
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+uint64_t CoinCache::hashBytes(const unsigned char *data, size_t size)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = data + size;
+    uint64_t h;
+
+    // four independent lanes over 32 byte stripes
+    if (size >= 32)
+    {
+        uint64_t v1 = HASH_PRIME1 + HASH_PRIME2;
+        uint64_t v2 = HASH_PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - HASH_PRIME1;
+        const unsigned char *limit = end - 32;
+        do
+        {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hashMerge(h, v1);
+        h = hashMerge(h, v2);
+        h = hashMerge(h, v3);
+        h = hashMerge(h, v4);
+    }
+    else
+    {
+        h = HASH_PRIME5;
+    }
+    h += (uint64_t)size;
+
+    // tail
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= hashRound(0, read64(p));
+        h = rotl64(h, 27) * HASH_PRIME1 + HASH_PRIME4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)read32(p) * HASH_PRIME1;
+        h = rotl64(h, 23) * HASH_PRIME2 + HASH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= (*p) * HASH_PRIME5;
+        h = rotl64(h, 11) * HASH_PRIME1;
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
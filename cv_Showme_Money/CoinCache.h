@@ -0,0 +1,109 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*******************************************************************************************************************/ /**
+ * @file CoinCache.h
+ * @brief Header file for the CoinCache class
+ *
+ * This class provides a persistent, memory-mapped cache of coin detection results keyed by the content hash of the
+ * encoded image file
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+
+#ifndef COINCACHE_H
+#define COINCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// maximum number of coins stored for one image
+#define COIN_CACHE_MAX_COINS 128
+
+// Detection result of a single coin, as stored in the cache file
+struct CoinRecord
+{
+    float centerX;   // ellipse center
+    float centerY;
+    float width;     // ellipse axes
+    float height;
+    float angle;     // ellipse rotation in degrees
+    int32_t type;    // coin type as classified
+    int32_t flags;   // COIN_RECORD_* flags
+};
+
+// the coin outline should be drawn (enough contour points for a stable ellipse)
+#define COIN_RECORD_DRAW_OUTLINE 1
+
+/*******************************************************************************************************************/ /**
+ * @class CoinCache
+ *
+ * @brief Persistent cache of coin detection results
+ *
+ * The cache is a single fixed-size file that is memory-mapped on open. It holds a compact key table (content hash,
+ * file size, configuration hash and last use stamp per slot) followed by the result slots, so a lookup only scans the key table and never
+ * decodes the image. When the cache is full the least recently used slot is overwritten, which keeps the file size
+ * bounded by the capacity given when it was created. The configuration hash identifies the detector and classifier
+ * parameters, so results computed with other parameters are never returned. Access is serialized between processes
+ * with an advisory lock.
+ *
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+class CoinCache
+{
+private:
+
+    struct Header;
+    struct Key;
+    struct Slot;
+
+    int myFile;
+    unsigned char *myMapping;
+    size_t myMappingSize;
+    Header *myHeader;
+    Key *myKeys;
+    Slot *mySlots;
+
+    void close();
+
+    // the mapping is owned by a single instance
+    CoinCache(const CoinCache &);
+    CoinCache &operator=(const CoinCache &);
+
+public:
+
+    // constructors
+    CoinCache();
+    ~CoinCache();
+
+    // cache file handling
+    bool open(const string &fileName, uint32_t capacity);
+    bool isOpen() const;
+
+    // cache access
+    bool lookup(uint64_t hash, uint64_t fileSize, uint64_t configHash, vector<CoinRecord> &coins);
+    void insert(uint64_t hash, uint64_t fileSize, uint64_t configHash, const vector<CoinRecord> &coins);
+
+    // misc
+    static uint64_t hashBytes(const unsigned char *data, size_t size);
+};
+
+#endif // COINCACHE_H
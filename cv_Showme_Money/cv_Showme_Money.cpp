@@ -24,8 +24,19 @@
 // include necessary dependencies
 #include <iostream>
 #include <string>
+#include <cstdlib>
+#include <cfloat>
+#include <climits>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 #include <opencv2/opencv.hpp>
 
+#include "CoinCache.h"
+
 // Global variables
 using namespace std;
 using namespace cv;
@@ -33,6 +44,31 @@ using namespace cv;
 // configuration parameters
 #define NUM_COMMAND_LINE_ARGUMENTS 1
 
+// Tiled edge detection parameters, images larger than TILED_MIN_PIXELS are processed in tiles automatically
+#define DEFAULT_TILE_SIZE 1024
+#define TILED_MIN_PIXELS (16 * 1024 * 1024)
+
+// Edge detection and ellipse fitting parameters
+#define CANNY_THRESHOLD1 100
+#define CANNY_THRESHOLD2 200
+#define CANNY_APERTURE 3
+#define MORPHOLOGY_SIZE 1
+#define MIN_ELLIPSE_INLIERS 20
+
+// Coin classifier parameters, a vote of the COIN_NEIGHBORS nearest rows of COIN_TABLE with every feature difference
+// divided by its scale, coins farther than COIN_MAX_DISTANCE from every row are not counted
+#define COIN_NEIGHBORS 3
+#define COIN_MAX_DISTANCE 3.0f
+#define COIN_SCALE_DIAMETER 10.0f
+#define COIN_SCALE_AXIS_RATIO 0.05f
+#define COIN_SCALE_HUE 5.0f
+#define COIN_SCALE_SATURATION 20.0f
+#define COIN_SCALE_RING_TEXTURE 0.1f
+
+// Result cache parameters
+#define COIN_CACHE_FILE_NAME "cv_Showme_Money.cache"
+#define COIN_CACHE_CAPACITY 1024
+
 // Color Constants
 Scalar COLOR_RED = CV_RGB(255, 0, 0); // For pennies
 Scalar COLOR_GREEN = CV_RGB(0, 255, 0); // For quarters
@@ -42,6 +78,548 @@ Scalar COLOR_YELLOW = CV_RGB(255, 255, 0); // For nickels
 // Outline color
 Scalar outlineColor;
 
+// Coin classes recognized by the classifier
+enum CoinType
+{
+    PENNY,
+    NICKEL,
+    DIME,
+    QUARTER,
+    UNKNOWN_COIN
+};
+
+// Per coin features compared by the classifier
+struct CoinFeatures
+{
+    float diameter;    // major axis of the fitted ellipse in pixels
+    float axisRatio;   // minor axis divided by major axis
+    float hue;         // circular mean hue (0-180) inside the ellipse
+    float saturation;  // mean saturation (0-255) inside the ellipse
+    float ringTexture; // fraction of edge pixels in the ring between the rim and the center
+};
+
+// Labelled coin of the classifier table
+struct CoinSample
+{
+    CoinFeatures features;
+    CoinType type;
+};
+
+// Classifier table, the features of the coins listed in coin_labels.txt at the scale of the coins*.jpeg samples, as
+// printed by --fit coin_labels.txt
+const CoinSample COIN_TABLE[] = {
+    {{133.3f, 0.989f, 21.0f, 42.4f, 0.637f}, QUARTER}, // coins1.jpeg 338 580
+    {{133.5f, 0.995f, 19.9f, 56.1f, 0.660f}, QUARTER}, // coins1.jpeg 488 496
+    {{105.1f, 0.995f, 12.8f, 120.8f, 0.178f}, PENNY}, // coins1.jpeg 252 450
+    {{99.7f, 0.991f, 21.9f, 44.0f, 0.648f}, DIME}, // coins1.jpeg 380 349
+    {{119.8f, 0.986f, 22.2f, 48.2f, 0.404f}, NICKEL}, // coins1.jpeg 551 287
+    {{102.0f, 0.990f, 20.3f, 58.2f, 0.413f}, DIME}, // coins1.jpeg 223 224
+    {{108.7f, 0.981f, 13.1f, 133.9f, 0.280f}, PENNY}, // coins1.jpeg 392 157
+    {{129.3f, 0.996f, 20.7f, 45.7f, 0.655f}, QUARTER}, // coins2.jpeg 300 559
+    {{129.0f, 0.981f, 19.7f, 57.6f, 0.685f}, QUARTER}, // coins2.jpeg 537 551
+    {{95.3f, 0.987f, 20.6f, 62.9f, 0.666f}, DIME}, // coins2.jpeg 427 370
+    {{115.2f, 0.971f, 22.5f, 50.0f, 0.381f}, NICKEL}, // coins2.jpeg 583 322
+    {{103.2f, 0.976f, 15.0f, 133.6f, 0.194f}, PENNY}, // coins2.jpeg 475 192
+    {{126.9f, 0.994f, 19.5f, 61.1f, 0.608f}, QUARTER}, // coins3.jpeg 486 489
+    {{94.8f, 0.992f, 21.1f, 52.4f, 0.681f}, DIME}, // coins3.jpeg 377 354
+    {{113.7f, 0.988f, 22.0f, 51.2f, 0.360f}, NICKEL}, // coins3.jpeg 531 300
+    {{97.2f, 0.984f, 23.3f, 59.0f, 0.617f}, DIME}, // coins3.jpeg 226 238
+    {{102.5f, 0.989f, 14.7f, 134.4f, 0.153f}, PENNY}, // coins3.jpeg 418 173
+    {{146.6f, 0.993f, 21.3f, 38.6f, 0.600f}, QUARTER}, // coins4.jpeg 264 535
+    {{146.1f, 0.989f, 19.8f, 50.3f, 0.648f}, QUARTER}, // coins4.jpeg 533 531
+    {{115.3f, 0.997f, 12.5f, 112.0f, 0.154f}, PENNY}, // coins4.jpeg 228 363
+    {{133.2f, 0.959f, 22.1f, 46.7f, 0.392f}, NICKEL}, // coins4.jpeg 591 272
+    {{119.1f, 0.971f, 13.2f, 130.4f, 0.241f}, PENNY}, // coins4.jpeg 470 120
+};
+const int COIN_TABLE_SIZE = sizeof(COIN_TABLE) / sizeof(COIN_TABLE[0]);
+
+/*******************************************************************************************************************/ /**
+ * @brief Find the cleaned up coin edges of a color image
+ *
+ * Converts the image to grayscale, runs Canny edge detection and closes small gaps in the edges with a dilate
+ * followed by an erode.
+ *
+ * @param[in] imageColor BGR input image (may be a ROI)
+ * @param[out] imageEnD edge mask after dilate and erode
+ * @param[in] cannyThreshold1 first hysteresis threshold for Canny
+ * @param[in] cannyThreshold2 second hysteresis threshold for Canny
+ * @param[in] cannyAperture aperture size of the Sobel operator used by Canny
+ * @param[in] morphologySize number of dilate/erode iterations
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void detectCoinEdges(const Mat &imageColor, Mat &imageEnD, double cannyThreshold1, double cannyThreshold2, int cannyAperture, int morphologySize)
+{
+    Mat imageGray;
+    Mat imageEdges;
+
+    // Converting the Color image to GrayScale image
+    cvtColor(imageColor, imageGray, COLOR_BGR2GRAY);
+
+    // Finding edges in the image using canny edge detection
+    Canny(imageGray, imageEdges, cannyThreshold1, cannyThreshold2, cannyAperture);
+
+    // Removing noise from the edges using ERODE and DILATE
+    dilate(imageEdges, imageEnD, Mat(), Point(-1, -1), morphologySize);
+    erode(imageEnD, imageEnD, Mat(), Point(-1, -1), morphologySize);
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Find the cleaned up coin edges of a large image tile by tile in parallel
+ *
+ * The image is split into tileSize x tileSize tiles which are processed concurrently with parallel_for_, each padded
+ * with a halo and written back without it. Canny's hysteresis follows weak edge chains across the whole image, so it
+ * cannot run per tile: the first pass runs Canny on every tile once with both thresholds set to the lower one and
+ * once with both set to the upper one, which gives the weak and strong edge candidates after non-maximum suppression
+ * and needs a halo only as wide as the Sobel aperture. Hysteresis then runs on the assembled masks, keeping every
+ * 8-connected chain of weak edges that holds a strong edge, and a second pass closes the gaps with dilate/erode per
+ * tile. The result is the same edge mask as detectCoinEdges() on the whole image, contours crossing tile borders stay
+ * connected when findContours runs over it, and the grayscale and raw edge intermediates are bounded by the tile size.
+ *
+ * @param[in] imageColor BGR input image
+ * @param[out] imageEnD edge mask after dilate and erode, same size as imageColor
+ * @param[in] tileSize edge length of a tile in pixels
+ * @param[in] cannyThreshold1 first hysteresis threshold for Canny
+ * @param[in] cannyThreshold2 second hysteresis threshold for Canny
+ * @param[in] cannyAperture aperture size of the Sobel operator used by Canny
+ * @param[in] morphologySize number of dilate/erode iterations
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void detectCoinEdgesTiled(const Mat &imageColor, Mat &imageEnD, int tileSize, double cannyThreshold1, double cannyThreshold2, int cannyAperture, int morphologySize)
+{
+    const int cannyHalo = cannyAperture / 2 + 1;
+    const int morphologyHalo = 2 * morphologySize;
+    const double lowThreshold = std::min(cannyThreshold1, cannyThreshold2);
+    const double highThreshold = std::max(cannyThreshold1, cannyThreshold2);
+    const int tilesX = (imageColor.cols + tileSize - 1) / tileSize;
+    const int tilesY = (imageColor.rows + tileSize - 1) / tileSize;
+    const Rect imageBounds(0, 0, imageColor.cols, imageColor.rows);
+
+    // tile core, and the region processed for it with a halo of the given width
+    auto tileCore = [&](int t)
+    {
+        return Rect(Point((t % tilesX) * tileSize, (t / tilesX) * tileSize), Size(tileSize, tileSize)) & imageBounds;
+    };
+    auto tilePadded = [&](const Rect &core, int halo)
+    {
+        return Rect(core.x - halo, core.y - halo, core.width + 2 * halo, core.height + 2 * halo) & imageBounds;
+    };
+
+    // weak and strong edge candidates, with equal thresholds Canny keeps every suppressed maximum above them
+    Mat weakEdges(imageColor.size(), CV_8UC1);
+    Mat strongEdges(imageColor.size(), CV_8UC1);
+    parallel_for_(Range(0, tilesX * tilesY), [&](const Range &range)
+    {
+        for (int t = range.start; t < range.end; t++)
+        {
+            Rect core = tileCore(t);
+            Rect padded = tilePadded(core, cannyHalo);
+            Rect coreInTile(core.tl() - padded.tl(), core.size());
+
+            Mat tileGray;
+            Mat tileEdges;
+            cvtColor(imageColor(padded), tileGray, COLOR_BGR2GRAY);
+            Canny(tileGray, tileEdges, lowThreshold, lowThreshold, cannyAperture);
+            tileEdges(coreInTile).copyTo(weakEdges(core));
+            Canny(tileGray, tileEdges, highThreshold, highThreshold, cannyAperture);
+            tileEdges(coreInTile).copyTo(strongEdges(core));
+        }
+    });
+
+    // hysteresis over the whole image, a chain of weak edges is kept if any of its pixels is a strong edge
+    Mat labels;
+    int labelCount = connectedComponents(weakEdges, labels, 8, CV_32S);
+    Mat keptLabels = Mat::zeros(1, labelCount, CV_8UC1);
+    uchar *kept = keptLabels.ptr<uchar>(0);
+    for (int y = 0; y < labels.rows; y++)
+    {
+        const int *labelRow = labels.ptr<int>(y);
+        const uchar *strongRow = strongEdges.ptr<uchar>(y);
+        for (int x = 0; x < labels.cols; x++)
+        {
+            if (strongRow[x] != 0)
+            {
+                kept[labelRow[x]] = 255;
+            }
+        }
+    }
+    kept[0] = 0;
+    weakEdges.release();
+    strongEdges.release();
+
+    // Removing noise from the edges using ERODE and DILATE
+    imageEnD.create(imageColor.size(), CV_8UC1);
+    parallel_for_(Range(0, tilesX * tilesY), [&](const Range &range)
+    {
+        for (int t = range.start; t < range.end; t++)
+        {
+            Rect core = tileCore(t);
+            Rect padded = tilePadded(core, morphologyHalo);
+
+            Mat tileEdges(padded.size(), CV_8UC1);
+            for (int y = 0; y < padded.height; y++)
+            {
+                const int *labelRow = labels.ptr<int>(padded.y + y) + padded.x;
+                uchar *edgeRow = tileEdges.ptr<uchar>(y);
+                for (int x = 0; x < padded.width; x++)
+                {
+                    edgeRow[x] = kept[labelRow[x]];
+                }
+            }
+            dilate(tileEdges, tileEdges, Mat(), Point(-1, -1), morphologySize);
+            erode(tileEdges, tileEdges, Mat(), Point(-1, -1), morphologySize);
+
+            // keep only the core, the halo is owned by the neighbouring tiles
+            tileEdges(Rect(core.tl() - padded.tl(), core.size())).copyTo(imageEnD(core));
+        }
+    });
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Compute the color, shape and texture features of a single coin
+ *
+ * The ellipse is rasterized into a mask over its bounding box only, and the color and texture statistics are taken
+ * with masked mean() reductions over that box, so the cost is proportional to the coin size and no per pixel at<>
+ * access is needed.
+ *
+ * @param[in] imageInput BGR input image
+ * @param[in] imageEnD edge mask of the image
+ * @param[in] coinEllipse ellipse fitted to the coin contour
+ * @return the features of the coin
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+CoinFeatures extractCoinFeatures(const Mat &imageInput, const Mat &imageEnD, const RotatedRect &coinEllipse)
+{
+    CoinFeatures features;
+    features.diameter = std::max(coinEllipse.size.width, coinEllipse.size.height);
+    features.axisRatio = std::min(coinEllipse.size.width, coinEllipse.size.height) / std::max(features.diameter, 1.0f);
+    features.hue = 0;
+    features.saturation = 0;
+    features.ringTexture = 0;
+
+    Rect region = coinEllipse.boundingRect() & Rect(0, 0, imageInput.cols, imageInput.rows);
+    if (region.empty())
+    {
+        return features;
+    }
+
+    // ellipse mask in the coordinates of the bounding box
+    RotatedRect localEllipse = coinEllipse;
+    localEllipse.center -= Point2f((float)region.x, (float)region.y);
+    Mat coinMask = Mat::zeros(region.size(), CV_8UC1);
+    ellipse(coinMask, localEllipse, Scalar(255), FILLED);
+
+    // ring between 55% and 85% of the radius, which holds the lettering and rim relief but not the outline itself
+    RotatedRect ringOuter = localEllipse;
+    RotatedRect ringInner = localEllipse;
+    ringOuter.size = Size2f(localEllipse.size.width * 0.85f, localEllipse.size.height * 0.85f);
+    ringInner.size = Size2f(localEllipse.size.width * 0.55f, localEllipse.size.height * 0.55f);
+    Mat ringMask = Mat::zeros(region.size(), CV_8UC1);
+    ellipse(ringMask, ringOuter, Scalar(255), FILLED);
+    ellipse(ringMask, ringInner, Scalar(0), FILLED);
+
+    // mean color of the coin, the hue is averaged as an angle since red and copper hues wrap around from 180 to 0
+    static Mat hueCosine;
+    static Mat hueSine;
+    if (hueCosine.empty())
+    {
+        hueCosine.create(1, 256, CV_32FC1);
+        hueSine.create(1, 256, CV_32FC1);
+        for (int h = 0; h < 256; h++)
+        {
+            hueCosine.at<float>(0, h) = (float)cos(h * CV_PI / 90.0);
+            hueSine.at<float>(0, h) = (float)sin(h * CV_PI / 90.0);
+        }
+    }
+    Mat coinHSV;
+    Mat channelsHSV[3];
+    Mat cosine;
+    Mat sine;
+    cvtColor(imageInput(region), coinHSV, COLOR_BGR2HSV);
+    split(coinHSV, channelsHSV);
+    LUT(channelsHSV[0], hueCosine, cosine);
+    LUT(channelsHSV[0], hueSine, sine);
+    double hueAngle = atan2(mean(sine, coinMask)[0], mean(cosine, coinMask)[0]);
+    features.hue = (float)fmod(hueAngle * 90.0 / CV_PI + 180.0, 180.0);
+    features.saturation = (float)mean(channelsHSV[1], coinMask)[0];
+
+    // edge density of the ring
+    features.ringTexture = (float)(mean(imageEnD(region), ringMask)[0] / 255.0);
+
+    return features;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Classify a coin by a vote of its nearest neighbors in the classifier table
+ *
+ * Feature differences are divided by their COIN_SCALE_* scale and hue differences are taken around the hue circle.
+ * The COIN_NEIGHBORS nearest table rows vote, a tie going to the type of the nearer row.
+ *
+ * @param[in] features features of the coin
+ * @return the coin type, or UNKNOWN_COIN if no table row is within COIN_MAX_DISTANCE
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+CoinType classifyCoin(const CoinFeatures &features)
+{
+    // nearest rows so far, by increasing distance
+    pair<float, CoinType> nearest[COIN_NEIGHBORS];
+    int nearestCount = 0;
+    for (int i = 0; i < COIN_TABLE_SIZE; i++)
+    {
+        const CoinFeatures &sample = COIN_TABLE[i].features;
+        float hueDifference = fabs(features.hue - sample.hue);
+        float terms[] = {(features.diameter - sample.diameter) / COIN_SCALE_DIAMETER,
+                         (features.axisRatio - sample.axisRatio) / COIN_SCALE_AXIS_RATIO,
+                         std::min(hueDifference, 180.0f - hueDifference) / COIN_SCALE_HUE,
+                         (features.saturation - sample.saturation) / COIN_SCALE_SATURATION,
+                         (features.ringTexture - sample.ringTexture) / COIN_SCALE_RING_TEXTURE};
+        float distance = 0.0f;
+        for (int t = 0; t < 5; t++)
+        {
+            distance += terms[t] * terms[t];
+        }
+
+        pair<float, CoinType> candidate(sqrt(distance), COIN_TABLE[i].type);
+        if (nearestCount < COIN_NEIGHBORS)
+        {
+            nearest[nearestCount++] = candidate;
+        }
+        else if (candidate.first < nearest[COIN_NEIGHBORS - 1].first)
+        {
+            nearest[COIN_NEIGHBORS - 1] = candidate;
+        }
+        else
+        {
+            continue;
+        }
+        for (int j = nearestCount - 1; j > 0 && nearest[j].first < nearest[j - 1].first; j--)
+        {
+            std::swap(nearest[j], nearest[j - 1]);
+        }
+    }
+
+    if (nearestCount == 0 || nearest[0].first > COIN_MAX_DISTANCE)
+    {
+        return UNKNOWN_COIN;
+    }
+
+    int votes[UNKNOWN_COIN] = {0};
+    for (int j = 0; j < nearestCount; j++)
+    {
+        votes[nearest[j].second]++;
+    }
+    CoinType type = nearest[0].second;
+    for (int j = 1; j < nearestCount; j++)
+    {
+        if (votes[nearest[j].second] > votes[type])
+        {
+            type = nearest[j].second;
+        }
+    }
+    return type;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Fit ellipses to the outer contours of an edge mask
+ * @param[in] imageEnD edge mask after dilate and erode
+ * @param[out] ellipses ellipses fitted to the contours of more than 5 points
+ * @param[out] contourSizes number of points of the contour of each ellipse
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void findCoinEllipses(const Mat &imageEnD, vector<RotatedRect> &ellipses, vector<size_t> &contourSizes)
+{
+    // Locating image contours by applying threshold or canny
+    vector<vector<Point> > contours;
+    findContours(imageEnD, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, Point(0, 0));
+
+    ellipses.clear();
+    contourSizes.clear();
+    for (size_t i = 0; i < contours.size(); i++)
+    {
+        if (contours[i].size() <= 5)
+        {
+            continue;
+        }
+        ellipses.push_back(fitEllipse(contours[i]));
+        contourSizes.push_back(contours[i].size());
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Detect and classify the coins in an image
+ * @param[in] imageInput BGR input image
+ * @param[in] tileSize tile size for edge detection, 0 processes the whole image at once
+ * @param[out] coins ellipse, type and drawing flags of every recognized coin
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+void detectCoins(const Mat &imageInput, int tileSize, vector<CoinRecord> &coins)
+{
+    // Finding edges in the image using canny edge detection, then removing noise using ERODE and DILATE
+    const double cannyThreshold1 = CANNY_THRESHOLD1;
+    const double cannyThreshold2 = CANNY_THRESHOLD2;
+    const int cannyAperture = CANNY_APERTURE;
+    const int morphologySize = MORPHOLOGY_SIZE;
+
+    Mat imageEnD;
+    if (tileSize > 0)
+    {
+        cout << "Tiled edge detection: " << tileSize << "x" << tileSize << " tiles on " << getNumThreads() << " threads" << endl << endl;
+        detectCoinEdgesTiled(imageInput, imageEnD, tileSize, cannyThreshold1, cannyThreshold2, cannyAperture, morphologySize);
+    }
+    else
+    {
+        detectCoinEdges(imageInput, imageEnD, cannyThreshold1, cannyThreshold2, cannyAperture, morphologySize);
+    }
+
+    vector<RotatedRect> ellipses;
+    vector<size_t> contourSizes;
+    findCoinEllipses(imageEnD, ellipses, contourSizes);
+
+    const size_t minEllipseInliers = MIN_ELLIPSE_INLIERS;
+
+    // identify the coins from the features of their ellipses
+    coins.clear();
+    for (size_t i = 0; i < ellipses.size(); i++)
+    {
+        CoinType type = classifyCoin(extractCoinFeatures(imageInput, imageEnD, ellipses[i]));
+        if (type == UNKNOWN_COIN)
+        {
+            continue;
+        }
+
+        CoinRecord coin;
+        coin.centerX = ellipses[i].center.x;
+        coin.centerY = ellipses[i].center.y;
+        coin.width = ellipses[i].size.width;
+        coin.height = ellipses[i].size.height;
+        coin.angle = ellipses[i].angle;
+        coin.type = type;
+        coin.flags = (contourSizes[i] > minEllipseInliers) ? COIN_RECORD_DRAW_OUTLINE : 0;
+        coins.push_back(coin);
+    }
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Fit the classifier table to labelled coins and print it
+ *
+ * Every line of the labels file names an image, relative to the labels file, the center of a coin in it and its type,
+ * and lines starting with # are comments. Each coin is matched with the ellipse nearest to its center, found as in
+ * detectCoins() on the whole image, and its features are printed as a COIN_TABLE row, so the table can be fitted
+ * again to new samples or a new camera setup.
+ *
+ * @param[in] labelsFileName path of the labels file
+ * @return false if the file or an image cannot be read, a line is malformed or a labelled coin is not found
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+bool fitCoinTable(const string &labelsFileName)
+{
+    const char *typeNames[] = {"penny", "nickel", "dime", "quarter"};
+    const char *typeConstants[] = {"PENNY", "NICKEL", "DIME", "QUARTER"};
+
+    ifstream labelsFile(labelsFileName.c_str());
+    if (!labelsFile)
+    {
+        cout << "Error while opening file " << labelsFileName << endl;
+        return false;
+    }
+    size_t slash = labelsFileName.find_last_of('/');
+    string directory = (slash == string::npos) ? string() : labelsFileName.substr(0, slash + 1);
+
+    // consecutive coins of the same image share its edges and ellipses
+    string imageName;
+    Mat imageInput;
+    Mat imageEnD;
+    vector<RotatedRect> ellipses;
+    vector<size_t> contourSizes;
+
+    string line;
+    for (int lineNumber = 1; getline(labelsFile, line); lineNumber++)
+    {
+        istringstream fields(line);
+        string name;
+        if (!(fields >> name) || name[0] == '#')
+        {
+            continue;
+        }
+
+        Point2f center;
+        string typeName;
+        int type = PENNY;
+        if (fields >> center.x >> center.y >> typeName)
+        {
+            while (type < UNKNOWN_COIN && typeName != typeNames[type])
+            {
+                type++;
+            }
+        }
+        if (typeName.empty() || type == UNKNOWN_COIN)
+        {
+            cout << "Malformed label on line " << lineNumber << " of " << labelsFileName << endl;
+            return false;
+        }
+
+        if (name != imageName)
+        {
+            imageInput = imread(directory + name, IMREAD_COLOR);
+            if (!imageInput.data)
+            {
+                cout << "Error while opening file " << directory + name << endl;
+                return false;
+            }
+            detectCoinEdges(imageInput, imageEnD, CANNY_THRESHOLD1, CANNY_THRESHOLD2, CANNY_APERTURE, MORPHOLOGY_SIZE);
+            findCoinEllipses(imageEnD, ellipses, contourSizes);
+            imageName = name;
+        }
+
+        // nearest ellipse that contains the labelled center
+        int coin = -1;
+        float coinDistance = FLT_MAX;
+        for (size_t i = 0; i < ellipses.size(); i++)
+        {
+            Point2f offset = ellipses[i].center - center;
+            float distance = sqrt(offset.x * offset.x + offset.y * offset.y);
+            if (distance < std::min(ellipses[i].size.width, ellipses[i].size.height) / 2 && distance < coinDistance)
+            {
+                coin = (int)i;
+                coinDistance = distance;
+            }
+        }
+        if (coin < 0)
+        {
+            cout << "No coin found at line " << lineNumber << " of " << labelsFileName << endl;
+            return false;
+        }
+
+        CoinFeatures features = extractCoinFeatures(imageInput, imageEnD, ellipses[coin]);
+        cout << fixed << "    {{" << setprecision(1) << features.diameter << "f, " << setprecision(3) << features.axisRatio
+             << "f, " << setprecision(1) << features.hue << "f, " << features.saturation << "f, " << setprecision(3)
+             << features.ringTexture << "f}, " << typeConstants[type] << "}, // " << name << " " << cvRound(center.x)
+             << " " << cvRound(center.y) << endl;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************/ /**
+ * @brief Hash the parameters that the coin results depend on, for the result cache
+ * @param[in] tileSize tile size argument, -1 when it is picked from the image size
+ * @return hash of the classifier table, the edge detection and the tiling parameters
+ * @author Viraj V. Sabhaya
+**********************************************************************************************************************/
+uint64_t coinConfigHash(int tileSize)
+{
+    vector<double> parameters;
+    for (int i = 0; i < COIN_TABLE_SIZE; i++)
+    {
+        const CoinFeatures &features = COIN_TABLE[i].features;
+        double row[] = {features.diameter, features.axisRatio, features.hue, features.saturation, features.ringTexture, (double)COIN_TABLE[i].type};
+        parameters.insert(parameters.end(), row, row + sizeof(row) / sizeof(row[0]));
+    }
+    double settings[] = {COIN_NEIGHBORS, COIN_MAX_DISTANCE, COIN_SCALE_DIAMETER, COIN_SCALE_AXIS_RATIO, COIN_SCALE_HUE,
+                         COIN_SCALE_SATURATION, COIN_SCALE_RING_TEXTURE, CANNY_THRESHOLD1, CANNY_THRESHOLD2, CANNY_APERTURE,
+                         MORPHOLOGY_SIZE, MIN_ELLIPSE_INLIERS, DEFAULT_TILE_SIZE, TILED_MIN_PIXELS, (double)tileSize};
+    parameters.insert(parameters.end(), settings, settings + sizeof(settings) / sizeof(settings[0]));
+    return CoinCache::hashBytes(reinterpret_cast<const unsigned char *>(parameters.data()), parameters.size() * sizeof(double));
+}
+
 /*******************************************************************************************************************/ /**
  * @brief program entry point
  * @param[in] argc number of command line arguments
@@ -51,13 +629,9 @@ Scalar outlineColor;
 **********************************************************************************************************************/
 int main(int argc, char *argv[])
 {
-    // Input image, GrayScale image and Coins Image(Circles the coins)
+    // Input image and Coins Image(Circles the coins)
     Mat imageInput;
-    Mat imageGray;
-    Mat imageEdges;
-    Mat imageResult;
     Mat imageEllipse;
-    Mat imageRectangles;
 
     // Total number of Pennies, Quarters, Dimes, Nickels
     int totalPennies = 0;
@@ -68,126 +642,138 @@ int main(int argc, char *argv[])
     // Total value of COINS
     double totalValue = 0.0;
 
-    if (argc != NUM_COMMAND_LINE_ARGUMENTS + 1)
+    // Tile size for edge detection, 0 processes the whole image at once and -1 picks based on the image size
+    int tileSize = -1;
+    bool displayImages = true;
+    bool useCache = true;
+
+    // refit the classifier table from labelled samples instead of counting coins
+    if (argc == 3 && string(argv[1]) == "--fit")
+    {
+        return fitCoinTable(argv[2]) ? 0 : 1;
+    }
+
+    if (argc < NUM_COMMAND_LINE_ARGUMENTS + 1)
     {
-        printf("Usage: %s <image_file>\n", argv[0]);
+        printf("Usage: %s <image_file> [tile_size] [--no-display] [--no-cache]\n", argv[0]);
+        printf("       %s --fit <labels_file>\n", argv[0]);
         return 0;
     }
-    else
+    for (int i = NUM_COMMAND_LINE_ARGUMENTS + 1; i < argc; i++)
     {
-        imageInput = imread(argv[1], IMREAD_COLOR);
-
-        // check for file error
-        if (!imageInput.data)
+        string option(argv[i]);
+        if (option == "--no-display")
         {
-            cout << "Error while opening file " << argv[1] << endl;
-            return 0;
+            displayImages = false;
+        }
+        else if (option == "--no-cache")
+        {
+            useCache = false;
+        }
+        else
+        {
+            // anything else must be a whole tile size, so a mistyped flag is not read as 0
+            char *end = NULL;
+            long value = strtol(argv[i], &end, 10);
+            if (end == argv[i] || *end != '\0' || value < 0 || value > INT_MAX)
+            {
+                printf("Invalid argument: %s\n", argv[i]);
+                printf("Usage: %s <image_file> [tile_size] [--no-display] [--no-cache]\n", argv[0]);
+                return 0;
+            }
+            tileSize = (int)value;
         }
     }
 
-    // Copy the input image to the result image, imageEllipse and imageRectangles
-    imageResult = imageInput.clone();
-    imageEllipse = imageInput.clone();
-    imageRectangles = imageInput.clone();
-    
-    // display the Input Image size (Width, Height) and channels
-    cout << "Input Image details ... " << endl;
-    cout << "Image width: " << imageInput.size().width << endl;
-    cout << "Image height: " << imageInput.size().height << endl;
-    cout << "Image channels: " << imageInput.channels() << endl << endl;
-
-    // Converting the Color image to GrayScale image
-    cvtColor(imageInput, imageGray, COLOR_BGR2GRAY);
-
-    // Finding edges in the image using canny edge detection
-    const double cannyThreshold1 = 100;
-    const double cannyThreshold2 = 200;
-    const int cannyAperture = 3;
-    Canny(imageGray, imageEdges, cannyThreshold1, cannyThreshold2, cannyAperture);
+    // read the encoded image, the cache is keyed by its bytes so a hit needs no decoding
+    vector<uchar> encodedImage;
+    ifstream imageFile(argv[1], ios::binary);
+    if (!imageFile)
+    {
+        cout << "Error while opening file " << argv[1] << endl;
+        return 0;
+    }
+    encodedImage.assign(istreambuf_iterator<char>(imageFile), istreambuf_iterator<char>());
 
-    // Removing noise from the edges using ERODE and DILATE
-    Mat imageEnD;
-    int morphologySize = 1;
-    dilate(imageEdges, imageEnD, Mat(), Point(-1, -1), morphologySize);
-    erode(imageEnD, imageEnD, Mat(), Point(-1, -1), morphologySize);
-    
-    // Locating image contours by applying threshold or canny
-    vector<vector<Point> > contours;
-    findContours(imageEnD, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, Point(0, 0));
+    int64 lookupStart = getTickCount();
+    uint64_t imageHash = CoinCache::hashBytes(encodedImage.data(), encodedImage.size());
+    uint64_t configHash = coinConfigHash(tileSize);
+    CoinCache cache;
+    vector<CoinRecord> coins;
+    bool cacheHit = useCache && cache.open(COIN_CACHE_FILE_NAME, COIN_CACHE_CAPACITY) && cache.lookup(imageHash, encodedImage.size(), configHash, coins);
+    double lookupMs = (getTickCount() - lookupStart) * 1000.0 / getTickFrequency();
 
-    // Drawing contours around the coins
-    for(int i = 0; i < contours.size(); i++)
+    if (!cacheHit || displayImages)
     {
-        drawContours(imageResult, contours, i, COLOR_RED, 2);
+        imageInput = imdecode(encodedImage, IMREAD_COLOR);
+
+        // check for file error
+        if (!imageInput.data)
+        {
+            cout << "Error while opening file " << argv[1] << endl;
+            return 0;
+        }
     }
 
-    // rectangles
-    vector<RotatedRect> minAreaRectangles(contours.size());
-    for (int i = 0; i < contours.size(); i++)
+    if (cacheHit)
     {
-        minAreaRectangles[i] = minAreaRect(contours[i]);
+        cout << "Cached result found in " << lookupMs << " ms" << endl << endl;
     }
-    
-    for(int i = 0; i < contours.size(); i++)
+    else
     {
-        Point2f rectanglePoints[4];
-        minAreaRectangles[i].points(rectanglePoints);
-        for(int j = 0; j < 4; j++)
+        // display the Input Image size (Width, Height) and channels
+        cout << "Input Image details ... " << endl;
+        cout << "Image width: " << imageInput.size().width << endl;
+        cout << "Image height: " << imageInput.size().height << endl;
+        cout << "Image channels: " << imageInput.channels() << endl << endl;
+
+        if (tileSize < 0)
         {
-            line(imageRectangles, rectanglePoints[j], rectanglePoints[(j+1)%4], COLOR_GREEN);
+            tileSize = (imageInput.total() >= TILED_MIN_PIXELS) ? DEFAULT_TILE_SIZE : 0;
         }
+        detectCoins(imageInput, tileSize, coins);
+        cache.insert(imageHash, encodedImage.size(), configHash, coins);
     }
-    // fit ellipses to contours 
-    vector<RotatedRect> fittedEllipses(contours.size());
-    for (int i = 0; i < contours.size(); i++)
+
+    // Copy the input image to imageEllipse
+    if (displayImages)
     {
-        if(contours.at(i).size() > 5)
-        {
-            fittedEllipses[i] = fitEllipse(contours[i]);
-        }
+        imageEllipse = imageInput.clone();
     }
 
-    const int minEllipseInliers = 20;
-
-    // Identify the coins in the image from the calculated areaa
-    for (int i = 0; i < contours.size(); i++)
+    // Count the coins and outline them with the color of their type
+    for (int i = 0; i < coins.size(); i++)
     {
-        // cout << "Ellipse " << i << " ... " << endl;
-        double height = fittedEllipses[i].size.height;
-        // cout << "HEIGHT: " << height << endl;
-        double width = fittedEllipses[i].size.width;
-        // cout << "WIDTH: " << width << endl;
-        double area = (height) * (width) * 3.14159265;
-        // cout << "AREA: " << area << endl << endl;
-
-        if(height >= 102 && height < 110)
-        {   
+        switch (coins[i].type)
+        {
+        case PENNY:
             totalPennies++;
             totalValue += 0.01;
             outlineColor = COLOR_RED;
-        }
-        else if(height >= 112 && height < 120)
-        {
+            break;
+        case NICKEL:
             totalNickels++;
             totalValue += 0.05;
             outlineColor = COLOR_YELLOW;
-        }
-        else if(height >= 92 && height < 102)
-        {
+            break;
+        case DIME:
             totalDimes++;
             totalValue += 0.10;
             outlineColor = COLOR_BLUE;
-        }
-        else if(height >= 125)
-        {
+            break;
+        case QUARTER:
             totalQuarters++;
             totalValue += 0.25;
             outlineColor = COLOR_GREEN;
+            break;
+        default:
+            continue;
         }
 
-        if(contours.at(i).size() > minEllipseInliers)
+        if (displayImages && (coins[i].flags & COIN_RECORD_DRAW_OUTLINE))
         {
-            ellipse(imageEllipse, fittedEllipses[i], outlineColor, 2);
+            RotatedRect coinEllipse(Point2f(coins[i].centerX, coins[i].centerY), Size2f(coins[i].width, coins[i].height), coins[i].angle);
+            ellipse(imageEllipse, coinEllipse, outlineColor, 2);
         }
     }
     
@@ -199,14 +785,12 @@ int main(int argc, char *argv[])
     cout << "Total Value - $" << totalValue << endl;
 
     // display the images
-    imshow("input image", imageInput);
-    // imshow("image GRAY w/ BLUR", imageGray);
-    // imshow("image EDGES", imageEdges);
-    // imshow("image EDGES w/ erode and dilate", imageEnD);
-    // imshow("image contours", imageResult);
-    // imshow("image rectangles", imageRectangles);
-    imshow("image RESULT w/ ellipses", imageEllipse); 
+    if (displayImages)
+    {
+        imshow("input image", imageInput);
+        imshow("image RESULT w/ ellipses", imageEllipse);
 
-    waitKey();
+        waitKey();
+    }
 
-}
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file BatchProcessor.cpp
+ * @brief Implementation of the BatchProcessor class
+ *
+ * This class measures the boxes of many captures concurrently, each worker thread with a pipeline of its own
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "BatchProcessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @param[in] workerCount number of worker threads, 0 for one per hardware thread
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+BatchProcessor::BatchProcessor(int workerCount)
+{
+    int hardwareThreads = max(1, (int)thread::hardware_concurrency());
+    if (workerCount <= 0)
+    {
+        workerCount = hardwareThreads;
+    }
+
+    // the hardware threads are divided between the workers for the steps that run threads of their own, and with
+    // several workers the captures are independent, so no worker carries the table plane of one capture over to the
+    // next; a single worker sees the captures in order and keeps tracking the plane
+    for (int w = 0; w < workerCount; w++)
+    {
+        myPipelines.push_back(unique_ptr<BoxPipeline>(new BoxPipeline));
+        myPipelines.back()->setThreadCount(max(1, hardwareThreads / workerCount));
+        if (workerCount > 1)
+        {
+            myPipelines.back()->setTrackPlane(false);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Get the number of workers
+ * @return number of worker threads, and of pipelines
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+int BatchProcessor::workerCount() const
+{
+    return (int)myPipelines.size();
+}
+
+/***********************************************************************************************************************
+ * @brief Get the pipeline of a worker, to configure it
+ * @param[in] worker worker index, from 0 to workerCount() - 1
+ * @return pipeline used by the worker
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+BoxPipeline &BatchProcessor::pipeline(int worker)
+{
+    return *myPipelines[worker];
+}
+
+/***********************************************************************************************************************
+ * @brief Measure the boxes of a batch of captures
+ * @param[in] fileNames PLY, PCD or PGM depth image files of the captures
+ * @param[out] results one result per capture, in the order of the file names
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BatchProcessor::process(const vector<string> &fileNames, vector<BatchResult> &results)
+{
+    results.resize(fileNames.size());
+    int threadCount = min((int)myPipelines.size(), (int)fileNames.size());
+    if (threadCount <= 1)
+    {
+        for (size_t f = 0; f < fileNames.size(); f++)
+        {
+            processOne(*myPipelines[0], fileNames[f], results[f]);
+        }
+        return;
+    }
+
+    // every worker takes the next capture until none are left, the results go to the slots of their captures
+    atomic<size_t> nextCapture(0);
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.push_back(thread([&, t]()
+        {
+            size_t f;
+            while ((f = nextCapture++) < fileNames.size())
+            {
+                processOne(*myPipelines[t], fileNames[f], results[f]);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Measure the boxes of one capture and copy them out of the pipeline
+ * @param[in] pipeline pipeline of the worker
+ * @param[in] fileName file of the capture
+ * @param[out] result boxes of the capture
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BatchProcessor::processOne(BoxPipeline &pipeline, const string &fileName, BatchResult &result)
+{
+    result.fileName = fileName;
+    result.ok = pipeline.process(fileName);
+    result.pointCount = result.ok ? pipeline.cloud()->points.size() : 0;
+    result.plane = pipeline.plane();
+    result.times = pipeline.times();
+    result.boxes.clear();
+    result.boxPointCounts.clear();
+    if (!result.ok)
+    {
+        return;
+    }
+
+    result.boxes = pipeline.boxes();
+    const vector<pcl::PointIndices> &clusters = pipeline.clusters();
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        result.boxPointCounts.push_back((int)clusters[c].indices.size());
+    }
+}
@@ -0,0 +1,93 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file BatchProcessor.h
+ * @brief Header file for the BatchProcessor class
+ *
+ * This class measures the boxes of many captures concurrently, each worker thread with a pipeline of its own
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include "BoxPipeline.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <pcl/ModelCoefficients.h>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @brief Boxes of one capture, copied out of the pipeline that measured it
+ **********************************************************************************************************************/
+struct BatchResult
+{
+    string fileName;
+    bool ok;
+    size_t pointCount;
+    pcl::ModelCoefficients plane;
+    vector<BoxDimensions> boxes;
+    vector<int> boxPointCounts;
+    PipelineTimes times;
+};
+
+/*******************************************************************************************************************//**
+ * @class BatchProcessor
+ *
+ * @brief Box dimensioning of a batch of captures on several threads
+ *
+ * Every worker owns a BoxPipeline, and with it the clouds, index lists, search structures and plane estimate that the
+ * pipeline reuses from one capture to the next, so the workers share nothing but the counter of the next capture to
+ * take. Each worker takes the next capture as soon as it is done with its last, which balances captures of different
+ * sizes, and writes its result to the slot of that capture, so the results come back in input order whatever order
+ * the captures finish in.
+ *
+ * The pipelines are configured through pipeline(), each the same way. They are set to divide the hardware threads
+ * between them for the plane search and grid clustering, so the workers do not oversubscribe the cores. With several
+ * workers they are also set not to track the table plane, so the result of a capture does not depend on which worker
+ * measured it or what that worker measured before; a single worker sees every capture in order and tracks the plane
+ * from one to the next, as a lone BoxPipeline does. With a single worker, or a single capture, the batch runs on the
+ * calling thread.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class BatchProcessor
+{
+private:
+
+    vector<unique_ptr<BoxPipeline> > myPipelines;
+
+    void processOne(BoxPipeline &pipeline, const string &fileName, BatchResult &result);
+
+public:
+
+    // constructors
+    BatchProcessor(int workerCount=0);
+
+    // configuration
+    int workerCount() const;
+    BoxPipeline &pipeline(int worker);
+
+    // processing
+    void process(const vector<string> &fileNames, vector<BatchResult> &results);
+};
+
+#endif // BATCHPROCESSOR_H
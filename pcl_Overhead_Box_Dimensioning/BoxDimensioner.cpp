@@ -0,0 +1,264 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file BoxDimensioner.cpp
+ * @brief Implementation of the BoxDimensioner class
+ *
+ * This class measures boxes standing on a plane with an oriented bounding box
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "BoxDimensioner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <Eigen/Geometry>
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Order 2D points by x, then by y
+ * @param[in] a first point
+ * @param[in] b second point
+ * @return true if the first point comes first
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+static bool compareLexicographic(const Eigen::Vector2f &a, const Eigen::Vector2f &b)
+{
+    return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+}
+
+/***********************************************************************************************************************
+ * @brief Z component of the cross product of (a - o) and (b - o)
+ * @param[in] o common origin
+ * @param[in] a first point
+ * @param[in] b second point
+ * @return positive if o, a, b turn counterclockwise
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+static float cross(const Eigen::Vector2f &o, const Eigen::Vector2f &a, const Eigen::Vector2f &b)
+{
+    return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+BoxDimensioner::BoxDimensioner() : myNormal(Eigen::Vector3f::Zero()), myAxisU(Eigen::Vector3f::Zero()), myAxisV(Eigen::Vector3f::Zero()), myOffset(0.0f)
+{
+}
+
+/***********************************************************************************************************************
+ * @brief Set the plane the boxes stand on
+ * @param[in] coefficients plane coefficients a, b, c, d of ax + by + cz + d = 0, as returned by segmentPlane
+ * @return true if the coefficients describe a plane
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool BoxDimensioner::setPlane(const pcl::ModelCoefficients &coefficients)
+{
+    if (coefficients.values.size() != 4)
+    {
+        return false;
+    }
+    return setPlane(Eigen::Vector4f(coefficients.values[0], coefficients.values[1], coefficients.values[2], coefficients.values[3]));
+}
+
+/***********************************************************************************************************************
+ * @brief Set the plane the boxes stand on
+ *
+ * The normal is oriented towards the sensor origin, which is where the boxes are seen from.
+ *
+ * @param[in] plane plane coefficients a, b, c, d of ax + by + cz + d = 0
+ * @return true if the coefficients describe a plane
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool BoxDimensioner::setPlane(const Eigen::Vector4f &plane)
+{
+    float norm = plane.head<3>().norm();
+    if (!(norm > 0.0f))
+    {
+        return false;
+    }
+
+    myNormal = plane.head<3>() / norm;
+    myOffset = plane[3] / norm;
+    if (myOffset < 0.0f)
+    {
+        myNormal = -myNormal;
+        myOffset = -myOffset;
+    }
+
+    // in-plane axes, with u, v and the normal forming a right handed frame
+    myAxisU = myNormal.unitOrthogonal();
+    myAxisV = myNormal.cross(myAxisU);
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Measure the oriented bounding box of a cluster
+ * @param[in] cloud point cloud holding the cluster
+ * @param[in] indices indices of the cluster points in the cloud
+ * @param[out] box dimensions, center and orientation of the box
+ * @return true if the box was measured, false without a plane or points
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool BoxDimensioner::measure(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const pcl::PointIndices &indices, BoxDimensions &box)
+{
+    if (indices.indices.empty() || myNormal.isZero())
+    {
+        return false;
+    }
+
+    // project the points onto the plane and find the top of the box
+    float height = 0.0f;
+    myProjected.resize(indices.indices.size());
+    for (size_t i = 0; i < indices.indices.size(); i++)
+    {
+        Eigen::Vector3f point = cloud.points[indices.indices[i]].getVector3fMap();
+        myProjected[i] = Eigen::Vector2f(myAxisU.dot(point), myAxisV.dot(point));
+        height = max(height, myNormal.dot(point) + myOffset);
+    }
+
+    buildHull();
+    Eigen::Vector2f center;
+    Eigen::Vector2f axis;
+    float length;
+    float width;
+    fitRectangle(center, axis, length, width);
+    if (length < width)
+    {
+        swap(length, width);
+        axis = Eigen::Vector2f(-axis[1], axis[0]);
+    }
+
+    box.normal = myNormal;
+    box.lengthAxis = myAxisU * axis[0] + myAxisV * axis[1];
+    box.widthAxis = myNormal.cross(box.lengthAxis);
+    box.center = myAxisU * center[0] + myAxisV * center[1] + myNormal * (0.5f * height - myOffset);
+    box.length = length;
+    box.width = width;
+    box.height = height;
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Replace the hull by the convex hull of the projected points
+ *
+ * Andrew's monotone chain, the hull is counterclockwise without collinear points or a repeated first point.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxDimensioner::buildHull()
+{
+    sort(myProjected.begin(), myProjected.end(), compareLexicographic);
+    myHull.resize(2 * myProjected.size());
+
+    size_t k = 0;
+    for (size_t i = 0; i < myProjected.size(); i++)
+    {
+        while (k >= 2 && cross(myHull[k - 2], myHull[k - 1], myProjected[i]) <= 0.0f)
+        {
+            k--;
+        }
+        myHull[k++] = myProjected[i];
+    }
+    for (size_t i = myProjected.size() - 1, lowerSize = k + 1; i > 0; i--)
+    {
+        while (k >= lowerSize && cross(myHull[k - 2], myHull[k - 1], myProjected[i - 1]) <= 0.0f)
+        {
+            k--;
+        }
+        myHull[k++] = myProjected[i - 1];
+    }
+    myHull.resize(k > 1 ? k - 1 : k);
+}
+
+/***********************************************************************************************************************
+ * @brief Find the minimum area rectangle around the hull with rotating calipers
+ *
+ * The best rectangle has a side on a hull edge. For each edge in turn, the farthest hull points along the edge, across
+ * it and against it only move forward around the hull, so all edges are tried in linear time.
+ *
+ * @param[out] center rectangle center
+ * @param[out] axis unit direction of the side measured by length
+ * @param[out] length rectangle side along the axis
+ * @param[out] width rectangle side across the axis
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxDimensioner::fitRectangle(Eigen::Vector2f &center, Eigen::Vector2f &axis, float &length, float &width) const
+{
+    const size_t n = myHull.size();
+    if (n < 3)
+    {
+        // a single point or a segment
+        Eigen::Vector2f side = myHull.back() - myHull.front();
+        center = 0.5f * (myHull.front() + myHull.back());
+        length = side.norm();
+        axis = length > 0.0f ? Eigen::Vector2f(side / length) : Eigen::Vector2f(1.0f, 0.0f);
+        width = 0.0f;
+        return;
+    }
+
+    float bestArea = numeric_limits<float>::max();
+    size_t right = 1;
+    size_t top = 0;
+    size_t left = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const Eigen::Vector2f &origin = myHull[i];
+        Eigen::Vector2f edge = (myHull[(i + 1) % n] - origin).normalized();
+        Eigen::Vector2f inward(-edge[1], edge[0]);
+
+        // advance the calipers, they start where the previous one stopped on the first edge
+        while (edge.dot(myHull[(right + 1) % n] - myHull[right]) > 0.0f)
+        {
+            right = (right + 1) % n;
+        }
+        if (i == 0)
+        {
+            top = right;
+        }
+        while (inward.dot(myHull[(top + 1) % n] - myHull[top]) > 0.0f)
+        {
+            top = (top + 1) % n;
+        }
+        if (i == 0)
+        {
+            left = top;
+        }
+        while (edge.dot(myHull[(left + 1) % n] - myHull[left]) < 0.0f)
+        {
+            left = (left + 1) % n;
+        }
+
+        float maxAlong = edge.dot(myHull[right] - origin);
+        float minAlong = edge.dot(myHull[left] - origin);
+        float across = inward.dot(myHull[top] - origin);
+        float area = (maxAlong - minAlong) * across;
+        if (area < bestArea)
+        {
+            bestArea = area;
+            center = origin + edge * (0.5f * (maxAlong + minAlong)) + inward * (0.5f * across);
+            axis = edge;
+            length = maxAlong - minAlong;
+            width = across;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file BoxDimensioner.h
+ * @brief Header file for the BoxDimensioner class
+ *
+ * This class measures boxes standing on a plane with an oriented bounding box
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef BOXDIMENSIONER_H
+#define BOXDIMENSIONER_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+#include <Eigen/Core>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @brief Oriented bounding box of a box standing on the plane
+ *
+ * The center is the middle of the box, halfway between the plane and the top. The axes form a right handed frame,
+ * with the length axis along the longer side of the footprint and the normal pointing away from the plane.
+ **********************************************************************************************************************/
+struct BoxDimensions
+{
+    Eigen::Vector3f center;
+    Eigen::Vector3f lengthAxis;
+    Eigen::Vector3f widthAxis;
+    Eigen::Vector3f normal;
+    float length;
+    float width;
+    float height;
+};
+
+/*******************************************************************************************************************//**
+ * @class BoxDimensioner
+ *
+ * @brief Oriented box measurement relative to the supporting plane
+ *
+ * The points of a cluster are projected onto the plane found by segmentPlane, and the minimum area rectangle around
+ * their 2D convex hull gives the length and width of the box, whatever its rotation on the plane. The hull is built
+ * with the monotone chain algorithm in O(n log n) and the rectangle is found with rotating calipers in linear time over
+ * the hull. The height is the largest distance of a point to the plane, so it does not depend on the camera tilt.
+ *
+ * Clusters are read through their indices into the cloud and never copied. The 2D projections and the hull live in
+ * buffers that are reused from one cluster to the next.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class BoxDimensioner
+{
+private:
+
+    Eigen::Vector3f myNormal;
+    Eigen::Vector3f myAxisU;
+    Eigen::Vector3f myAxisV;
+    float myOffset;
+    vector<Eigen::Vector2f> myProjected;
+    vector<Eigen::Vector2f> myHull;
+
+    void buildHull();
+    void fitRectangle(Eigen::Vector2f &center, Eigen::Vector2f &axis, float &length, float &width) const;
+
+public:
+
+    // constructors
+    BoxDimensioner();
+
+    // supporting plane
+    bool setPlane(const pcl::ModelCoefficients &coefficients);
+    bool setPlane(const Eigen::Vector4f &plane);
+
+    // measurement
+    bool measure(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const pcl::PointIndices &indices, BoxDimensions &box);
+};
+
+#endif // BOXDIMENSIONER_H
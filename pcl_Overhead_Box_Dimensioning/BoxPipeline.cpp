@@ -0,0 +1,465 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file BoxPipeline.cpp
+ * @brief Implementation of the BoxPipeline class
+ *
+ * This class runs the box dimensioning steps on a sequence of captures, reusing its state from frame to frame
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "BoxPipeline.h"
+
+#include <algorithm>
+#include <pcl/common/time.h>
+#include <pcl/console/print.h>
+
+#define CLUSTER_TOLERANCE 0.02
+#define MIN_CLUSTER_SIZE 5000
+#define MAX_CLUSTER_SIZE 100000
+#define VOXEL_LEAF_RATIO 0.5
+#define PLANE_DISTANCE_THRESHOLD 0.02
+#define PLANE_MAX_ITERATIONS 5000
+
+// color of the table, and colors of the boxes, the first box green and the second red as before, repeated for more boxes
+static const unsigned char TABLE_COLOR[3] = {0, 0, 255};
+static const unsigned char BOX_COLORS[][3] = {{0, 255, 0}, {255, 0, 0}, {255, 255, 0}, {255, 0, 255}, {0, 255, 255}, {255, 128, 0}};
+static const size_t BOX_COLOR_COUNT = sizeof(BOX_COLORS) / sizeof(BOX_COLORS[0]);
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+BoxPipeline::BoxPipeline() :
+    myClusterTolerance(CLUSTER_TOLERANCE), myMinClusterSize(MIN_CLUSTER_SIZE), myMaxClusterSize(MAX_CLUSTER_SIZE),
+    myClusteringBackend(CLUSTERING_KDTREE), myTrackPlane(true), myHasPlaneHint(false),
+    myPlaneHint(Eigen::Vector4f::Zero()), myDownsampler(CLUSTER_TOLERANCE * VOXEL_LEAF_RATIO),
+    myPlaneEstimator(PLANE_DISTANCE_THRESHOLD, PLANE_MAX_ITERATIONS),
+    myTree(new pcl::search::KdTree<pcl::PointXYZRGBA>), myVoxels(new pcl::PointCloud<pcl::PointXYZRGBA>),
+    myVoxelInliers(new pcl::PointIndices), myPointWeight(1.0), myCloud(new pcl::PointCloud<pcl::PointXYZRGBA>),
+    myObjects(new pcl::PointCloud<pcl::PointXYZRGBA>), myInliers(new pcl::PointIndices), myPlane(new pcl::ModelCoefficients)
+{
+    myTimes = PipelineTimes();
+    myExtract.setNegative(true);
+    myClusterExtraction.setSearchMethod(myTree);
+}
+
+/***********************************************************************************************************************
+ * @brief Set the reader used to load the captures
+ * @param[in] reader reader with the region of interest and subsampling to apply while loading
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setReader(const CloudReader &reader)
+{
+    myReader = reader;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the voxel size used for plane segmentation and clustering
+ * @param[in] leafSize voxel edge length in meters, 0 to work on every point
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setVoxelLeafSize(float leafSize)
+{
+    myDownsampler.setLeafSize(leafSize);
+}
+
+/***********************************************************************************************************************
+ * @brief Set the distance between two clusters
+ * @param[in] tolerance largest gap in meters between points of the same box
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setClusterTolerance(float tolerance)
+{
+    myClusterTolerance = tolerance;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the range of box sizes
+ * @param[in] minSize smallest number of full resolution points of a box
+ * @param[in] maxSize largest number of full resolution points of a box
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setClusterSizeRange(int minSize, int maxSize)
+{
+    myMinClusterSize = minSize;
+    myMaxClusterSize = maxSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Select the clustering implementation
+ * @param[in] backend CLUSTERING_KDTREE for pcl::EuclideanClusterExtraction, CLUSTERING_GRID for GridClustering
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setClusteringBackend(ClusteringBackend backend)
+{
+    myClusteringBackend = backend;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the table plane to try on the first frame, or on every frame if the plane is not tracked
+ * @param[in] plane plane coefficients a, b, c, d of ax + by + cz + d = 0
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setPlaneHint(const Eigen::Vector4f &plane)
+{
+    myPlaneHint = plane;
+    myHasPlaneHint = true;
+    myPlaneEstimator.setHint(plane);
+}
+
+/***********************************************************************************************************************
+ * @brief Choose whether the table plane of each frame is tried first on the next
+ *
+ * Tracking suits a stream from one camera. Without it every capture is processed as if it were the first, with only
+ * the plane hint set by setPlaneHint(), so the results of a capture do not depend on the captures before it.
+ *
+ * @param[in] trackPlane true to start from the plane of the previous frame, the default
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setTrackPlane(bool trackPlane)
+{
+    myTrackPlane = trackPlane;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the number of threads of the plane search and grid clustering
+ * @param[in] threadCount number of threads, 0 for one per hardware thread
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::setThreadCount(int threadCount)
+{
+    myPlaneEstimator.setThreadCount(threadCount);
+    myGridClustering.setThreadCount(threadCount);
+}
+
+/***********************************************************************************************************************
+ * @brief Load a capture and measure the boxes on the table
+ * @param[in] fileName PLY, PCD or PGM depth image file of the capture
+ * @return true if the capture was read and a table plane found
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool BoxPipeline::process(const string &fileName)
+{
+    pcl::StopWatch watch;
+    myTimes = PipelineTimes();
+    myClusters.clear();
+    myBoxes.clear();
+
+    size_t candidates = 0;
+    if (!myReader.read(fileName, *myCloud, &candidates))
+    {
+        return false;
+    }
+    myTimes.load = watch.getTime();
+
+    // full resolution points each loaded point stands for when the reader subsamples
+    myPointWeight = 1.0;
+    if (myReader.leafSize() > 0.0f && !myCloud->points.empty())
+    {
+        myPointWeight = max(1.0, (double)candidates / myCloud->points.size());
+    }
+
+    bool found = processCloud();
+    myTimes.total = watch.getTime();
+    if (!found)
+    {
+        PCL_WARN("No table plane found in %s\n", fileName.c_str());
+    }
+    return found;
+}
+
+/***********************************************************************************************************************
+ * @brief Segment, cluster and measure the loaded cloud
+ * @return true if a table plane was found
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool BoxPipeline::processCloud()
+{
+    pcl::StopWatch watch;
+
+    // downsample the cloud for the plane search, the voxels are smaller than the cluster tolerance
+    myDownsampler.downsample(*myCloud, *myVoxels);
+    myTimes.downsample = watch.getTime();
+
+    // segment the table plane, the plane of the previous frame is tried first unless the plane is not tracked
+    watch.reset();
+    if (!myTrackPlane && myHasPlaneHint)
+    {
+        myPlaneEstimator.setHint(myPlaneHint);
+    }
+    else if (!myTrackPlane)
+    {
+        myPlaneEstimator.clearHint();
+    }
+    if (!myPlaneEstimator.estimate(*myVoxels, *myVoxelInliers, *myPlane))
+    {
+        myInliers->indices.clear();
+        myObjects->points.clear();
+        return false;
+    }
+    myDownsampler.expand(*myVoxelInliers, *myInliers);
+    myTimes.plane = watch.getTime();
+
+    // remove the table, and downsample the remaining objects for clustering unless the cloud keeps its pixel grid
+    watch.reset();
+    myExtract.setInputCloud(myCloud);
+    myExtract.setIndices(myInliers);
+    myExtract.filter(*myObjects);
+    bool organized = myCloud->height > 1 && myCloud->points.size() == (size_t)myCloud->width * myCloud->height;
+    if (!organized)
+    {
+        myDownsampler.downsample(*myObjects, *myVoxels);
+    }
+    myTimes.extract = watch.getTime();
+
+    if (organized)
+    {
+        watch.reset();
+        clusterOrganized();
+        myTimes.clustering = watch.getTime();
+    }
+    else
+    {
+        // cluster the voxels, the cluster sizes are checked on the full resolution points
+        myVoxelClusters.clear();
+        if (myClusteringBackend == CLUSTERING_GRID)
+        {
+            watch.reset();
+            myGridClustering.setClusterTolerance(myClusterTolerance);
+            myGridClustering.extract(*myVoxels, myVoxelClusters);
+        }
+        else
+        {
+            watch.reset();
+            myTree->setInputCloud(myVoxels);
+            myTimes.tree = watch.getTime();
+
+            watch.reset();
+            myClusterExtraction.setClusterTolerance(myClusterTolerance);
+            myClusterExtraction.setMinClusterSize(1);
+            myClusterExtraction.setMaxClusterSize(max((int)myVoxels->points.size(), 1));
+            myClusterExtraction.setInputCloud(myVoxels);
+            myClusterExtraction.extract(myVoxelClusters);
+        }
+
+        // map the clusters back to the loaded points, keeping the largest clusters first, with the size limits scaled
+        // to the points of a subsampled capture
+        myDownsampler.expand(myVoxelClusters, myPointClusters);
+        keepClusters(myPointClusters, myMinClusterSize / myPointWeight, myMaxClusterSize / myPointWeight, myClusters);
+        myTimes.clustering = watch.getTime();
+    }
+
+    // measure the boxes relative to the table plane
+    watch.reset();
+    myDimensioner.setPlane(*myPlane);
+    myBoxes.resize(myClusters.size());
+    for (size_t c = 0; c < myClusters.size(); c++)
+    {
+        myDimensioner.measure(*myObjects, myClusters[c], myBoxes[c]);
+    }
+    myTimes.measurement = watch.getTime();
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Cluster the objects of an organized capture over the pixel grid
+ *
+ * The table pixels are masked out and the clusters found on the full resolution capture, then their indices are
+ * shifted to the objects cloud, which holds every point of the capture except the table, in the same order.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::clusterOrganized()
+{
+    const size_t pointCount = myCloud->points.size();
+    const vector<int> &table = myInliers->indices;
+    myTableMask.assign(pointCount, 0);
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        myTableMask[table[i]] = 1;
+    }
+
+    myOrganizedClustering.setClusterTolerance(myClusterTolerance);
+    myOrganizedClustering.setMinClusterSize(myMinClusterSize);
+    myOrganizedClustering.setMaxClusterSize(myMaxClusterSize);
+    myOrganizedClustering.extract(*myCloud, myTableMask, myClusters);
+
+    // index of every capture point in the objects cloud, the number of table points before it being skipped
+    myObjectOfPoint.resize(pointCount);
+    int objectIndex = 0;
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        myObjectOfPoint[i] = objectIndex;
+        objectIndex += myTableMask[i] ? 0 : 1;
+    }
+    for (size_t c = 0; c < myClusters.size(); c++)
+    {
+        vector<int> &indices = myClusters[c].indices;
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            indices[i] = myObjectOfPoint[indices[i]];
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Get the last capture
+ * @return full resolution cloud as loaded
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &BoxPipeline::cloud() const
+{
+    return myCloud;
+}
+
+/***********************************************************************************************************************
+ * @brief Get the objects of the last capture
+ * @return full resolution cloud without the table plane, the clusters index into it
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &BoxPipeline::objects() const
+{
+    return myObjects;
+}
+
+/***********************************************************************************************************************
+ * @brief Get the table points of the last capture
+ * @return indices into the full resolution cloud
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const pcl::PointIndices &BoxPipeline::planeInliers() const
+{
+    return *myInliers;
+}
+
+/***********************************************************************************************************************
+ * @brief Get the table plane of the last capture
+ * @return plane coefficients a, b, c, d of ax + by + cz + d = 0
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const pcl::ModelCoefficients &BoxPipeline::plane() const
+{
+    return *myPlane;
+}
+
+/***********************************************************************************************************************
+ * @brief Check how the table plane of the last capture was found
+ * @return true if the plane of the previous frame was reused, false if RANSAC ran
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool BoxPipeline::usedPlaneHint() const
+{
+    return myPlaneEstimator.usedHint();
+}
+
+/***********************************************************************************************************************
+ * @brief Get the boxes of the last capture
+ * @return indices into the objects cloud of each box, the largest box first
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const vector<pcl::PointIndices> &BoxPipeline::clusters() const
+{
+    return myClusters;
+}
+
+/***********************************************************************************************************************
+ * @brief Get the dimensions of the boxes of the last capture
+ * @return one oriented box per cluster, in the same order
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const vector<BoxDimensions> &BoxPipeline::boxes() const
+{
+    return myBoxes;
+}
+
+/***********************************************************************************************************************
+ * @brief Get the step times of the last capture
+ * @return times in milliseconds
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+const PipelineTimes &BoxPipeline::times() const
+{
+    return myTimes;
+}
+
+/***********************************************************************************************************************
+ * @brief Write the last capture with the table and the boxes colored
+ *
+ * The table is blue, each box gets a color of its own and every other point keeps its color. The output is sized
+ * once and each point written once, walking the capture and the sorted table indices together to find the objects
+ * cloud index of every point that is not on the table.
+ *
+ * @param[out] output colored copy of the capture
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void BoxPipeline::colorize(pcl::PointCloud<pcl::PointXYZRGBA> &output)
+{
+    // box of every objects cloud point, -1 for none
+    myClusterOfObject.assign(myObjects->points.size(), -1);
+    for (size_t c = 0; c < myClusters.size(); c++)
+    {
+        const vector<int> &indices = myClusters[c].indices;
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            myClusterOfObject[indices[i]] = (int)c;
+        }
+    }
+
+    const vector<int> &table = myInliers->indices;
+    const size_t pointCount = myCloud->points.size();
+    output.points.resize(pointCount);
+    output.width = myCloud->width;
+    output.height = myCloud->height;
+    output.is_dense = myCloud->is_dense;
+    output.sensor_origin_ = myCloud->sensor_origin_;
+    output.sensor_orientation_ = myCloud->sensor_orientation_;
+
+    size_t tableIndex = 0;
+    size_t objectIndex = 0;
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        pcl::PointXYZRGBA &point = output.points[i];
+        point = myCloud->points[i];
+
+        const unsigned char *color = NULL;
+        if (tableIndex < table.size() && table[tableIndex] == (int)i)
+        {
+            color = TABLE_COLOR;
+            tableIndex++;
+        }
+        else
+        {
+            int cluster = objectIndex < myClusterOfObject.size() ? myClusterOfObject[objectIndex] : -1;
+            if (cluster >= 0)
+            {
+                color = BOX_COLORS[cluster % BOX_COLOR_COUNT];
+            }
+            objectIndex++;
+        }
+
+        if (color != NULL)
+        {
+            point.r = color[0];
+            point.g = color[1];
+            point.b = color[2];
+        }
+    }
+}
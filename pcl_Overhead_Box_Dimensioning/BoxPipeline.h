@@ -0,0 +1,170 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file BoxPipeline.h
+ * @brief Header file for the BoxPipeline class
+ *
+ * This class runs the box dimensioning steps on a sequence of captures, reusing its state from frame to frame
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef BOXPIPELINE_H
+#define BOXPIPELINE_H
+
+#include "BoxDimensioner.h"
+#include "CloudReader.h"
+#include "GridClustering.h"
+#include "OrganizedClustering.h"
+#include "PlaneEstimator.h"
+#include "VoxelDownsampler.h"
+
+#include <string>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/filters/extract_indices.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/extract_clusters.h>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @brief Euclidean clustering implementations, with identical results
+ **********************************************************************************************************************/
+enum ClusteringBackend
+{
+    CLUSTERING_KDTREE,
+    CLUSTERING_GRID
+};
+
+/*******************************************************************************************************************//**
+ * @brief Time spent in each step of the last frame, in milliseconds
+ **********************************************************************************************************************/
+struct PipelineTimes
+{
+    double load;
+    double downsample;
+    double plane;
+    double extract;
+    double tree;
+    double clustering;
+    double measurement;
+    double total;
+};
+
+/*******************************************************************************************************************//**
+ * @class BoxPipeline
+ *
+ * @brief Box dimensioning of one capture after another
+ *
+ * Each frame is loaded, downsampled, split into the table plane and the objects on it, clustered and measured. The
+ * clouds, index lists, KdTree, extraction objects and the plane estimate belong to the pipeline and are kept between
+ * frames, so after the first frame no buffer is reallocated unless a capture is larger than any before, and the table
+ * plane of the previous frame is tried before RANSAC.
+ *
+ * Organized captures, which keep the pixel grid of the depth image, skip the second downsampling and the KdTree: the
+ * objects are clustered by OrganizedClustering over pixel adjacency, in one linear pass over the full resolution
+ * capture.
+ *
+ * The box size limits count full resolution points. When the reader subsamples the capture, every loaded point stands
+ * for the average number of points of the region of interest it replaced, and the limits are scaled by that ratio.
+ *
+ * The results of the last frame stay available until the next one is processed. Boxes are index lists into the objects
+ * cloud rather than clouds of their own, and colorize() writes the whole scene, with the table and the boxes colored,
+ * in a single pass over the capture.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class BoxPipeline
+{
+private:
+
+    // configuration
+    CloudReader myReader;
+    float myClusterTolerance;
+    int myMinClusterSize;
+    int myMaxClusterSize;
+    ClusteringBackend myClusteringBackend;
+    bool myTrackPlane;
+    bool myHasPlaneHint;
+    Eigen::Vector4f myPlaneHint;
+
+    // processing state reused between frames
+    VoxelDownsampler myDownsampler;
+    PlaneEstimator myPlaneEstimator;
+    BoxDimensioner myDimensioner;
+    pcl::ExtractIndices<pcl::PointXYZRGBA> myExtract;
+    pcl::search::KdTree<pcl::PointXYZRGBA>::Ptr myTree;
+    pcl::EuclideanClusterExtraction<pcl::PointXYZRGBA> myClusterExtraction;
+    GridClustering myGridClustering;
+    OrganizedClustering myOrganizedClustering;
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr myVoxels;
+    pcl::PointIndices::Ptr myVoxelInliers;
+    vector<pcl::PointIndices> myVoxelClusters;
+    vector<pcl::PointIndices> myPointClusters;
+    vector<int> myClusterOfObject;
+    vector<unsigned char> myTableMask;
+    vector<int> myObjectOfPoint;
+    double myPointWeight;
+
+    // results of the last frame
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr myCloud;
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr myObjects;
+    pcl::PointIndices::Ptr myInliers;
+    pcl::ModelCoefficients::Ptr myPlane;
+    vector<pcl::PointIndices> myClusters;
+    vector<BoxDimensions> myBoxes;
+    PipelineTimes myTimes;
+
+    bool processCloud();
+    void clusterOrganized();
+
+public:
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // constructors
+    BoxPipeline();
+
+    // configuration
+    void setReader(const CloudReader &reader);
+    void setVoxelLeafSize(float leafSize);
+    void setClusterTolerance(float tolerance);
+    void setClusterSizeRange(int minSize, int maxSize);
+    void setClusteringBackend(ClusteringBackend backend);
+    void setPlaneHint(const Eigen::Vector4f &plane);
+    void setThreadCount(int threadCount);
+    void setTrackPlane(bool trackPlane);
+
+    // processing
+    bool process(const string &fileName);
+
+    // results of the last frame
+    const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud() const;
+    const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &objects() const;
+    const pcl::PointIndices &planeInliers() const;
+    const pcl::ModelCoefficients &plane() const;
+    bool usedPlaneHint() const;
+    const vector<pcl::PointIndices> &clusters() const;
+    const vector<BoxDimensions> &boxes() const;
+    const PipelineTimes &times() const;
+    void colorize(pcl::PointCloud<pcl::PointXYZRGBA> &output);
+};
+
+#endif // BOXPIPELINE_H
@@ -0,0 +1,270 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file BoxService.cpp
+ * @brief Headless box dimensioning that prints the boxes of each capture as JSON
+ *
+ * The captures named on the command line, or read one path per line from the standard input when the only file name
+ * is -, are processed and each produces one line of JSON on the standard output, in input order. With one thread each
+ * line is written as soon as its capture is measured; with more, the captures are measured concurrently by a
+ * BatchProcessor, the standard input being read to its end first, and the throughput is reported on the standard
+ * error. Diagnostics go to the standard error, so the output can be piped straight into another program. This
+ * program links the processing library only, without pcl_visualization or VTK, and so runs on machines without a
+ * display.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "BatchProcessor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <pcl/common/time.h>
+#include <sstream>
+
+#define NUM_COMMAND_ARGS 1
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Quote a string for JSON
+ * @param[in] text string to quote
+ * @return string in double quotes, with quotes, backslashes and control characters escaped
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+string jsonString(const string &text)
+{
+    ostringstream quoted;
+    quoted << '"';
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\')
+        {
+            quoted << '\\' << c;
+        }
+        else if (c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted << escaped;
+        }
+        else
+        {
+            quoted << c;
+        }
+    }
+    quoted << '"';
+    return quoted.str();
+}
+
+/***********************************************************************************************************************
+ * @brief Write a vector as a JSON array
+ * @param[in,out] json output stream
+ * @param[in] v vector to write
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void writeVector(ostream &json, const Eigen::Vector3f &v)
+{
+    json << "[" << v[0] << "," << v[1] << "," << v[2] << "]";
+}
+
+/***********************************************************************************************************************
+ * @brief Print the boxes of one capture as one line of JSON
+ *
+ * A capture without a table plane, or that cannot be read, is reported with "ok": false and no boxes.
+ *
+ * @param[in] result boxes of the capture
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void printResult(const BatchResult &result)
+{
+    ostringstream json;
+    json << "{\"file\":" << jsonString(result.fileName) << ",\"ok\":" << (result.ok ? "true" : "false");
+    if (result.ok)
+    {
+        const vector<float> &plane = result.plane.values;
+        json << ",\"points\":" << result.pointCount << ",\"plane\":[" << plane[0] << "," << plane[1] << "," << plane[2]
+             << "," << plane[3] << "]";
+    }
+
+    json << ",\"boxes\":[";
+    const vector<BoxDimensions> &boxes = result.boxes;
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+        json << (b > 0 ? "," : "") << "{\"length\":" << boxes[b].length << ",\"width\":" << boxes[b].width
+             << ",\"height\":" << boxes[b].height << ",\"center\":";
+        writeVector(json, boxes[b].center);
+        json << ",\"length_axis\":";
+        writeVector(json, boxes[b].lengthAxis);
+        json << ",\"width_axis\":";
+        writeVector(json, boxes[b].widthAxis);
+        json << ",\"points\":" << result.boxPointCounts[b] << "}";
+    }
+    json << "],\"time_ms\":" << result.times.total << "}";
+
+    cout << json.str() << endl;
+}
+
+int main(int argc, char **argv)
+{
+    // validate and parse the command line arguments
+    if (argc < NUM_COMMAND_ARGS + 1)
+    {
+        printf("USAGE: %s <file_name|-> [<file_name> ...] [--clustering kdtree|grid] [--max-depth <meters>] [--leaf <meters>] [--voxel <meters>] [--plane <a> <b> <c> <d>] [--crop <min_x> <min_y> <min_z> <max_x> <max_y> <max_z>] [--intrinsics <fx> <fy> <cx> <cy> <depth_scale>] [--threads <count>]\n", argv[0]);
+        return 0;
+    }
+
+    vector<string> fileNames;
+    CloudReader reader;
+    ClusteringBackend backend = CLUSTERING_KDTREE;
+    float voxelLeafSize = -1.0f;
+    bool hasPlaneHint = false;
+    Eigen::Vector4f planeHint;
+    int threadCount = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option == "-" || option.compare(0, 2, "--") != 0)
+        {
+            fileNames.push_back(option);
+        }
+        else if (option == "--clustering" && i + 1 < argc)
+        {
+            string name(argv[++i]);
+            if (name != "kdtree" && name != "grid")
+            {
+                cerr << "unknown clustering backend: " << name << endl;
+                return 1;
+            }
+            backend = name == "grid" ? CLUSTERING_GRID : CLUSTERING_KDTREE;
+        }
+        else if (option == "--max-depth" && i + 1 < argc)
+        {
+            reader.setDepthRange(0.0f, (float)atof(argv[++i]));
+        }
+        else if (option == "--leaf" && i + 1 < argc)
+        {
+            reader.setLeafSize((float)atof(argv[++i]));
+        }
+        else if (option == "--voxel" && i + 1 < argc)
+        {
+            voxelLeafSize = (float)atof(argv[++i]);
+        }
+        else if (option == "--plane" && i + 4 < argc)
+        {
+            planeHint = Eigen::Vector4f((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]), (float)atof(argv[i + 4]));
+            hasPlaneHint = true;
+            i += 4;
+        }
+        else if (option == "--crop" && i + 6 < argc)
+        {
+            Eigen::Vector3f minPoint((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]));
+            Eigen::Vector3f maxPoint((float)atof(argv[i + 4]), (float)atof(argv[i + 5]), (float)atof(argv[i + 6]));
+            reader.setCropBox(minPoint, maxPoint);
+            i += 6;
+        }
+        else if (option == "--intrinsics" && i + 5 < argc)
+        {
+            reader.setIntrinsics((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]), (float)atof(argv[i + 4]), (float)atof(argv[i + 5]));
+            i += 5;
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else
+        {
+            cerr << "unknown option: " << option << endl;
+            return 1;
+        }
+    }
+
+    // every worker pipeline is configured the same way
+    BatchProcessor batch(threadCount);
+    for (int w = 0; w < batch.workerCount(); w++)
+    {
+        BoxPipeline &pipeline = batch.pipeline(w);
+        pipeline.setReader(reader);
+        pipeline.setClusteringBackend(backend);
+        if (voxelLeafSize >= 0.0f)
+        {
+            pipeline.setVoxelLeafSize(voxelLeafSize);
+        }
+        if (hasPlaneHint)
+        {
+            pipeline.setPlaneHint(planeHint);
+        }
+    }
+
+    // the standard input stands in for a job queue, one capture path per line until it is closed
+    bool allProcessed = true;
+    vector<BatchResult> results;
+    bool streaming = fileNames.size() == 1 && fileNames[0] == "-";
+    if (streaming)
+    {
+        fileNames.clear();
+        string line;
+        while (getline(cin, line))
+        {
+            if (line.empty())
+            {
+                continue;
+            }
+            if (batch.workerCount() > 1)
+            {
+                fileNames.push_back(line);
+                continue;
+            }
+            batch.process(vector<string>(1, line), results);
+            printResult(results[0]);
+            allProcessed &= results[0].ok;
+        }
+    }
+
+    // with one worker each capture is printed as soon as it is measured
+    pcl::StopWatch watch;
+    if (batch.workerCount() == 1)
+    {
+        for (size_t f = 0; f < fileNames.size(); f++)
+        {
+            batch.process(vector<string>(1, fileNames[f]), results);
+            printResult(results[0]);
+            allProcessed &= results[0].ok;
+        }
+    }
+    else if (!fileNames.empty())
+    {
+        batch.process(fileNames, results);
+        for (size_t f = 0; f < results.size(); f++)
+        {
+            printResult(results[f]);
+            allProcessed &= results[f].ok;
+        }
+    }
+    if (!fileNames.empty())
+    {
+        double elapsed = watch.getTime();
+        cerr << fileNames.size() << " captures in " << elapsed << " ms on " << batch.workerCount() << " threads, "
+             << fileNames.size() * 1000.0 / max(elapsed, 1e-3) << " captures/s" << endl;
+    }
+
+    // a non-zero exit code when a capture could not be read or had no table
+    return allProcessed ? 0 : 1;
+}
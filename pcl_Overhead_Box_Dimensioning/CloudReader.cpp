@@ -0,0 +1,717 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file CloudReader.cpp
+ * @brief Implementation of the CloudReader class
+ *
+ * This class reads PLY and PCD point clouds, cropping and subsampling them while they are decoded
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "CloudReader.h"
+#include "VoxelDownsampler.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+
+using namespace std;
+
+// scalar types of PLY properties
+enum PlyType {PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64};
+
+/***********************************************************************************************************************
+ * @brief A property of a PLY element, at a fixed offset within the element
+ **********************************************************************************************************************/
+struct PlyProperty
+{
+    string name;
+    PlyType type;
+    size_t offset;
+};
+
+/***********************************************************************************************************************
+ * @brief A PLY element, such as the vertices
+ **********************************************************************************************************************/
+struct PlyElement
+{
+    string name;
+    size_t count;
+    size_t stride;
+    bool hasList;
+    vector<PlyProperty> properties;
+};
+
+/***********************************************************************************************************************
+ * @brief Parse a PLY scalar type name
+ * @param[in] name type name, in either the old (uchar) or the sized (uint8) form
+ * @param[out] type parsed type
+ * @param[out] size size of the type in bytes
+ * @return false if the name is not a PLY type
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+static bool parsePlyType(const string &name, PlyType &type, size_t &size)
+{
+    static const struct { const char *name; PlyType type; size_t size; } types[] =
+    {
+        {"char", PLY_INT8, 1}, {"int8", PLY_INT8, 1}, {"uchar", PLY_UINT8, 1}, {"uint8", PLY_UINT8, 1},
+        {"short", PLY_INT16, 2}, {"int16", PLY_INT16, 2}, {"ushort", PLY_UINT16, 2}, {"uint16", PLY_UINT16, 2},
+        {"int", PLY_INT32, 4}, {"int32", PLY_INT32, 4}, {"uint", PLY_UINT32, 4}, {"uint32", PLY_UINT32, 4},
+        {"float", PLY_FLOAT32, 4}, {"float32", PLY_FLOAT32, 4}, {"double", PLY_FLOAT64, 8}, {"float64", PLY_FLOAT64, 8}
+    };
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        if (name == types[i].name)
+        {
+            type = types[i].type;
+            size = types[i].size;
+            return true;
+        }
+    }
+    return false;
+}
+
+/***********************************************************************************************************************
+ * @brief Read a little endian PLY scalar
+ * @param[in] data address of the value
+ * @param[in] type type of the value
+ * @return the value
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+static double readPlyValue(const unsigned char *data, PlyType type)
+{
+    switch (type)
+    {
+    case PLY_INT8: { int8_t v; memcpy(&v, data, sizeof(v)); return v; }
+    case PLY_UINT8: return data[0];
+    case PLY_INT16: { int16_t v; memcpy(&v, data, sizeof(v)); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, data, sizeof(v)); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, data, sizeof(v)); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, data, sizeof(v)); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, data, sizeof(v)); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, data, sizeof(v)); return v; }
+    }
+    return 0.0;
+}
+
+/***********************************************************************************************************************
+ * @brief Read a color channel
+ * @param[in] vertex address of the vertex
+ * @param[in] property color property, NULL if the file has none
+ * @return the channel value, 255 without a property
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+static uint8_t readPlyColor(const unsigned char *vertex, const PlyProperty *property)
+{
+    if (property == NULL)
+    {
+        return 255;
+    }
+    if (property->type == PLY_UINT8)
+    {
+        return vertex[property->offset];
+    }
+    double value = readPlyValue(vertex + property->offset, property->type);
+    return (uint8_t)max(0.0, min(255.0, value));
+}
+
+/***********************************************************************************************************************
+ * @brief Check that a header line has no tokens left after the parsed ones
+ * @param[in,out] tokens rest of the line
+ * @return false if anything but whitespace is left
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+static bool lineConsumed(istringstream &tokens)
+{
+    string extra;
+    return !(tokens >> extra);
+}
+
+/***********************************************************************************************************************
+ * @brief Class constructor, the reader starts out keeping every point
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+CloudReader::CloudReader() :
+    myMinDepth(0.0f), myMaxDepth(numeric_limits<float>::infinity()), myLeafSize(0.0f), myFx(0.0f), myFy(0.0f), myCx(0.0f),
+    myCy(0.0f), myDepthScale(0.001f)
+{
+    myCropMin.setConstant(-numeric_limits<float>::infinity());
+    myCropMax.setConstant(numeric_limits<float>::infinity());
+}
+
+/***********************************************************************************************************************
+ * @brief Set the box points have to lie in
+ * @param[in] minPoint smallest coordinates, -infinity for no limit
+ * @param[in] maxPoint largest coordinates, +infinity for no limit
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void CloudReader::setCropBox(const Eigen::Vector3f &minPoint, const Eigen::Vector3f &maxPoint)
+{
+    myCropMin = minPoint;
+    myCropMax = maxPoint;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the range of depths points have to lie in
+ * @param[in] minDepth smallest depth, in meters
+ * @param[in] maxDepth largest depth, in meters, +infinity for no limit
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void CloudReader::setDepthRange(float minDepth, float maxDepth)
+{
+    myMinDepth = minDepth;
+    myMaxDepth = maxDepth;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the voxel subsampling
+ * @param[in] leafSize voxel edge length in meters, 0 to keep every point
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void CloudReader::setLeafSize(float leafSize)
+{
+    myLeafSize = max(0.0f, leafSize);
+}
+
+/***********************************************************************************************************************
+ * @brief Get the voxel subsampling
+ * @return voxel edge length in meters, 0 if every point is kept
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+float CloudReader::leafSize() const
+{
+    return myLeafSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the camera of depth images
+ * @param[in] fx focal length along the image columns, in pixels
+ * @param[in] fy focal length along the image rows, in pixels
+ * @param[in] cx column of the principal point
+ * @param[in] cy row of the principal point
+ * @param[in] depthScale meters per depth unit, 0.001 for millimeter depth images
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void CloudReader::setIntrinsics(float fx, float fy, float cx, float cy, float depthScale)
+{
+    myFx = fx;
+    myFy = fy;
+    myCx = cx;
+    myCy = cy;
+    myDepthScale = depthScale;
+}
+
+/***********************************************************************************************************************
+ * @brief Read a point cloud file
+ * @param[in] fileName PLY or PCD file, or PGM depth image
+ * @param[out] cloud points kept, organized if the file is and no leaf size is set
+ * @param[out] candidates if not NULL, number of finite points inside the region of interest before subsampling
+ * @return false if an error occurred while reading the file
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool CloudReader::read(const string &fileName, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t *candidates) const
+{
+    size_t inside = 0;
+    string fileExtension = fileName.substr(fileName.find_last_of(".") + 1);
+    if (fileExtension.compare("ply") == 0)
+    {
+        bool supported = true;
+        if (readPly(fileName, cloud, supported, inside))
+        {
+            if (candidates != NULL)
+            {
+                *candidates = inside;
+            }
+            return true;
+        }
+        if (supported)
+        {
+            PCL_ERROR("error while attempting to read ply file: %s \n", fileName.c_str());
+            return false;
+        }
+
+        // formats the streaming decoder does not handle
+        if (pcl::io::loadPLYFile<pcl::PointXYZRGBA>(fileName, cloud) == -1)
+        {
+            PCL_ERROR("error while attempting to read ply file: %s \n", fileName.c_str());
+            return false;
+        }
+    }
+    else if (fileExtension.compare("pcd") == 0)
+    {
+        if (pcl::io::loadPCDFile<pcl::PointXYZRGBA>(fileName, cloud) == -1)
+        {
+            PCL_ERROR("error while attempting to read pcd file: %s \n", fileName.c_str());
+            return false;
+        }
+    }
+    else if (fileExtension.compare("pgm") == 0)
+    {
+        if (!readDepthImage(fileName, cloud))
+        {
+            PCL_ERROR("error while attempting to read depth image: %s \n", fileName.c_str());
+            return false;
+        }
+    }
+    else
+    {
+        PCL_ERROR("error while attempting to read unsupported file: %s \n", fileName.c_str());
+        return false;
+    }
+
+    if (isFiltering())
+    {
+        filter(cloud, inside);
+    }
+    else
+    {
+        inside = cloud.points.size();
+    }
+    if (candidates != NULL)
+    {
+        *candidates = inside;
+    }
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Check whether a crop, a depth range or subsampling is set
+ * @return true if some finite points may be dropped
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool CloudReader::isFiltering() const
+{
+    return myLeafSize > 0.0f || myMinDepth > 0.0f || myMaxDepth < numeric_limits<float>::infinity() ||
+           (myCropMin.array() > -numeric_limits<float>::infinity()).any() || (myCropMax.array() < numeric_limits<float>::infinity()).any();
+}
+
+/***********************************************************************************************************************
+ * @brief Decide whether a point is kept
+ * @param[in] x x coordinate
+ * @param[in] y y coordinate
+ * @param[in] z z coordinate
+ * @param[in,out] voxels voxels that already have a point, the voxel of a kept point is added
+ * @param[in,out] candidates incremented if the point is finite and inside the region of interest
+ * @return true if the point is finite, inside the region of interest and the first of its voxel
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool CloudReader::keep(float x, float y, float z, unordered_set<uint64_t> &voxels, size_t &candidates) const
+{
+    if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z))
+    {
+        return false;
+    }
+    if (x < myCropMin[0] || y < myCropMin[1] || z < myCropMin[2] || x > myCropMax[0] || y > myCropMax[1] || z > myCropMax[2])
+    {
+        return false;
+    }
+    float depth = fabs(z);
+    if (depth < myMinDepth || depth > myMaxDepth)
+    {
+        return false;
+    }
+    candidates++;
+    if (myLeafSize <= 0.0f)
+    {
+        return true;
+    }
+
+    return voxels.insert(voxelKey(x, y, z, myLeafSize)).second;
+}
+
+/***********************************************************************************************************************
+ * @brief Decode a binary little endian PLY file in one streaming pass
+ * @param[in] fileName PLY file
+ * @param[out] cloud points kept
+ * @param[out] supported false if the file is valid PLY in a format this decoder does not handle
+ * @param[out] candidates number of finite points inside the region of interest before subsampling
+ * @return false if the file could not be decoded
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool CloudReader::readPly(const string &fileName, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, bool &supported, size_t &candidates) const
+{
+    // the vertex data is copied as is, which needs a little endian machine
+    const uint16_t one = 1;
+    supported = (*(const unsigned char *)&one == 1);
+    if (!supported)
+    {
+        return false;
+    }
+
+    int file = open(fileName.c_str(), O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        if (file >= 0)
+        {
+            close(file);
+        }
+        return false;
+    }
+    size_t fileSize = (size_t)status.st_size;
+    void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+    const unsigned char *data = (const unsigned char *)mapping;
+
+    // parse the header, lines may end in \r\n
+    vector<PlyElement> elements;
+    size_t position = 0;
+    bool binaryLittleEndian = false;
+    bool headerEnded = false;
+    size_t columns = 0;
+    size_t rows = 0;
+    bool valid = true;
+    while (valid && !headerEnded && position < fileSize)
+    {
+        const unsigned char *lineEnd = (const unsigned char *)memchr(data + position, '\n', fileSize - position);
+        if (lineEnd == NULL)
+        {
+            valid = false;
+            break;
+        }
+        string line((const char *)data + position, (const char *)lineEnd);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+        bool firstLine = (position == 0);
+        position = (size_t)(lineEnd - data) + 1;
+
+        istringstream tokens(line);
+        string keyword;
+        tokens >> keyword;
+        if (firstLine)
+        {
+            valid = (keyword == "ply");
+        }
+        else if (keyword == "format")
+        {
+            string format, version;
+            valid = static_cast<bool>(tokens >> format >> version) && lineConsumed(tokens);
+            binaryLittleEndian = (format == "binary_little_endian");
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            element.stride = 0;
+            element.hasList = false;
+            valid = static_cast<bool>(tokens >> element.name >> element.count) && lineConsumed(tokens);
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyElement &element = elements.back();
+            string typeName;
+            PlyProperty property;
+            size_t size = 0;
+            tokens >> typeName;
+            if (typeName == "list")
+            {
+                element.hasList = true;
+                continue;
+            }
+            valid = static_cast<bool>(tokens >> property.name) && lineConsumed(tokens) && parsePlyType(typeName, property.type, size);
+            property.offset = element.stride;
+            element.stride += size;
+            element.properties.push_back(property);
+        }
+        else if (keyword == "obj_info")
+        {
+            // image size of organized clouds, as written by pcl::PLYWriter
+            string name;
+            size_t value = 0;
+            tokens >> name;
+            if (name == "num_cols" || name == "num_rows")
+            {
+                valid = static_cast<bool>(tokens >> value) && lineConsumed(tokens);
+                (name == "num_cols" ? columns : rows) = value;
+            }
+        }
+        else if (keyword == "end_header")
+        {
+            headerEnded = true;
+        }
+    }
+
+    // only vertices with fixed size properties are decoded, after elements of fixed size
+    size_t vertexStart = position;
+    const PlyElement *vertices = NULL;
+    for (size_t i = 0; valid && headerEnded && i < elements.size() && vertices == NULL; i++)
+    {
+        if (elements[i].hasList)
+        {
+            break;
+        }
+        if (elements[i].name == "vertex")
+        {
+            vertices = &elements[i];
+        }
+        else
+        {
+            // compared by division, a corrupt count must not overflow the product
+            const PlyElement &element = elements[i];
+            if (element.stride > 0 && element.count > (fileSize - vertexStart) / element.stride)
+            {
+                valid = false;
+                break;
+            }
+            vertexStart += element.count * element.stride;
+        }
+    }
+
+    const PlyProperty *properties[7] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+    const char *names[7] = {"x", "y", "z", "red", "green", "blue", "alpha"};
+    for (size_t i = 0; vertices != NULL && i < vertices->properties.size(); i++)
+    {
+        for (int j = 0; j < 7; j++)
+        {
+            if (vertices->properties[i].name == names[j])
+            {
+                properties[j] = &vertices->properties[i];
+            }
+        }
+    }
+
+    if (!valid || !headerEnded)
+    {
+        munmap(mapping, fileSize);
+        return false;
+    }
+    if (!binaryLittleEndian || vertices == NULL || properties[0] == NULL || properties[1] == NULL || properties[2] == NULL)
+    {
+        supported = false;
+        munmap(mapping, fileSize);
+        return false;
+    }
+    if (vertices->stride == 0 || vertices->count > (fileSize - vertexStart) / vertices->stride)
+    {
+        munmap(mapping, fileSize);
+        return false;
+    }
+
+    // decode straight into the cloud. Organized clouds keep every vertex, with the dropped ones set to NaN, and without
+    // filtering nearly every vertex is kept, so the cloud is sized once; a filtered cloud grows with the kept points,
+    // so subsampling a large capture never allocates room for all of its vertices
+    const bool organized = rows > 1 && columns == vertices->count / rows && vertices->count % rows == 0 && myLeafSize <= 0.0f;
+    const float nan = numeric_limits<float>::quiet_NaN();
+    bool dense = true;
+    const bool floatCoordinates = properties[0]->type == PLY_FLOAT32 && properties[1]->type == PLY_FLOAT32 && properties[2]->type == PLY_FLOAT32;
+    unordered_set<uint64_t> voxels;
+    if (myLeafSize > 0.0f)
+    {
+        voxels.reserve(vertices->count / 4);
+    }
+    const bool growing = !organized && isFiltering();
+    cloud.points.clear();
+    if (growing)
+    {
+        cloud.points.reserve(vertices->count / 4);
+    }
+    else
+    {
+        cloud.points.resize(vertices->count);
+    }
+    size_t kept = 0;
+    candidates = 0;
+    const unsigned char *vertex = data + vertexStart;
+    for (size_t i = 0; i < vertices->count; i++, vertex += vertices->stride)
+    {
+        float x, y, z;
+        if (floatCoordinates)
+        {
+            memcpy(&x, vertex + properties[0]->offset, sizeof(float));
+            memcpy(&y, vertex + properties[1]->offset, sizeof(float));
+            memcpy(&z, vertex + properties[2]->offset, sizeof(float));
+        }
+        else
+        {
+            x = (float)readPlyValue(vertex + properties[0]->offset, properties[0]->type);
+            y = (float)readPlyValue(vertex + properties[1]->offset, properties[1]->type);
+            z = (float)readPlyValue(vertex + properties[2]->offset, properties[2]->type);
+        }
+        if (!keep(x, y, z, voxels, candidates))
+        {
+            if (!organized)
+            {
+                continue;
+            }
+            x = y = z = nan;
+            dense = false;
+        }
+
+        if (growing)
+        {
+            cloud.points.push_back(pcl::PointXYZRGBA());
+        }
+        pcl::PointXYZRGBA &point = cloud.points[kept++];
+        point.x = x;
+        point.y = y;
+        point.z = z;
+        point.r = readPlyColor(vertex, properties[3]);
+        point.g = readPlyColor(vertex, properties[4]);
+        point.b = readPlyColor(vertex, properties[5]);
+        point.a = readPlyColor(vertex, properties[6]);
+    }
+    munmap(mapping, fileSize);
+
+    cloud.points.resize(kept);
+    cloud.width = organized ? (uint32_t)columns : (uint32_t)kept;
+    cloud.height = organized ? (uint32_t)rows : 1;
+    cloud.is_dense = dense;
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Turn a binary PGM depth image into an organized cloud
+ *
+ * Pixels with a depth of 0 have no measurement and become NaN points. The points are in the optical frame of the
+ * camera, x along the columns, y along the rows and z along the view direction, and are white.
+ *
+ * @param[in] fileName PGM file with 8 or 16 bit depths
+ * @param[out] cloud organized cloud with one point per pixel
+ * @return false if the file is not a binary PGM image or no intrinsics are set
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool CloudReader::readDepthImage(const string &fileName, pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const
+{
+    if (myFx <= 0.0f || myFy <= 0.0f)
+    {
+        PCL_ERROR("depth images need the camera intrinsics \n");
+        return false;
+    }
+
+    // header fields are separated by whitespace and may be followed by comments
+    ifstream file(fileName.c_str(), ios::binary);
+    string magic;
+    size_t fields[3] = {0, 0, 0};
+    file >> magic;
+    for (int i = 0; i < 3 && file; i++)
+    {
+        file >> ws;
+        while (file.peek() == '#')
+        {
+            string comment;
+            getline(file, comment);
+            file >> ws;
+        }
+        file >> fields[i];
+    }
+    file.get();
+    const size_t columns = fields[0];
+    const size_t rows = fields[1];
+    const size_t maxValue = fields[2];
+    if (!file || magic != "P5" || columns == 0 || rows == 0 || maxValue == 0 || maxValue > 65535)
+    {
+        return false;
+    }
+
+    const size_t bytesPerPixel = maxValue > 255 ? 2 : 1;
+    if (columns > numeric_limits<size_t>::max() / bytesPerPixel / rows)
+    {
+        return false;
+    }
+    vector<unsigned char> depths(columns * rows * bytesPerPixel);
+    if (!file.read((char *)depths.data(), depths.size()))
+    {
+        return false;
+    }
+
+    const float nan = numeric_limits<float>::quiet_NaN();
+    bool dense = true;
+    cloud.points.resize(columns * rows);
+    for (size_t row = 0, i = 0; row < rows; row++)
+    {
+        for (size_t column = 0; column < columns; column++, i++)
+        {
+            // 16 bit samples are big endian
+            unsigned int depth = bytesPerPixel == 2 ? (depths[2 * i] << 8) | depths[2 * i + 1] : depths[i];
+            pcl::PointXYZRGBA &point = cloud.points[i];
+            if (depth == 0)
+            {
+                point.x = point.y = point.z = nan;
+                dense = false;
+            }
+            else
+            {
+                point.z = depth * myDepthScale;
+                point.x = (column - myCx) * point.z / myFx;
+                point.y = (row - myCy) * point.z / myFy;
+            }
+            point.r = point.g = point.b = point.a = 255;
+        }
+    }
+    cloud.width = (uint32_t)columns;
+    cloud.height = (uint32_t)rows;
+    cloud.is_dense = dense;
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Drop the points outside the region of interest and subsample a cloud read with pcl::io or from a depth image
+ * @param[in,out] cloud cloud to filter in place, organized clouds stay organized unless a leaf size is set
+ * @param[out] candidates number of finite points inside the region of interest before subsampling
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void CloudReader::filter(pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t &candidates) const
+{
+    candidates = 0;
+    unordered_set<uint64_t> voxels;
+    if (cloud.height > 1 && myLeafSize <= 0.0f)
+    {
+        const float nan = numeric_limits<float>::quiet_NaN();
+        for (size_t i = 0; i < cloud.points.size(); i++)
+        {
+            pcl::PointXYZRGBA &point = cloud.points[i];
+            if (!keep(point.x, point.y, point.z, voxels, candidates))
+            {
+                point.x = point.y = point.z = nan;
+                cloud.is_dense = false;
+            }
+        }
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < cloud.points.size(); i++)
+    {
+        const pcl::PointXYZRGBA &point = cloud.points[i];
+        if (keep(point.x, point.y, point.z, voxels, candidates))
+        {
+            cloud.points[kept++] = point;
+        }
+    }
+    cloud.points.resize(kept);
+    cloud.width = (uint32_t)kept;
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
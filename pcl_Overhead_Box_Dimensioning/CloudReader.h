@@ -0,0 +1,102 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file CloudReader.h
+ * @brief Header file for the CloudReader class
+ *
+ * This class reads PLY and PCD point clouds, cropping and subsampling them while they are decoded
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef CLOUDREADER_H
+#define CLOUDREADER_H
+
+#include <string>
+#include <unordered_set>
+#include <stdint.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <Eigen/Core>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @class CloudReader
+ *
+ * @brief Point cloud reader with a region of interest and voxel subsampling applied while decoding
+ *
+ * Binary little endian PLY files, as saved by the RealSense Viewer, are memory mapped and their vertices decoded in a
+ * single sequential pass straight into the output cloud, which is allocated once for the vertex count of the header,
+ * or grows with the kept points when points are dropped, so subsampling never allocates the full capture. Points
+ * outside the crop box or the depth range, points with non-finite coordinates and, when a leaf size is set, every
+ * point after the first of its voxel are dropped as they are decoded, so the cloud never holds them. No intermediate
+ * PLY structures are built, and the file pages are read by the OS as the pass reaches them.
+ *
+ * Other files (ASCII or big endian PLY, PCD) are read with pcl::io and filtered afterwards, with the same result.
+ *
+ * Organized clouds keep their width and height: PLY files with obj_info num_cols and num_rows lines, organized PCD
+ * files, and 16 bit PGM depth images, which are turned into points with the pinhole camera intrinsics. Points outside
+ * the region of interest then become NaN instead of being dropped, unless a leaf size is set, since subsampling does
+ * not preserve the pixel grid.
+ *
+ * read() can report how many points were inside the region of interest before subsampling, so callers can relate
+ * point counts of the subsampled cloud to the full resolution capture.
+ *
+ * The depth of a point is the absolute value of its z coordinate, so it does not depend on whether the camera looks
+ * along +z or, as in RealSense Viewer exports, along -z.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class CloudReader
+{
+private:
+
+    Eigen::Vector3f myCropMin;
+    Eigen::Vector3f myCropMax;
+    float myMinDepth;
+    float myMaxDepth;
+    float myLeafSize;
+    float myFx;
+    float myFy;
+    float myCx;
+    float myCy;
+    float myDepthScale;
+
+    bool isFiltering() const;
+    bool keep(float x, float y, float z, unordered_set<uint64_t> &voxels, size_t &candidates) const;
+    bool readPly(const string &fileName, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, bool &supported, size_t &candidates) const;
+    bool readDepthImage(const string &fileName, pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const;
+    void filter(pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t &candidates) const;
+
+public:
+
+    // constructors
+    CloudReader();
+
+    // region of interest and subsampling
+    void setCropBox(const Eigen::Vector3f &minPoint, const Eigen::Vector3f &maxPoint);
+    void setDepthRange(float minDepth, float maxDepth);
+    void setLeafSize(float leafSize);
+    float leafSize() const;
+    void setIntrinsics(float fx, float fy, float cx, float cy, float depthScale);
+
+    // reading
+    bool read(const string &fileName, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t *candidates=NULL) const;
+};
+
+#endif // CLOUDREADER_H
@@ -0,0 +1,194 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file ClusterBenchmark.cpp
+ * @brief Compares pcl::EuclideanClusterExtraction with GridClustering
+ *
+ * Each capture goes through the dimensioning pipeline once to remove the table. The objects are then clustered with
+ * both backends, at full resolution with the box size filter and on the voxel grid used by the pipeline, and the
+ * results are checked to be identical and the mean times reported.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "BoxPipeline.h"
+#include "GridClustering.h"
+#include "VoxelDownsampler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <pcl/common/time.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/extract_clusters.h>
+
+#define NUM_COMMAND_ARGS 1
+#define CLUSTER_TOLERANCE 0.02
+#define MIN_CLUSTER_SIZE 5000
+#define MAX_CLUSTER_SIZE 100000
+#define VOXEL_LEAF_SIZE 0.01
+#define DEFAULT_RUNS 10
+
+using namespace std;
+using namespace pcl;
+
+/***********************************************************************************************************************
+ * @brief Order clusters by decreasing size, then by first index, so equal sized clusters compare in a fixed order
+ * @param[in] a first cluster
+ * @param[in] b second cluster
+ * @return true if the first cluster comes first
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool compareClusters(const PointIndices &a, const PointIndices &b)
+{
+    if (a.indices.size() != b.indices.size())
+    {
+        return a.indices.size() > b.indices.size();
+    }
+    return !a.indices.empty() && a.indices[0] < b.indices[0];
+}
+
+/***********************************************************************************************************************
+ * @brief Check that two sets of clusters hold the same points
+ * @param[in] a first set of clusters
+ * @param[in] b second set of clusters
+ * @return true if every cluster of one set is a cluster of the other
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool sameClusters(vector<PointIndices> a, vector<PointIndices> b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t c = 0; c < a.size(); c++)
+    {
+        sort(a[c].indices.begin(), a[c].indices.end());
+        sort(b[c].indices.begin(), b[c].indices.end());
+    }
+    sort(a.begin(), a.end(), compareClusters);
+    sort(b.begin(), b.end(), compareClusters);
+    for (size_t c = 0; c < a.size(); c++)
+    {
+        if (a[c].indices != b[c].indices)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Cluster a cloud with both backends and print the comparison
+ * @param[in] label name of the comparison
+ * @param[in] cloud cloud to cluster
+ * @param[in] minSize smallest cluster to keep
+ * @param[in] maxSize largest cluster to keep
+ * @param[in] runs number of timed runs of each backend
+ * @return true if the backends found the same clusters
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool compareBackends(const string &label, const PointCloud<PointXYZRGBA>::Ptr &cloud, int minSize, int maxSize, int runs)
+{
+    vector<PointIndices> kdTreeClusters;
+    vector<PointIndices> gridClusters;
+    search::KdTree<PointXYZRGBA>::Ptr tree(new search::KdTree<PointXYZRGBA>);
+    EuclideanClusterExtraction<PointXYZRGBA> ec;
+    GridClustering grid(CLUSTER_TOLERANCE);
+    grid.setMinClusterSize(minSize);
+    grid.setMaxClusterSize(maxSize);
+
+    StopWatch watch;
+    double kdTreeTime = 0.0;
+    double gridTime = 0.0;
+    for (int run = 0; run < runs; run++)
+    {
+        // the KdTree build is part of the cost of the KdTree backend
+        watch.reset();
+        tree->setInputCloud(cloud);
+        ec.setClusterTolerance(CLUSTER_TOLERANCE);
+        ec.setMinClusterSize(minSize);
+        ec.setMaxClusterSize(maxSize);
+        ec.setSearchMethod(tree);
+        ec.setInputCloud(cloud);
+        kdTreeClusters.clear();
+        ec.extract(kdTreeClusters);
+        kdTreeTime += watch.getTime();
+
+        watch.reset();
+        grid.extract(*cloud, gridClusters);
+        gridTime += watch.getTime();
+    }
+
+    bool same = sameClusters(kdTreeClusters, gridClusters);
+    cout << "  " << label << ": " << cloud->points.size() << " points, " << kdTreeClusters.size() << " clusters, kdtree "
+         << kdTreeTime / runs << " ms, grid " << gridTime / runs << " ms, " << (same ? "identical" : "DIFFERENT") << endl;
+    return same;
+}
+
+int main(int argc, char **argv)
+{
+    // validate and parse the command line arguments
+    if (argc < NUM_COMMAND_ARGS + 1)
+    {
+        printf("USAGE: %s <file_name> [<file_name> ...] [--runs <count>]\n", argv[0]);
+        return 0;
+    }
+
+    vector<string> fileNames;
+    int runs = DEFAULT_RUNS;
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option == "--runs" && i + 1 < argc)
+        {
+            runs = max(1, atoi(argv[++i]));
+        }
+        else if (option.compare(0, 2, "--") == 0)
+        {
+            printf("unknown option: %s\n", argv[i]);
+            return 0;
+        }
+        else
+        {
+            fileNames.push_back(option);
+        }
+    }
+
+    // find the objects on the table at full resolution
+    BoxPipeline pipeline;
+    pipeline.setVoxelLeafSize(0.0f);
+    VoxelDownsampler downsampler(VOXEL_LEAF_SIZE);
+    PointCloud<PointXYZRGBA>::Ptr voxels(new PointCloud<PointXYZRGBA>);
+
+    bool allSame = true;
+    for (size_t f = 0; f < fileNames.size(); f++)
+    {
+        if (!pipeline.process(fileNames[f]))
+        {
+            continue;
+        }
+        cout << fileNames[f] << endl;
+        allSame &= compareBackends("full resolution", pipeline.objects(), MIN_CLUSTER_SIZE, MAX_CLUSTER_SIZE, runs);
+
+        downsampler.downsample(*pipeline.objects(), *voxels);
+        allSame &= compareBackends("voxels", voxels, 1, max((int)voxels->points.size(), 1), runs);
+    }
+
+    // a non-zero exit code when the backends disagree
+    return allSame ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file GridClustering.cpp
+ * @brief Implementation of the GridClustering class
+ *
+ * This class extracts Euclidean clusters with a spatial hash grid and union-find instead of a KdTree
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "GridClustering.h"
+#include "VoxelDownsampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+// smallest cloud worth spreading over several threads
+#define PARALLEL_MIN_POINTS 20000
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @param[in] tolerance largest distance between neighboring points of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+GridClustering::GridClustering(float tolerance) :
+    myTolerance(tolerance), myMinClusterSize(1), myMaxClusterSize(numeric_limits<int>::max()),
+    myThreadCount(max(1, (int)thread::hardware_concurrency())), myParentCapacity(0)
+{
+}
+
+/***********************************************************************************************************************
+ * @brief Set the cluster tolerance, which is also the grid cell size
+ * @param[in] tolerance largest distance between neighboring points of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::setClusterTolerance(float tolerance)
+{
+    myTolerance = tolerance;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the smallest cluster to keep
+ * @param[in] minSize minimum number of points of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::setMinClusterSize(int minSize)
+{
+    myMinClusterSize = minSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the largest cluster to keep
+ * @param[in] maxSize maximum number of points of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::setMaxClusterSize(int maxSize)
+{
+    myMaxClusterSize = maxSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the number of threads
+ * @param[in] threadCount number of threads, 0 for one per hardware thread
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::setThreadCount(int threadCount)
+{
+    myThreadCount = threadCount > 0 ? threadCount : max(1, (int)thread::hardware_concurrency());
+}
+
+/***********************************************************************************************************************
+ * @brief Extract the Euclidean clusters of a cloud
+ * @param[in] cloud input cloud, non-finite points belong to no cluster
+ * @param[out] clusters point indices of each cluster within the size range, the largest cluster first
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::extract(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, vector<pcl::PointIndices> &clusters)
+{
+    clusters.clear();
+    const int pointCount = (int)cloud.points.size();
+    if (pointCount == 0 || !(myTolerance > 0.0f))
+    {
+        return;
+    }
+
+    // sort the points by cell, so the points of a cell are contiguous
+    const float scale = sqrt(3.0f) / myTolerance;
+    myPointsByCell.clear();
+    myPointsByCell.reserve(pointCount);
+    for (int i = 0; i < pointCount; i++)
+    {
+        const pcl::PointXYZRGBA &p = cloud.points[i];
+        if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+        {
+            myPointsByCell.push_back(make_pair(voxelKey((int64_t)floor(p.x * scale), (int64_t)floor(p.y * scale), (int64_t)floor(p.z * scale)), i));
+        }
+    }
+    sort(myPointsByCell.begin(), myPointsByCell.end());
+
+    myCellStarts.clear();
+    myCellOfKey.clear();
+    myCellOfPoint.assign(pointCount, -1);
+    for (size_t k = 0; k < myPointsByCell.size(); k++)
+    {
+        if (k == 0 || myPointsByCell[k].first != myPointsByCell[k - 1].first)
+        {
+            myCellOfKey[myPointsByCell[k].first] = (int)myCellStarts.size();
+            myCellStarts.push_back((int)k);
+        }
+        myCellOfPoint[myPointsByCell[k].second] = (int)myCellStarts.size() - 1;
+    }
+    const int cellCount = (int)myCellStarts.size();
+    myCellStarts.push_back((int)myPointsByCell.size());
+
+    // every cell starts as its own tree
+    if (myParentCapacity < (size_t)cellCount)
+    {
+        myParents.reset(new atomic<int>[cellCount]);
+        myParentCapacity = cellCount;
+    }
+    for (int c = 0; c < cellCount; c++)
+    {
+        myParents[c].store(c, memory_order_relaxed);
+    }
+
+    // join the neighboring cells, interleaving the cells over the threads
+    int threadCount = (int)myPointsByCell.size() < PARALLEL_MIN_POINTS ? 1 : min(myThreadCount, cellCount);
+    if (threadCount <= 1)
+    {
+        joinCells(cloud, 0, 1);
+    }
+    else
+    {
+        vector<thread> threads;
+        for (int t = 0; t < threadCount; t++)
+        {
+            threads.push_back(thread(&GridClustering::joinCells, this, cref(cloud), (size_t)t, (size_t)threadCount));
+        }
+        for (size_t t = 0; t < threads.size(); t++)
+        {
+            threads[t].join();
+        }
+    }
+
+    // one cluster per tree, numbered in the order of their first point so the indices come out sorted
+    vector<pcl::PointIndices> trees;
+    myClusterOfRoot.assign(cellCount, -1);
+    for (int i = 0; i < pointCount; i++)
+    {
+        if (myCellOfPoint[i] < 0)
+        {
+            continue;
+        }
+        int root = find(myCellOfPoint[i]);
+        if (myClusterOfRoot[root] < 0)
+        {
+            myClusterOfRoot[root] = (int)trees.size();
+            trees.push_back(pcl::PointIndices());
+        }
+        trees[myClusterOfRoot[root]].indices.push_back(i);
+    }
+
+    keepClusters(trees, myMinClusterSize, myMaxClusterSize, clusters);
+}
+
+/***********************************************************************************************************************
+ * @brief Find the root of the tree of a cell, halving the path on the way
+ * @param[in] cell cell index
+ * @return index of the root cell
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+int GridClustering::find(int cell) const
+{
+    while (true)
+    {
+        int parent = myParents[cell].load(memory_order_relaxed);
+        if (parent == cell)
+        {
+            return cell;
+        }
+        int grandParent = myParents[parent].load(memory_order_relaxed);
+        if (grandParent != parent)
+        {
+            myParents[cell].compare_exchange_weak(parent, grandParent, memory_order_relaxed);
+        }
+        cell = grandParent;
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Join the trees of two cells
+ *
+ * The root with the larger index is linked below the other one. The link only succeeds while that root is still a
+ * root, otherwise another thread got there first and the roots are looked up again.
+ *
+ * @param[in] a first cell index
+ * @param[in] b second cell index
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::unite(int a, int b) const
+{
+    while (true)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+        {
+            return;
+        }
+        if (a < b)
+        {
+            swap(a, b);
+        }
+        int expected = a;
+        if (myParents[a].compare_exchange_strong(expected, b))
+        {
+            return;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Join a set of cells with their neighbors
+ *
+ * Cells up to two cells apart can hold points within the tolerance. Each cell is compared with the 62 of those
+ * neighbors that come after it, so every pair is compared once, and the comparison stops at the first pair of points
+ * within the tolerance or right away if the cells are already in the same tree.
+ *
+ * @param[in] cloud input cloud
+ * @param[in] firstCell first cell to process
+ * @param[in] cellStep distance between the processed cells
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void GridClustering::joinCells(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t firstCell, size_t cellStep) const
+{
+    const float squaredTolerance = myTolerance * myTolerance;
+    const size_t cellCount = myCellStarts.size() - 1;
+    for (size_t cell = firstCell; cell < cellCount; cell += cellStep)
+    {
+        const int begin = myCellStarts[cell];
+        const int end = myCellStarts[cell + 1];
+        int64_t x, y, z;
+        voxelCell(myPointsByCell[begin].first, x, y, z);
+
+        for (int dx = 0; dx <= 2; dx++)
+        {
+            for (int dy = (dx == 0 ? 0 : -2); dy <= 2; dy++)
+            {
+                for (int dz = (dx == 0 && dy == 0 ? 1 : -2); dz <= 2; dz++)
+                {
+                    unordered_map<uint64_t, int>::const_iterator neighbor = myCellOfKey.find(voxelKey(x + dx, y + dy, z + dz));
+                    if (neighbor == myCellOfKey.end() || find((int)cell) == find(neighbor->second))
+                    {
+                        continue;
+                    }
+
+                    // look for one pair of points within the tolerance
+                    const int neighborBegin = myCellStarts[neighbor->second];
+                    const int neighborEnd = myCellStarts[neighbor->second + 1];
+                    bool joined = false;
+                    for (int a = begin; a < end && !joined; a++)
+                    {
+                        const pcl::PointXYZRGBA &pa = cloud.points[myPointsByCell[a].second];
+                        for (int b = neighborBegin; b < neighborEnd; b++)
+                        {
+                            const pcl::PointXYZRGBA &pb = cloud.points[myPointsByCell[b].second];
+                            float deltaX = pa.x - pb.x;
+                            float deltaY = pa.y - pb.y;
+                            float deltaZ = pa.z - pb.z;
+                            if (deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ <= squaredTolerance)
+                            {
+                                unite((int)cell, neighbor->second);
+                                joined = true;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,130 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file GridClustering.h
+ * @brief Header file for the GridClustering class
+ *
+ * This class extracts Euclidean clusters with a spatial hash grid and union-find instead of a KdTree
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef GRIDCLUSTERING_H
+#define GRIDCLUSTERING_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @brief Order clusters by decreasing size, as pcl::EuclideanClusterExtraction does
+ * @param[in] a first cluster
+ * @param[in] b second cluster
+ * @return true if the first cluster has more points
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+inline bool compareClusterSize(const pcl::PointIndices &a, const pcl::PointIndices &b)
+{
+    return a.indices.size() > b.indices.size();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Keep the clusters within the size limits, largest first
+ * @param[in,out] trees candidate clusters, emptied of the kept ones
+ * @param[in] minSize smallest number of points of a cluster
+ * @param[in] maxSize largest number of points of a cluster
+ * @param[out] clusters kept clusters by decreasing size, ties in candidate order
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+inline void keepClusters(vector<pcl::PointIndices> &trees, double minSize, double maxSize,
+                         vector<pcl::PointIndices> &clusters)
+{
+    for (size_t c = 0; c < trees.size(); c++)
+    {
+        double size = (double)trees[c].indices.size();
+        if (size >= minSize && size <= maxSize)
+        {
+            clusters.push_back(pcl::PointIndices());
+            clusters.back().indices.swap(trees[c].indices);
+        }
+    }
+    stable_sort(clusters.begin(), clusters.end(), compareClusterSize);
+}
+
+/*******************************************************************************************************************//**
+ * @class GridClustering
+ *
+ * @brief Euclidean cluster extraction on a uniform grid instead of radius searches
+ *
+ * The cloud is hashed into cubic cells with a diagonal equal to the cluster tolerance, so all points of a cell are
+ * within the tolerance of each other and belong to the same cluster. Clustering the points then reduces to joining
+ * cells: two cells up to two cells apart are joined in a union-find forest as soon as one pair of their points is
+ * within the tolerance, and pairs of cells already in the same tree are not compared at all. The clusters are the trees
+ * of the forest, which are exactly the clusters of pcl::EuclideanClusterExtraction: the same size filter is applied,
+ * indices are sorted within a cluster, and clusters are ordered by decreasing size.
+ *
+ * Cells are spread over several threads for large clouds. The union-find links roots with compare-and-swap, so
+ * threads join trees without locks.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class GridClustering
+{
+private:
+
+    float myTolerance;
+    int myMinClusterSize;
+    int myMaxClusterSize;
+    int myThreadCount;
+
+    // grid and union-find buffers, reused between calls
+    vector<pair<uint64_t, int> > myPointsByCell;
+    vector<int> myCellStarts;
+    vector<int> myCellOfPoint;
+    unordered_map<uint64_t, int> myCellOfKey;
+    unique_ptr<atomic<int>[]> myParents;
+    size_t myParentCapacity;
+    vector<int> myClusterOfRoot;
+
+    int find(int cell) const;
+    void unite(int a, int b) const;
+    void joinCells(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t firstCell, size_t cellStep) const;
+
+public:
+
+    // constructors
+    GridClustering(float tolerance=0.02f);
+
+    // configuration
+    void setClusterTolerance(float tolerance);
+    void setMinClusterSize(int minSize);
+    void setMaxClusterSize(int maxSize);
+    void setThreadCount(int threadCount);
+
+    // clustering
+    void extract(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, vector<pcl::PointIndices> &clusters);
+};
+
+#endif // GRIDCLUSTERING_H
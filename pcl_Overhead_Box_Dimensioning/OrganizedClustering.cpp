@@ -0,0 +1,199 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file OrganizedClustering.cpp
+ * @brief Implementation of the OrganizedClustering class
+ *
+ * This class extracts clusters of an organized cloud as connected components of the pixel grid
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "OrganizedClustering.h"
+#include "GridClustering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @param[in] tolerance largest distance between the points of neighboring pixels of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+OrganizedClustering::OrganizedClustering(float tolerance) :
+    myTolerance(tolerance), myMinClusterSize(1), myMaxClusterSize(numeric_limits<int>::max())
+{
+}
+
+/***********************************************************************************************************************
+ * @brief Set the cluster tolerance
+ * @param[in] tolerance largest distance between the points of neighboring pixels of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void OrganizedClustering::setClusterTolerance(float tolerance)
+{
+    myTolerance = tolerance;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the smallest cluster to keep
+ * @param[in] minSize minimum number of points of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void OrganizedClustering::setMinClusterSize(int minSize)
+{
+    myMinClusterSize = minSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the largest cluster to keep
+ * @param[in] maxSize maximum number of points of a cluster
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void OrganizedClustering::setMaxClusterSize(int maxSize)
+{
+    myMaxClusterSize = maxSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Extract the connected clusters of an organized cloud
+ * @param[in] cloud organized cloud
+ * @param[in] excluded non-zero for the pixels to leave out, such as the table, one entry per point
+ * @param[out] clusters point indices of each cluster within the size range, the largest cluster first
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void OrganizedClustering::extract(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const vector<unsigned char> &excluded, vector<pcl::PointIndices> &clusters)
+{
+    clusters.clear();
+    const int columns = (int)cloud.width;
+    const int rows = (int)cloud.height;
+    const int pixelCount = columns * rows;
+    if (pixelCount == 0 || (int)cloud.points.size() != pixelCount || (int)excluded.size() != pixelCount)
+    {
+        return;
+    }
+
+    // pixels without a usable point are marked with -1
+    myParents.resize(pixelCount);
+    for (int i = 0; i < pixelCount; i++)
+    {
+        const pcl::PointXYZRGBA &p = cloud.points[i];
+        bool usable = !excluded[i] && std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+        myParents[i] = usable ? i : -1;
+    }
+
+    // join each pixel with its right and lower neighbors
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            int pixel = row * columns + column;
+            if (myParents[pixel] < 0)
+            {
+                continue;
+            }
+            if (column + 1 < columns)
+            {
+                join(cloud, excluded, pixel, pixel + 1);
+            }
+            if (row + 1 < rows)
+            {
+                if (column > 0)
+                {
+                    join(cloud, excluded, pixel, pixel + columns - 1);
+                }
+                join(cloud, excluded, pixel, pixel + columns);
+                if (column + 1 < columns)
+                {
+                    join(cloud, excluded, pixel, pixel + columns + 1);
+                }
+            }
+        }
+    }
+
+    // one cluster per tree, numbered in the order of their first pixel so the indices come out sorted
+    vector<pcl::PointIndices> trees;
+    myClusterOfRoot.assign(pixelCount, -1);
+    for (int i = 0; i < pixelCount; i++)
+    {
+        if (myParents[i] < 0)
+        {
+            continue;
+        }
+        int root = find(i);
+        if (myClusterOfRoot[root] < 0)
+        {
+            myClusterOfRoot[root] = (int)trees.size();
+            trees.push_back(pcl::PointIndices());
+        }
+        trees[myClusterOfRoot[root]].indices.push_back(i);
+    }
+
+    keepClusters(trees, myMinClusterSize, myMaxClusterSize, clusters);
+}
+
+/***********************************************************************************************************************
+ * @brief Find the root of the tree of a pixel, halving the path on the way
+ * @param[in] pixel pixel index
+ * @return index of the root pixel
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+int OrganizedClustering::find(int pixel)
+{
+    while (myParents[pixel] != pixel)
+    {
+        myParents[pixel] = myParents[myParents[pixel]];
+        pixel = myParents[pixel];
+    }
+    return pixel;
+}
+
+/***********************************************************************************************************************
+ * @brief Join the trees of two neighboring pixels if their points are within the tolerance
+ * @param[in] cloud organized cloud
+ * @param[in] excluded non-zero for the pixels to leave out
+ * @param[in] a first pixel, usable
+ * @param[in] b second pixel
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void OrganizedClustering::join(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const vector<unsigned char> &excluded, int a, int b)
+{
+    if (myParents[b] < 0 || excluded[b])
+    {
+        return;
+    }
+
+    const pcl::PointXYZRGBA &pa = cloud.points[a];
+    const pcl::PointXYZRGBA &pb = cloud.points[b];
+    float deltaX = pa.x - pb.x;
+    float deltaY = pa.y - pb.y;
+    float deltaZ = pa.z - pb.z;
+    if (deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ > myTolerance * myTolerance)
+    {
+        return;
+    }
+
+    int rootA = find(a);
+    int rootB = find(b);
+    if (rootA != rootB)
+    {
+        myParents[max(rootA, rootB)] = min(rootA, rootB);
+    }
+}
@@ -0,0 +1,79 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file OrganizedClustering.h
+ * @brief Header file for the OrganizedClustering class
+ *
+ * This class extracts clusters of an organized cloud as connected components of the pixel grid
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef ORGANIZEDCLUSTERING_H
+#define ORGANIZEDCLUSTERING_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @class OrganizedClustering
+ *
+ * @brief Euclidean clustering of organized clouds over pixel adjacency
+ *
+ * In a cloud that keeps the layout of the depth image, the neighbors of a point are the points of the 8 surrounding
+ * pixels, so no search structure is needed. Two neighboring pixels are joined when their points are within the
+ * tolerance, scanning the image row by row and comparing each pixel with its right and three lower neighbors only,
+ * and the clusters are the connected components of a union-find forest over the pixels. This takes a single linear
+ * pass over the image, reading each row close to the previous one.
+ *
+ * Unlike a radius search, points within the tolerance that are not in adjacent pixels are not joined, so boxes are
+ * split by holes in the depth image. The size filter and the order of the clusters are the same as with
+ * pcl::EuclideanClusterExtraction.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class OrganizedClustering
+{
+private:
+
+    float myTolerance;
+    int myMinClusterSize;
+    int myMaxClusterSize;
+    vector<int> myParents;
+    vector<int> myClusterOfRoot;
+
+    int find(int pixel);
+    void join(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const vector<unsigned char> &excluded, int a, int b);
+
+public:
+
+    // constructors
+    OrganizedClustering(float tolerance=0.02f);
+
+    // configuration
+    void setClusterTolerance(float tolerance);
+    void setMinClusterSize(int minSize);
+    void setMaxClusterSize(int maxSize);
+
+    // clustering
+    void extract(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const vector<unsigned char> &excluded, vector<pcl::PointIndices> &clusters);
+};
+
+#endif // ORGANIZEDCLUSTERING_H
@@ -0,0 +1,316 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file PipelineBenchmark.cpp
+ * @brief Times each step of the box dimensioning pipeline and checks the boxes against measured dimensions
+ *
+ * The captures are processed one after another, as a camera stream would be, for the given number of runs. The mean
+ * and 95th percentile time of every step are reported for each capture, with the peak memory of the process. As when
+ * streaming, the table plane of one capture is tried on the next, so after the first capture the plane step mostly
+ * times the check of that hint; --no-track-plane runs RANSAC on every capture to time the plane search itself. With a
+ * ground truth file the boxes of every run are compared with the measured dimensions, and the exit code is non-zero
+ * if any box is missing or off by more than the tolerance.
+ *
+ * The ground truth file has one line per box, "<capture file name> <length> <width> <height>" in meters, where the
+ * file name is matched without its directory. Lines starting with # are comments.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "BoxPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <sys/resource.h>
+
+#define NUM_COMMAND_ARGS 1
+#define DEFAULT_RUNS 10
+#define DEFAULT_TOLERANCE 0.005
+#define PERCENTILE 0.95
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @brief Measured dimensions of a box, in meters
+ **********************************************************************************************************************/
+struct TruthBox
+{
+    float length;
+    float width;
+    float height;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Step times and accuracy of one capture over all runs
+ **********************************************************************************************************************/
+struct CaptureStats
+{
+    vector<PipelineTimes> times;
+    int failedRuns;
+    float worstError;
+};
+
+/***********************************************************************************************************************
+ * @brief Strip the directory from a path
+ * @param[in] path file path
+ * @return file name
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+string baseName(const string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+/***********************************************************************************************************************
+ * @brief Read the ground truth file
+ * @param[in] fileName path of the ground truth file
+ * @param[out] truths boxes of each capture file name
+ * @return false if the file cannot be read or a line is malformed
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool readTruth(const string &fileName, map<string, vector<TruthBox> > &truths)
+{
+    ifstream file(fileName.c_str());
+    if (!file)
+    {
+        cout << "Cannot read the ground truth file " << fileName << endl;
+        return false;
+    }
+
+    string line;
+    for (int lineNumber = 1; getline(file, line); lineNumber++)
+    {
+        istringstream fields(line);
+        string name;
+        if (!(fields >> name) || name[0] == '#')
+        {
+            continue;
+        }
+
+        TruthBox box;
+        if (!(fields >> box.length >> box.width >> box.height))
+        {
+            cout << "Malformed ground truth on line " << lineNumber << " of " << fileName << endl;
+            return false;
+        }
+        truths[baseName(name)].push_back(box);
+    }
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Match the measured boxes with the ground truth
+ *
+ * Each ground truth box is paired with the unused measured box whose largest dimension error is smallest, so the
+ * check does not depend on the order of the clusters.
+ *
+ * @param[in] boxes measured boxes
+ * @param[in] truth ground truth boxes of the capture
+ * @param[in] tolerance largest allowed error of a dimension in meters
+ * @param[in,out] worstError largest dimension error seen so far
+ * @return true if there are as many boxes as in the ground truth and every dimension is within the tolerance
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool checkBoxes(const vector<BoxDimensions> &boxes, const vector<TruthBox> &truth, float tolerance, float &worstError)
+{
+    bool passed = boxes.size() == truth.size();
+    vector<bool> used(boxes.size(), false);
+    for (size_t t = 0; t < truth.size(); t++)
+    {
+        int best = -1;
+        float bestError = 0.0f;
+        for (size_t b = 0; b < boxes.size(); b++)
+        {
+            float error = max(fabs(boxes[b].length - truth[t].length),
+                              max(fabs(boxes[b].width - truth[t].width), fabs(boxes[b].height - truth[t].height)));
+            if (!used[b] && (best < 0 || error < bestError))
+            {
+                best = (int)b;
+                bestError = error;
+            }
+        }
+
+        if (best < 0)
+        {
+            passed = false;
+            continue;
+        }
+        used[best] = true;
+        worstError = max(worstError, bestError);
+        passed &= bestError <= tolerance;
+    }
+    return passed;
+}
+
+/***********************************************************************************************************************
+ * @brief Print the mean and percentile of one step over all runs
+ * @param[in] label name of the step
+ * @param[in] times step times of every run
+ * @param[in] step member of PipelineTimes for the step
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void printStep(const string &label, const vector<PipelineTimes> &times, double PipelineTimes::*step)
+{
+    vector<double> values(times.size());
+    double sum = 0.0;
+    for (size_t r = 0; r < times.size(); r++)
+    {
+        values[r] = times[r].*step;
+        sum += values[r];
+    }
+    sort(values.begin(), values.end());
+
+    // nearest rank percentile
+    size_t rank = (size_t)ceil(PERCENTILE * values.size());
+    double percentile = values[max(rank, (size_t)1) - 1];
+    cout << "  " << left << setw(12) << label << right << fixed << setprecision(3) << setw(10) << sum / values.size()
+         << setw(10) << percentile << endl;
+}
+
+int main(int argc, char **argv)
+{
+    // validate and parse the command line arguments
+    if (argc < NUM_COMMAND_ARGS + 1)
+    {
+        printf("USAGE: %s <file_name> [<file_name> ...] [--runs <count>] [--truth <file_name>] [--tolerance <meters>] [--clustering kdtree|grid] [--voxel <meters>] [--no-track-plane]\n", argv[0]);
+        return 0;
+    }
+
+    vector<string> fileNames;
+    int runs = DEFAULT_RUNS;
+    float tolerance = DEFAULT_TOLERANCE;
+    map<string, vector<TruthBox> > truths;
+    bool hasTruth = false;
+    bool trackPlane = true;
+    BoxPipeline pipeline;
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option == "--runs" && i + 1 < argc)
+        {
+            runs = max(1, atoi(argv[++i]));
+        }
+        else if (option == "--truth" && i + 1 < argc)
+        {
+            if (!readTruth(argv[++i], truths))
+            {
+                return 1;
+            }
+            hasTruth = true;
+        }
+        else if (option == "--tolerance" && i + 1 < argc)
+        {
+            tolerance = (float)atof(argv[++i]);
+        }
+        else if (option == "--clustering" && i + 1 < argc)
+        {
+            string backend(argv[++i]);
+            if (backend != "kdtree" && backend != "grid")
+            {
+                printf("unknown clustering backend: %s\n", backend.c_str());
+                return 0;
+            }
+            pipeline.setClusteringBackend(backend == "grid" ? CLUSTERING_GRID : CLUSTERING_KDTREE);
+        }
+        else if (option == "--voxel" && i + 1 < argc)
+        {
+            pipeline.setVoxelLeafSize((float)atof(argv[++i]));
+        }
+        else if (option == "--no-track-plane")
+        {
+            trackPlane = false;
+        }
+        else if (option.compare(0, 2, "--") == 0)
+        {
+            printf("unknown option: %s\n", argv[i]);
+            return 0;
+        }
+        else
+        {
+            fileNames.push_back(option);
+        }
+    }
+
+    // process the captures in sequence, so the table plane of one frame is tried on the next as when streaming, unless
+    // the plane search itself is timed
+    pipeline.setTrackPlane(trackPlane);
+    cout << "Plane: " << (trackPlane ? "tracked from the previous capture" : "RANSAC on every capture") << endl;
+    vector<CaptureStats> stats(fileNames.size());
+    for (size_t f = 0; f < fileNames.size(); f++)
+    {
+        stats[f].failedRuns = 0;
+        stats[f].worstError = 0.0f;
+    }
+    bool allFound = true;
+    for (int run = 0; run < runs; run++)
+    {
+        for (size_t f = 0; f < fileNames.size(); f++)
+        {
+            bool found = pipeline.process(fileNames[f]);
+            allFound &= found;
+            stats[f].times.push_back(pipeline.times());
+
+            map<string, vector<TruthBox> >::const_iterator truth = truths.find(baseName(fileNames[f]));
+            if (truth != truths.end() && !(found && checkBoxes(pipeline.boxes(), truth->second, tolerance, stats[f].worstError)))
+            {
+                stats[f].failedRuns++;
+            }
+        }
+    }
+
+    // report the step times of each capture, and its accuracy when there is a ground truth
+    bool allPassed = allFound;
+    for (size_t f = 0; f < fileNames.size(); f++)
+    {
+        cout << fileNames[f] << " (" << runs << " runs, ms)" << endl;
+        cout << "  " << left << setw(12) << "step" << right << setw(10) << "mean" << setw(10) << "p95" << endl;
+        printStep("load", stats[f].times, &PipelineTimes::load);
+        printStep("downsample", stats[f].times, &PipelineTimes::downsample);
+        printStep("plane", stats[f].times, &PipelineTimes::plane);
+        printStep("extract", stats[f].times, &PipelineTimes::extract);
+        printStep("tree", stats[f].times, &PipelineTimes::tree);
+        printStep("clustering", stats[f].times, &PipelineTimes::clustering);
+        printStep("measurement", stats[f].times, &PipelineTimes::measurement);
+        printStep("total", stats[f].times, &PipelineTimes::total);
+
+        if (truths.count(baseName(fileNames[f])) > 0)
+        {
+            cout << "  accuracy: " << runs - stats[f].failedRuns << "/" << runs << " runs within " << tolerance
+                 << " m, worst dimension error " << stats[f].worstError << " m" << endl;
+            allPassed &= stats[f].failedRuns == 0;
+        }
+        else if (hasTruth)
+        {
+            cout << "  accuracy: no ground truth for this capture" << endl;
+        }
+    }
+
+    // peak resident memory of the process, in kilobytes on Linux
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << "Peak memory: " << setprecision(1) << usage.ru_maxrss / 1024.0 << " MB" << endl;
+
+    // a non-zero exit code when a capture has no table or a box is off
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,483 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file PlaneEstimator.cpp
+ * @brief Implementation of the PlaneEstimator class
+ *
+ * This class finds the dominant plane of a cloud, starting from the plane of the previous capture
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "PlaneEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <Eigen/Eigenvalues>
+
+// share of the previous inliers a hint must keep to be accepted
+#define HINT_INLIER_RATIO 0.9
+
+// RANSAC iterations scored between two updates of the iteration budget, and seed of the first iteration
+#define RANSAC_BATCH_ITERATIONS 32
+#define RANSAC_SEED 12345u
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @param[in] distanceThreshold maximum distance of a point to the plane to be considered an inlier
+ * @param[in] maxIterations upper bound on the RANSAC iterations
+ * @param[in] confidence probability of drawing an all-inlier sample at which RANSAC stops
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+PlaneEstimator::PlaneEstimator(float distanceThreshold, int maxIterations, double confidence) :
+    myDistanceThreshold(distanceThreshold), myMaxIterations(maxIterations), myConfidence(confidence),
+    myThreadCount(max(1, (int)thread::hardware_concurrency())), myMinInlierFraction(0.2f),
+    myHint(Eigen::Vector4f::Zero()), myHintInlierFraction(0.0f), myHasHint(false), myUsedHint(false), myIterations(0)
+{
+}
+
+/***********************************************************************************************************************
+ * @brief Set the inlier distance
+ * @param[in] distanceThreshold maximum distance of a point to the plane to be considered an inlier
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::setDistanceThreshold(float distanceThreshold)
+{
+    myDistanceThreshold = distanceThreshold;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the iteration limit of RANSAC
+ * @param[in] maxIterations upper bound on the RANSAC iterations
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::setMaxIterations(int maxIterations)
+{
+    myMaxIterations = max(1, maxIterations);
+}
+
+/***********************************************************************************************************************
+ * @brief Set the stopping confidence of RANSAC
+ * @param[in] confidence probability of drawing an all-inlier sample, between 0 and 1
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::setConfidence(double confidence)
+{
+    myConfidence = min(max(confidence, 0.0), 0.999999);
+}
+
+/***********************************************************************************************************************
+ * @brief Set the number of RANSAC threads
+ * @param[in] threadCount number of threads, 0 for one per hardware thread
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::setThreadCount(int threadCount)
+{
+    myThreadCount = threadCount > 0 ? threadCount : max(1, (int)thread::hardware_concurrency());
+}
+
+/***********************************************************************************************************************
+ * @brief Set the smallest share of the cloud a plane must hold
+ * @param[in] fraction minimum inlier count divided by the point count, for hints and RANSAC results
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::setMinInlierFraction(float fraction)
+{
+    myMinInlierFraction = fraction;
+}
+
+/***********************************************************************************************************************
+ * @brief Set the plane to try first, such as a table plane saved from an earlier run
+ * @param[in] plane plane coefficients a, b, c, d of ax + by + cz + d = 0
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::setHint(const Eigen::Vector4f &plane)
+{
+    float norm = plane.head<3>().norm();
+    myHasHint = norm > 0.0f;
+    myHint = myHasHint ? Eigen::Vector4f(plane / norm) : Eigen::Vector4f::Zero();
+    myHintInlierFraction = 0.0f;
+}
+
+/***********************************************************************************************************************
+ * @brief Forget the plane hint, so the next estimate runs RANSAC
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::clearHint()
+{
+    myHasHint = false;
+}
+
+/***********************************************************************************************************************
+ * @brief Check for a plane hint
+ * @return true if the next estimate will try a hint first
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool PlaneEstimator::hasHint() const
+{
+    return myHasHint;
+}
+
+/***********************************************************************************************************************
+ * @brief Find the dominant plane of a cloud
+ *
+ * The hint is tried first and RANSAC only runs when it fails. The plane found becomes the hint of the next call.
+ *
+ * @param[in] cloud input cloud
+ * @param[out] inliers indices of the points within the distance threshold of the plane
+ * @param[out] coefficients plane coefficients a, b, c, d of ax + by + cz + d = 0, with a unit normal
+ * @return true if a plane holding the minimum inlier fraction was found
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool PlaneEstimator::estimate(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients)
+{
+    inliers.indices.clear();
+    coefficients.values.clear();
+    myUsedHint = false;
+    myIterations = 0;
+    if (cloud.points.size() < 3)
+    {
+        return false;
+    }
+
+    // verify the hint with one inlier count
+    const float pointCount = (float)cloud.points.size();
+    const float requiredFraction = max(myMinInlierFraction, (float)HINT_INLIER_RATIO * myHintInlierFraction);
+    Eigen::Vector4f plane = myHint;
+    myUsedHint = myHasHint && countInliers(cloud, myHint) >= requiredFraction * pointCount;
+    if (!myUsedHint && !ransac(cloud, plane))
+    {
+        return false;
+    }
+
+    // refine the plane by least squares on its inliers and collect the inliers of the refined plane
+    findInliers(cloud, plane, inliers);
+    if (fitPlane(cloud, inliers, plane))
+    {
+        findInliers(cloud, plane, inliers);
+    }
+
+    float inlierFraction = inliers.indices.size() / pointCount;
+    if (inlierFraction < myMinInlierFraction)
+    {
+        inliers.indices.clear();
+        return false;
+    }
+
+    myHint = plane;
+    myHintInlierFraction = inlierFraction;
+    myHasHint = true;
+    coefficients.values.assign(plane.data(), plane.data() + 4);
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Check how the last plane was found
+ * @return true if the last estimate accepted the hint, false if it ran RANSAC
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool PlaneEstimator::usedHint() const
+{
+    return myUsedHint;
+}
+
+/***********************************************************************************************************************
+ * @brief Get the RANSAC iterations of the last estimate
+ * @return number of hypotheses scored, 0 if the hint was accepted
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+int PlaneEstimator::iterations() const
+{
+    return myIterations;
+}
+
+/***********************************************************************************************************************
+ * @brief Count the points within the distance threshold of a plane
+ * @param[in] cloud input cloud
+ * @param[in] plane plane coefficients with a unit normal
+ * @return number of inliers
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+size_t PlaneEstimator::countInliers(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const Eigen::Vector4f &plane) const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < cloud.points.size(); i++)
+    {
+        const pcl::PointXYZRGBA &p = cloud.points[i];
+        count += fabs(plane[0] * p.x + plane[1] * p.y + plane[2] * p.z + plane[3]) <= myDistanceThreshold;
+    }
+    return count;
+}
+
+/***********************************************************************************************************************
+ * @brief Collect the points within the distance threshold of a plane
+ * @param[in] cloud input cloud
+ * @param[in] plane plane coefficients with a unit normal
+ * @param[out] inliers indices of the inliers, in increasing order
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void PlaneEstimator::findInliers(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const Eigen::Vector4f &plane, pcl::PointIndices &inliers) const
+{
+    inliers.indices.clear();
+    for (size_t i = 0; i < cloud.points.size(); i++)
+    {
+        const pcl::PointXYZRGBA &p = cloud.points[i];
+        if (fabs(plane[0] * p.x + plane[1] * p.y + plane[2] * p.z + plane[3]) <= myDistanceThreshold)
+        {
+            inliers.indices.push_back((int)i);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Fit a plane to a set of points by least squares
+ *
+ * The normal is the eigenvector of the smallest eigenvalue of the point covariance, and is kept on the same side as
+ * the normal of the input plane.
+ *
+ * @param[in] cloud input cloud
+ * @param[in] inliers indices of the points to fit
+ * @param[in,out] plane plane coefficients, replaced by the fitted plane
+ * @return true if the points span a plane
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool PlaneEstimator::fitPlane(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const pcl::PointIndices &inliers, Eigen::Vector4f &plane) const
+{
+    if (inliers.indices.size() < 3)
+    {
+        return false;
+    }
+
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d products = Eigen::Matrix3d::Zero();
+    for (size_t i = 0; i < inliers.indices.size(); i++)
+    {
+        Eigen::Vector3d p = cloud.points[inliers.indices[i]].getVector3fMap().cast<double>();
+        sum += p;
+        products += p * p.transpose();
+    }
+    Eigen::Vector3d centroid = sum / (double)inliers.indices.size();
+    Eigen::Matrix3d covariance = products / (double)inliers.indices.size() - centroid * centroid.transpose();
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    if (solver.info() != Eigen::Success)
+    {
+        return false;
+    }
+    Eigen::Vector3f normal = solver.eigenvectors().col(0).cast<float>();
+    if (normal.dot(plane.head<3>()) < 0.0f)
+    {
+        normal = -normal;
+    }
+    plane << normal, -normal.dot(centroid.cast<float>());
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Draw the plane hypothesis of one RANSAC iteration
+ *
+ * Each iteration seeds its own generator with its index, so the hypothesis of an iteration does not depend on which
+ * thread scores it.
+ *
+ * @param[in] cloud input cloud with at least 3 points
+ * @param[in] iteration iteration index
+ * @param[out] hypothesis plane through three points of the cloud, with a unit normal
+ * @return false if the three points are not distinct or are collinear
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool PlaneEstimator::drawHypothesis(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, int iteration, Eigen::Vector4f &hypothesis) const
+{
+    mt19937 generator(RANSAC_SEED + (unsigned)iteration);
+    uniform_int_distribution<int> pick(0, (int)cloud.points.size() - 1);
+    int a = pick(generator);
+    int b = pick(generator);
+    int c = pick(generator);
+    if (a == b || a == c || b == c)
+    {
+        return false;
+    }
+
+    Eigen::Vector3f pa = cloud.points[a].getVector3fMap();
+    Eigen::Vector3f normal = (cloud.points[b].getVector3fMap() - pa).cross(cloud.points[c].getVector3fMap() - pa);
+    float norm = normal.norm();
+    if (!(norm > 1e-9f))
+    {
+        return false;
+    }
+    normal /= norm;
+    hypothesis << normal, -normal.dot(pa);
+    return true;
+}
+
+/***********************************************************************************************************************
+ * @brief Search the plane with the most inliers by multithreaded adaptive RANSAC
+ *
+ * The iterations run in batches of RANSAC_BATCH_ITERATIONS. Within a batch, thread t scores the iterations t, t + n,
+ * t + 2n, ... for n threads, and keeps its best plane. At the end of the batch the threads meet, the best plane is
+ * taken from their results, ties going to the lowest iteration index, and the iteration budget is lowered to
+ * log(1 - confidence) / log(1 - w^3), w being the inlier share of the best plane so far, before the next batch starts.
+ * Since every iteration draws from its own seed and the budget only changes between batches, the plane and the
+ * iteration count are the same for any number of threads.
+ *
+ * @param[in] cloud input cloud with at least 3 points
+ * @param[out] plane best plane, with a unit normal
+ * @return true if a plane was found
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool PlaneEstimator::ransac(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, Eigen::Vector4f &plane)
+{
+    const int pointCount = (int)cloud.points.size();
+    const int threadCount = max(1, min(myThreadCount, RANSAC_BATCH_ITERATIONS));
+    int requiredIterations = myMaxIterations;
+    size_t bestCount = 0;
+    Eigen::Vector4f bestPlane = Eigen::Vector4f::Zero();
+
+    // best plane of each thread in the current batch, the first iteration with the most inliers
+    vector<size_t> threadBestCount(threadCount);
+    vector<int> threadBestIteration(threadCount);
+    vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > threadBestPlane(threadCount);
+    auto scoreSlice = [&](int t, int batchStart, int batchEnd)
+    {
+        threadBestCount[t] = 0;
+        threadBestIteration[t] = batchEnd;
+        Eigen::Vector4f hypothesis;
+        for (int i = batchStart + t; i < batchEnd; i += threadCount)
+        {
+            if (!drawHypothesis(cloud, i, hypothesis))
+            {
+                continue;
+            }
+            size_t count = countInliers(cloud, hypothesis);
+            if (count > threadBestCount[t])
+            {
+                threadBestCount[t] = count;
+                threadBestIteration[t] = i;
+                threadBestPlane[t] = hypothesis;
+            }
+        }
+    };
+
+    // the worker threads score their slice of each batch the calling thread announces, which scores slice 0
+    mutex batchMutex;
+    condition_variable batchStarted;
+    condition_variable batchFinished;
+    int batch = 0;
+    int batchStart = 0;
+    int batchEnd = 0;
+    int pendingThreads = 0;
+    bool finished = false;
+    vector<thread> threads;
+    for (int t = 1; t < threadCount; t++)
+    {
+        threads.push_back(thread([&, t]()
+        {
+            int seenBatch = 0;
+            while (true)
+            {
+                int start, end;
+                {
+                    unique_lock<mutex> lock(batchMutex);
+                    batchStarted.wait(lock, [&]() { return finished || batch != seenBatch; });
+                    if (finished)
+                    {
+                        return;
+                    }
+                    seenBatch = batch;
+                    start = batchStart;
+                    end = batchEnd;
+                }
+                scoreSlice(t, start, end);
+                lock_guard<mutex> lock(batchMutex);
+                if (--pendingThreads == 0)
+                {
+                    batchFinished.notify_one();
+                }
+            }
+        }));
+    }
+
+    int scoredIterations = 0;
+    while (scoredIterations < requiredIterations)
+    {
+        int end = min(scoredIterations + RANSAC_BATCH_ITERATIONS, requiredIterations);
+        {
+            lock_guard<mutex> lock(batchMutex);
+            batch++;
+            batchStart = scoredIterations;
+            batchEnd = end;
+            pendingThreads = threadCount - 1;
+        }
+        batchStarted.notify_all();
+        scoreSlice(0, scoredIterations, end);
+        {
+            unique_lock<mutex> lock(batchMutex);
+            batchFinished.wait(lock, [&]() { return pendingThreads == 0; });
+        }
+        scoredIterations = end;
+
+        // earlier batches won ties already, within the batch the lowest iteration wins
+        int winner = -1;
+        for (int t = 0; t < threadCount; t++)
+        {
+            if (threadBestCount[t] > bestCount ||
+                (winner >= 0 && threadBestCount[t] == bestCount && threadBestIteration[t] < threadBestIteration[winner]))
+            {
+                bestCount = threadBestCount[t];
+                winner = t;
+            }
+        }
+        if (winner < 0)
+        {
+            continue;
+        }
+        bestPlane = threadBestPlane[winner];
+
+        // probability that one sample of three points holds an outlier
+        double w = (double)bestCount / pointCount;
+        double outlierSample = 1.0 - w * w * w;
+        if (outlierSample <= 0.0)
+        {
+            requiredIterations = 0;
+        }
+        else if (outlierSample < 1.0)
+        {
+            double needed = ceil(log(1.0 - myConfidence) / log(outlierSample));
+            requiredIterations = min(requiredIterations, (int)min(needed, (double)myMaxIterations));
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(batchMutex);
+        finished = true;
+    }
+    batchStarted.notify_all();
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+
+    myIterations = scoredIterations;
+    plane = bestPlane;
+    return bestCount > 0;
+}
@@ -0,0 +1,98 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file PlaneEstimator.h
+ * @brief Header file for the PlaneEstimator class
+ *
+ * This class finds the dominant plane of a cloud, starting from the plane of the previous capture
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef PLANEESTIMATOR_H
+#define PLANEESTIMATOR_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+#include <Eigen/Core>
+
+using namespace std;
+
+/*******************************************************************************************************************//**
+ * @class PlaneEstimator
+ *
+ * @brief Plane segmentation with a plane hint and parallel adaptive RANSAC
+ *
+ * The camera looks at the table from a fixed mount, so the table plane of one capture is a good guess for the next.
+ * The plane of the last successful estimate is kept as a hint. A new cloud is first checked against it with a single
+ * inlier count, and if the hint still has at least the expected share of inliers it is refined by a least squares fit
+ * to those inliers and returned without any sampling.
+ *
+ * Only when there is no hint, or it fails the check, the plane is searched with RANSAC. Hypotheses are scored by
+ * several threads at once in small batches, and between batches the number of iterations is lowered as better planes
+ * are found, to the count that gives the configured confidence of having drawn three inliers at least once. Each
+ * iteration draws its sample from its own seed, so the result is repeatable and does not depend on the thread count.
+ * The best plane is refined by least squares, as SACSegmentation does with optimized coefficients.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class PlaneEstimator
+{
+private:
+
+    float myDistanceThreshold;
+    int myMaxIterations;
+    double myConfidence;
+    int myThreadCount;
+    float myMinInlierFraction;
+    Eigen::Vector4f myHint;
+    float myHintInlierFraction;
+    bool myHasHint;
+    bool myUsedHint;
+    int myIterations;
+
+    size_t countInliers(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const Eigen::Vector4f &plane) const;
+    void findInliers(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const Eigen::Vector4f &plane, pcl::PointIndices &inliers) const;
+    bool fitPlane(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const pcl::PointIndices &inliers, Eigen::Vector4f &plane) const;
+    bool drawHypothesis(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, int iteration, Eigen::Vector4f &hypothesis) const;
+    bool ransac(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, Eigen::Vector4f &plane);
+
+public:
+
+    // constructors
+    PlaneEstimator(float distanceThreshold=0.02f, int maxIterations=5000, double confidence=0.99);
+
+    // configuration
+    void setDistanceThreshold(float distanceThreshold);
+    void setMaxIterations(int maxIterations);
+    void setConfidence(double confidence);
+    void setThreadCount(int threadCount);
+    void setMinInlierFraction(float fraction);
+
+    // plane hint
+    void setHint(const Eigen::Vector4f &plane);
+    void clearHint();
+    bool hasHint() const;
+
+    // estimation
+    bool estimate(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients);
+    bool usedHint() const;
+    int iterations() const;
+};
+
+#endif // PLANEESTIMATOR_H
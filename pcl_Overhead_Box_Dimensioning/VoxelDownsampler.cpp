@@ -0,0 +1,196 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/***********************************************************************************************************************
+ * @file VoxelDownsampler.cpp
+ * @brief Implementation of the VoxelDownsampler class
+ *
+ * This class reduces a point cloud to one point per voxel and maps results on the voxels back to the points
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#include "VoxelDownsampler.h"
+
+#include <unordered_map>
+
+using namespace std;
+
+/***********************************************************************************************************************
+ * @brief Class constructor
+ * @param[in] leafSize voxel edge length in meters, 0 to keep every point
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+VoxelDownsampler::VoxelDownsampler(float leafSize) : myLeafSize(max(0.0f, leafSize)), myVoxelCount(0)
+{
+}
+
+/***********************************************************************************************************************
+ * @brief Set the voxel size
+ * @param[in] leafSize voxel edge length in meters, 0 to keep every point
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void VoxelDownsampler::setLeafSize(float leafSize)
+{
+    myLeafSize = max(0.0f, leafSize);
+}
+
+/***********************************************************************************************************************
+ * @brief Get the voxel size
+ * @return voxel edge length in meters, 0 if every point is kept
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+float VoxelDownsampler::leafSize() const
+{
+    return myLeafSize;
+}
+
+/***********************************************************************************************************************
+ * @brief Replace the points of every voxel by their centroid
+ *
+ * Voxels are numbered in the order of their first point, so the result does not depend on hashing. Non-finite points
+ * belong to no voxel.
+ *
+ * @param[in] cloudIn full resolution cloud
+ * @param[out] voxelsOut one point per occupied voxel, with the mean position and color of its points
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void VoxelDownsampler::downsample(const pcl::PointCloud<pcl::PointXYZRGBA> &cloudIn, pcl::PointCloud<pcl::PointXYZRGBA> &voxelsOut)
+{
+    const size_t pointCount = cloudIn.points.size();
+    myVoxelOfPoint.assign(pointCount, -1);
+    myVoxelCount = 0;
+
+    // sums of the coordinates and colors of each voxel, and its point count
+    vector<Eigen::Vector3d> positionSums;
+    vector<Eigen::Vector3i> colorSums;
+    vector<int> counts;
+    unordered_map<uint64_t, int> voxelOfKey;
+    voxelOfKey.reserve(myLeafSize > 0.0f ? pointCount / 4 : 0);
+    positionSums.reserve(myLeafSize > 0.0f ? pointCount / 4 : pointCount);
+
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        const pcl::PointXYZRGBA &point = cloudIn.points[i];
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+        {
+            continue;
+        }
+
+        int voxel = myVoxelCount;
+        if (myLeafSize > 0.0f)
+        {
+            uint64_t key = voxelKey(point.x, point.y, point.z, myLeafSize);
+            voxel = voxelOfKey.insert(make_pair(key, myVoxelCount)).first->second;
+        }
+        if (voxel == myVoxelCount)
+        {
+            positionSums.push_back(Eigen::Vector3d::Zero());
+            colorSums.push_back(Eigen::Vector3i::Zero());
+            counts.push_back(0);
+            myVoxelCount++;
+        }
+
+        positionSums[voxel] += Eigen::Vector3d(point.x, point.y, point.z);
+        colorSums[voxel] += Eigen::Vector3i(point.r, point.g, point.b);
+        counts[voxel]++;
+        myVoxelOfPoint[i] = voxel;
+    }
+
+    voxelsOut.points.resize(myVoxelCount);
+    for (int v = 0; v < myVoxelCount; v++)
+    {
+        pcl::PointXYZRGBA &voxel = voxelsOut.points[v];
+        Eigen::Vector3d position = positionSums[v] / counts[v];
+        voxel.x = (float)position[0];
+        voxel.y = (float)position[1];
+        voxel.z = (float)position[2];
+        voxel.r = (uint8_t)(colorSums[v][0] / counts[v]);
+        voxel.g = (uint8_t)(colorSums[v][1] / counts[v]);
+        voxel.b = (uint8_t)(colorSums[v][2] / counts[v]);
+        voxel.a = 255;
+    }
+    voxelsOut.width = (uint32_t)myVoxelCount;
+    voxelsOut.height = 1;
+    voxelsOut.is_dense = true;
+}
+
+/***********************************************************************************************************************
+ * @brief Map voxel indices to the indices of the points in those voxels
+ * @param[in] voxelIndices indices into the downsampled cloud
+ * @param[out] pointIndices indices into the full resolution cloud, in increasing order
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void VoxelDownsampler::expand(const pcl::PointIndices &voxelIndices, pcl::PointIndices &pointIndices) const
+{
+    vector<pcl::PointIndices> voxelClusters(1, voxelIndices);
+    vector<pcl::PointIndices> pointClusters;
+    expand(voxelClusters, pointClusters);
+    pointIndices.indices.swap(pointClusters[0].indices);
+}
+
+/***********************************************************************************************************************
+ * @brief Map clusters of voxels to clusters of points, in two linear passes over the points
+ * @param[in] voxelClusters clusters of indices into the downsampled cloud, not overlapping
+ * @param[out] pointClusters clusters of indices into the full resolution cloud, in the same order
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void VoxelDownsampler::expand(const vector<pcl::PointIndices> &voxelClusters, vector<pcl::PointIndices> &pointClusters) const
+{
+    vector<int> clusterOfVoxel(myVoxelCount, -1);
+    for (size_t c = 0; c < voxelClusters.size(); c++)
+    {
+        for (size_t i = 0; i < voxelClusters[c].indices.size(); i++)
+        {
+            clusterOfVoxel[voxelClusters[c].indices[i]] = (int)c;
+        }
+    }
+
+    // count the cluster sizes first, so every index list is allocated once
+    vector<size_t> sizes(voxelClusters.size(), 0);
+    for (size_t i = 0; i < myVoxelOfPoint.size(); i++)
+    {
+        if (myVoxelOfPoint[i] >= 0 && clusterOfVoxel[myVoxelOfPoint[i]] >= 0)
+        {
+            sizes[clusterOfVoxel[myVoxelOfPoint[i]]]++;
+        }
+    }
+
+    pointClusters.resize(voxelClusters.size());
+    for (size_t c = 0; c < voxelClusters.size(); c++)
+    {
+        pointClusters[c].indices.clear();
+        pointClusters[c].indices.reserve(sizes[c]);
+    }
+    for (size_t i = 0; i < myVoxelOfPoint.size(); i++)
+    {
+        if (myVoxelOfPoint[i] >= 0 && clusterOfVoxel[myVoxelOfPoint[i]] >= 0)
+        {
+            pointClusters[clusterOfVoxel[myVoxelOfPoint[i]]].indices.push_back((int)i);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ * @brief Get the voxel a point fell into
+ * @param[in] pointIndex index into the full resolution cloud of the last downsample() call
+ * @return index into the downsampled cloud, -1 for non-finite points
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+int VoxelDownsampler::voxelOf(int pointIndex) const
+{
+    return myVoxelOfPoint[pointIndex];
+}
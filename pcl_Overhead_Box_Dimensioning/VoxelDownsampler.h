@@ -0,0 +1,124 @@
+//
+//    Copyright 2023 Viraj V. Sabhaya
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+/*******************************************************************************************************************//**
+ * @file VoxelDownsampler.h
+ * @brief Header file for the VoxelDownsampler class
+ *
+ * This class reduces a point cloud to one point per voxel and maps results on the voxels back to the points
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+
+#ifndef VOXELDOWNSAMPLER_H
+#define VOXELDOWNSAMPLER_H
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+using namespace std;
+
+// voxel keys hold 21 bits per biased cell coordinate, which covers +-20 km at a 2 cm leaf size
+#define VOXEL_KEY_BITS 21
+#define VOXEL_KEY_BIAS ((int64_t)1 << (VOXEL_KEY_BITS - 1))
+#define VOXEL_KEY_MASK (((uint64_t)1 << VOXEL_KEY_BITS) - 1)
+
+/*******************************************************************************************************************//**
+ * @brief Pack the coordinates of a grid cell into a hash key
+ * @param[in] x cell x coordinate
+ * @param[in] y cell y coordinate
+ * @param[in] z cell z coordinate
+ * @return key, unique for coordinates within +-2^20
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+inline uint64_t voxelKey(int64_t x, int64_t y, int64_t z)
+{
+    return ((uint64_t)(x + VOXEL_KEY_BIAS) & VOXEL_KEY_MASK) | (((uint64_t)(y + VOXEL_KEY_BIAS) & VOXEL_KEY_MASK) << VOXEL_KEY_BITS) |
+           (((uint64_t)(z + VOXEL_KEY_BIAS) & VOXEL_KEY_MASK) << (2 * VOXEL_KEY_BITS));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Get the key of the voxel holding a point
+ * @param[in] x point x coordinate
+ * @param[in] y point y coordinate
+ * @param[in] z point z coordinate
+ * @param[in] leafSize voxel edge length
+ * @return key of the voxel
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+inline uint64_t voxelKey(float x, float y, float z, float leafSize)
+{
+    return voxelKey((int64_t)floor(x / leafSize), (int64_t)floor(y / leafSize), (int64_t)floor(z / leafSize));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Unpack the cell coordinates of a key made by voxelKey()
+ * @param[in] key voxel key
+ * @param[out] x cell x coordinate
+ * @param[out] y cell y coordinate
+ * @param[out] z cell z coordinate
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+inline void voxelCell(uint64_t key, int64_t &x, int64_t &y, int64_t &z)
+{
+    x = (int64_t)(key & VOXEL_KEY_MASK) - VOXEL_KEY_BIAS;
+    y = (int64_t)((key >> VOXEL_KEY_BITS) & VOXEL_KEY_MASK) - VOXEL_KEY_BIAS;
+    z = (int64_t)((key >> (2 * VOXEL_KEY_BITS)) & VOXEL_KEY_MASK) - VOXEL_KEY_BIAS;
+}
+
+/*******************************************************************************************************************//**
+ * @class VoxelDownsampler
+ *
+ * @brief Voxel grid downsampling that remembers which voxel every point fell into
+ *
+ * Each occupied voxel of a grid with the given leaf size is replaced by the centroid of its points, as with
+ * pcl::VoxelGrid, in a single hashed pass over the cloud. The voxel of every input point is kept, so index lists
+ * computed on the downsampled cloud, such as plane inliers or clusters, can be expanded to the full resolution points
+ * in linear time. Expensive steps (RANSAC, KdTree search) then run on the voxels, and only the final measurement
+ * sees every point.
+ *
+ * A leaf size of 0 makes the downsampled cloud a copy of the input, and expansion the identity.
+ *
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+class VoxelDownsampler
+{
+private:
+
+    float myLeafSize;
+    vector<int> myVoxelOfPoint;
+    int myVoxelCount;
+
+public:
+
+    // constructors
+    VoxelDownsampler(float leafSize=0.0f);
+
+    // configuration
+    void setLeafSize(float leafSize);
+    float leafSize() const;
+
+    // downsampling
+    void downsample(const pcl::PointCloud<pcl::PointXYZRGBA> &cloudIn, pcl::PointCloud<pcl::PointXYZRGBA> &voxelsOut);
+    void expand(const pcl::PointIndices &voxelIndices, pcl::PointIndices &pointIndices) const;
+    void expand(const vector<pcl::PointIndices> &voxelClusters, vector<pcl::PointIndices> &pointClusters) const;
+    int voxelOf(int pointIndex) const;
+};
+
+#endif // VOXELDOWNSAMPLER_H
@@ -15,125 +15,38 @@
 //    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include "BoxPipeline.h"
 #include "CloudVisualizer.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+
 // using this for: Creating point clouds and using those PCL
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
-// using this for: Reading PLY file
-#include <pcl/io/pcd_io.h>
-#include <pcl/io/ply_io.h>
-
 // using this for: to measure time
 #include <pcl/common/time.h>
 
-// using this for: to find min and max points from point cloud
-#include <pcl/common/common.h>
-
-// using this for: plane segmentation
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/sac_model_plane.h>
-
-// using this for: to seperate out the clusters formed.
-// Clusters here are point clouds of each box respectivley.
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/segmentation/extract_clusters.h>
-
 // using this for: to store the data points
 #include <pcl/ModelCoefficients.h>
-#include <pcl/filters/extract_indices.h>
 #include <pcl/features/normal_3d.h>
 
-// using this for: used for tracking the points quickly
-#include <pcl/kdtree/kdtree.h>
-
 #define NUM_COMMAND_ARGS 1
+#define FRAME_BUDGET_MS 33
+#define POLL_INTERVAL_MS 5
 
 using namespace std;
 using namespace pcl;
 
-/***********************************************************************************************************************
- * @brief Opens a point cloud file
- *
- * Opens a point cloud file in either PCD or PLY format
- *
- * @param[out] cloudOut pointer to opened point cloud
- * @param[in] filename path and name of input file
- * @return false if an error occurred while opening file
- * @author Christopher D. McMurrough
- **********************************************************************************************************************/
-bool openCloud(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudOut, const char *fileName)
-{
-    // convert the file name to string
-    string fileNameStr(fileName);
-
-    // handle various file types
-    string fileExtension = fileNameStr.substr(fileNameStr.find_last_of(".") + 1);
-    if (fileExtension.compare("pcd") == 0)
-    {
-        // attempt to open the file
-        if (pcl::io::loadPCDFile<pcl::PointXYZRGBA>(fileNameStr, *cloudOut) == -1)
-        {
-            PCL_ERROR("error while attempting to read pcd file: %s \n", fileNameStr.c_str());
-            return false;
-        }
-        else
-        {
-            return true;
-        }
-    }
-    else if (fileExtension.compare("ply") == 0)
-    {
-        // attempt to open the file
-        if (pcl::io::loadPLYFile<pcl::PointXYZRGBA>(fileNameStr, *cloudOut) == -1)
-        {
-            PCL_ERROR("error while attempting to read pcl file: %s \n", fileNameStr.c_str());
-            return false;
-        }
-        else
-        {
-            return true;
-        }
-    }
-    else
-    {
-        PCL_ERROR("error while attempting to read unsupported file: %s \n", fileNameStr.c_str());
-        return false;
-    }
-}
-
-/*******************************************************************************************************************/ /**
-                                                                                                                       * @brief Locate a plane in the cloud
-                                                                                                                       *
-                                                                                                                       * Perform planar segmentation using RANSAC, returning the plane parameters and point indices
-                                                                                                                       *
-                                                                                                                       * @param[in] cloudIn pointer to input point cloud
-                                                                                                                       * @param[out] inliers list containing the point indices of inliers
-                                                                                                                       * @param[in] distanceThreshold maximum distance of a point to the planar model to be considered an inlier
-                                                                                                                       * @param[in] maxIterations maximum number of iterations to attempt before returning
-                                                                                                                       * @return the number of inliers
-                                                                                                                       * @author Christopher D. McMurrough
-                                                                                                                       **********************************************************************************************************************/
-void segmentPlane(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn, pcl::PointIndices::Ptr &inliers, double distanceThreshold, int maxIterations)
-{
-    // store the model coefficients
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-
-    // Create the segmentation object for the planar model and set the parameters
-    pcl::SACSegmentation<pcl::PointXYZRGBA> seg;
-    seg.setOptimizeCoefficients(true);
-    seg.setModelType(pcl::SACMODEL_PLANE);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(maxIterations);
-    seg.setDistanceThreshold(distanceThreshold);
-
-    // Segment the largest planar component from the remaining cloud
-    seg.setInputCloud(cloudIn);
-    seg.segment(*inliers, *coefficients);
-}
-
 /***********************************************************************************************************************
  * @brief callback function for handling a point picking event
  * @param[in] event handle generated by the visualization window
@@ -187,138 +100,296 @@ void keyboardCallback(const pcl::visualization::KeyboardEvent &event, void *view
     }
 }
 
-int main(int argc, char **argv)
+/***********************************************************************************************************************
+ * @brief List the point cloud files of a directory
+ * @param[in] directory path of the directory
+ * @param[out] fileNames paths of the PLY, PCD and PGM depth image files, sorted by name
+ * @return false if the path is not a directory
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool listClouds(const string &directory, vector<string> &fileNames)
 {
-    // validate and parse the command line arguments
-    if (argc != NUM_COMMAND_ARGS + 1)
+    fileNames.clear();
+    DIR *dir = opendir(directory.c_str());
+    if (dir == NULL)
     {
-        printf("USAGE: %s <file_name>\n", argv[0]);
-        return 0;
+        return false;
     }
 
-    // parse the command line arguments
-    char *fileName = argv[1];
-
-    // create a stop watch for measuring time
-    StopWatch watch;
-
-    // initialize the cloud viewer
-    CloudVisualizer CV("Rendering Window");
-
-    // start timing the processing step
-    watch.reset();
-
-    // open the point cloud
-    PointCloud<PointXYZRGBA>::Ptr cloud(new PointCloud<PointXYZRGBA>);
-    openCloud(cloud, fileName);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        string name(entry->d_name);
+        string extension = name.size() > 4 ? name.substr(name.size() - 4) : "";
+        if (extension == ".ply" || extension == ".pcd" || extension == ".pgm")
+        {
+            fileNames.push_back(directory + "/" + name);
+        }
+    }
+    closedir(dir);
+    sort(fileNames.begin(), fileNames.end());
+    return true;
+}
 
-    // creating a copy of the cloud so that we can save the table which is later filtered out to obtain the boxes
-    PointCloud<PointXYZRGBA>::Ptr copiedCloud(new PointCloud<PointXYZRGBA>(*cloud));
+/***********************************************************************************************************************
+ * @brief Show the table and the boxes of the last frame
+ *
+ * The cloud is added on the first frame and updated in place afterwards, the box outlines are replaced.
+ *
+ * @param[in] CV viewer to draw in
+ * @param[in] pipeline pipeline holding the frame
+ * @param[in] mergedCloud cloud shown in the viewer, rebuilt for the frame
+ * @param[in] firstFrame true if nothing was shown yet
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+void showFrame(CloudVisualizer &CV, BoxPipeline &pipeline, PointCloud<PointXYZRGBA>::Ptr &mergedCloud, bool firstFrame)
+{
+    // color the table and the boxes into the displayed cloud
+    pipeline.colorize(*mergedCloud);
 
-    // creating a point cloud to merge both views
-    PointCloud<PointXYZRGBA>::Ptr mergedCloud(new PointCloud<PointXYZRGBA>); 
+    // render the scene
+    if (firstFrame)
+    {
+        CV.addCloud(mergedCloud);
+        CV.addCoordinateFrame(mergedCloud->sensor_origin_, mergedCloud->sensor_orientation_);
+    }
+    else
+    {
+        CV.updateCloud(mergedCloud);
+        CV.removeAllShapes();
+    }
 
-    // segment a plane
-    const float distanceThreshold = 0.02;
-    const int maxIterations = 5000;
-    PointIndices::Ptr inliers(new PointIndices);
-    segmentPlane(copiedCloud, inliers, distanceThreshold, maxIterations);
-    cout << "Segmentation result: " << inliers->indices.size() << " points" << endl;
+    const vector<BoxDimensions> &boxes = pipeline.boxes();
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+        Eigen::Matrix3f rotation;
+        rotation << boxes[b].lengthAxis, boxes[b].widthAxis, boxes[b].normal;
+        stringstream id;
+        id << "box" << b;
+        CV.addBox(boxes[b].center, Eigen::Quaternionf(rotation), boxes[b].length, boxes[b].width, boxes[b].height, 255.0, 255.0, 255.0, 1.0, 2.0, false, id.str());
+    }
+}
 
-    // coloring the tabletop to blue color
-    for (int i = 0; i < copiedCloud->points.size(); ++i)
+/***********************************************************************************************************************
+ * @brief Measure the boxes of one capture, print them and show them if a viewer is attached
+ * @param[in] pipeline pipeline to run
+ * @param[in] fileName PLY or PCD file of the capture
+ * @param[in] frame frame number, from 1
+ * @param[in] budget latency budget in milliseconds
+ * @param[in] CV viewer, or NULL to run without one
+ * @param[in] mergedCloud cloud shown in the viewer
+ * @return true if the frame was processed
+ * @author Viraj V. Sabhaya
+ **********************************************************************************************************************/
+bool processFrame(BoxPipeline &pipeline, const string &fileName, int frame, double budget, CloudVisualizer *CV, PointCloud<PointXYZRGBA>::Ptr &mergedCloud)
+{
+    if (!pipeline.process(fileName))
     {
-        copiedCloud->points[i].r = 0;
-        copiedCloud->points[i].g = 0;
-        copiedCloud->points[i].b = 255;
+        return false;
     }
 
-    // merging the table to the point cloud
-    *mergedCloud = *copiedCloud;
+    StopWatch watch;
+    if (CV != NULL)
+    {
+        showFrame(*CV, pipeline, mergedCloud, frame == 1);
+    }
+    double displayTime = watch.getTime();
+
+    const ModelCoefficients &plane = pipeline.plane();
+    const vector<BoxDimensions> &boxes = pipeline.boxes();
+    cout << "FRAME " << frame << ": " << fileName << ", " << pipeline.cloud()->points.size() << " points, "
+         << boxes.size() << " boxes" << endl;
+    cout << "Table plane: " << plane.values[0] << " " << plane.values[1] << " " << plane.values[2] << " "
+         << plane.values[3] << (pipeline.usedPlaneHint() ? " (hint)" : " (RANSAC)") << endl;
+    for (size_t j = 0; j < boxes.size(); j++)
+    {
+        cout << "BOX " << j + 1 << ": " << boxes[j].length << " " << boxes[j].width << " " << boxes[j].height << endl;
+    }
 
-    // removing the planar inliers from input cloud
-    ExtractIndices<PointXYZRGBA> extract;
-    extract.setInputCloud(cloud);
-    extract.setIndices(inliers);
-    extract.setNegative(true);
-    extract.filter(*cloud);
+    const PipelineTimes &times = pipeline.times();
+    double latency = times.total + displayTime;
+    cout << "Step times [ms]: load " << times.load << ", downsample " << times.downsample << ", plane " << times.plane
+         << ", extract " << times.extract << ", kdtree " << times.tree << ", clustering " << times.clustering
+         << ", measurement " << times.measurement << ", display " << displayTime << ", latency " << latency << endl;
+    if (latency > budget)
+    {
+        cout << "FRAME " << frame << " is over the latency budget of " << budget << " ms" << endl;
+    }
+    return true;
+}
 
-    // Create the KdTree object for the search method of the extraction
-    search::KdTree<PointXYZRGBA>::Ptr tree(new search::KdTree<PointXYZRGBA>);
-    tree->setInputCloud(cloud);
+int main(int argc, char **argv)
+{
+    // validate and parse the command line arguments
+    if (argc < NUM_COMMAND_ARGS + 1)
+    {
+        printf("USAGE: %s <file_name|directory> [<file_name> ...] [--budget <ms>] [--no-viewer] [--clustering kdtree|grid] [--max-depth <meters>] [--leaf <meters>] [--voxel <meters>] [--plane <a> <b> <c> <d>] [--crop <min_x> <min_y> <min_z> <max_x> <max_y> <max_z>] [--intrinsics <fx> <fy> <cx> <cy> <depth_scale>]\n", argv[0]);
+        return 0;
+    }
 
-    vector<PointIndices> clusterIndices;
+    // parse the command line arguments, the region of interest and subsampling are applied while loading
+    vector<string> inputs;
+    CloudReader reader;
+    BoxPipeline pipeline;
+    double budget = FRAME_BUDGET_MS;
+    bool showViewer = true;
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 2, "--") != 0)
+        {
+            inputs.push_back(option);
+        }
+        else if (option == "--budget" && i + 1 < argc)
+        {
+            budget = atof(argv[++i]);
+        }
+        else if (option == "--no-viewer")
+        {
+            showViewer = false;
+        }
+        else if (option == "--clustering" && i + 1 < argc)
+        {
+            string backend(argv[++i]);
+            if (backend != "kdtree" && backend != "grid")
+            {
+                printf("unknown clustering backend: %s\n", backend.c_str());
+                return 0;
+            }
+            pipeline.setClusteringBackend(backend == "grid" ? CLUSTERING_GRID : CLUSTERING_KDTREE);
+        }
+        else if (option == "--max-depth" && i + 1 < argc)
+        {
+            reader.setDepthRange(0.0f, (float)atof(argv[++i]));
+        }
+        else if (option == "--leaf" && i + 1 < argc)
+        {
+            reader.setLeafSize((float)atof(argv[++i]));
+        }
+        else if (option == "--voxel" && i + 1 < argc)
+        {
+            pipeline.setVoxelLeafSize((float)atof(argv[++i]));
+        }
+        else if (option == "--plane" && i + 4 < argc)
+        {
+            // table plane printed by an earlier run, tried before searching
+            pipeline.setPlaneHint(Eigen::Vector4f((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]), (float)atof(argv[i + 4])));
+            i += 4;
+        }
+        else if (option == "--crop" && i + 6 < argc)
+        {
+            Eigen::Vector3f minPoint((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]));
+            Eigen::Vector3f maxPoint((float)atof(argv[i + 4]), (float)atof(argv[i + 5]), (float)atof(argv[i + 6]));
+            reader.setCropBox(minPoint, maxPoint);
+            i += 6;
+        }
+        else if (option == "--intrinsics" && i + 5 < argc)
+        {
+            // camera of the PGM depth images, the depth scale is the size in meters of one depth unit
+            reader.setIntrinsics((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]), (float)atof(argv[i + 4]), (float)atof(argv[i + 5]));
+            i += 5;
+        }
+        else
+        {
+            printf("unknown option: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    pipeline.setReader(reader);
 
-    // creating the euclidian cluster extraction object
-    EuclideanClusterExtraction<PointXYZRGBA> ec;
-    ec.setClusterTolerance(0.02); // distance between two clusters
-    ec.setMinClusterSize(5000);
-    ec.setMaxClusterSize(100000);
-    ec.setSearchMethod(tree);
-    ec.setInputCloud(cloud);
+    // a single directory is watched for new captures, standing in for the camera
+    vector<string> fileNames;
+    bool watching = inputs.size() == 1 && listClouds(inputs[0], fileNames);
+    if (!watching)
+    {
+        fileNames = inputs;
+    }
 
-    ec.extract(clusterIndices);
-    std::cout << "Clusters identified: " << clusterIndices.size() << std::endl;
+    // initialize the cloud viewer
+    unique_ptr<CloudVisualizer> CV(showViewer ? new CloudVisualizer("Rendering Window") : NULL);
+    PointCloud<PointXYZRGBA>::Ptr mergedCloud(new PointCloud<PointXYZRGBA>);
+    if (CV)
+    {
+        // register mouse and keyboard event callbacks
+        CV->registerPointPickingCallback(pointPickingCallback, mergedCloud);
+        CV->registerKeyboardCallback(keyboardCallback);
+    }
 
-    int j = 0;
-    vector<PointIndices>::const_iterator i;
-    for (i = clusterIndices.begin(); i != clusterIndices.end(); ++i)
+    int frame = 0;
+    if (!watching)
     {
-        PointCloud<PointXYZRGBA>::Ptr cloud_cluster(new PointCloud<PointXYZRGBA>);
-        for (vector<int>::const_iterator k = i->indices.begin(); k != i->indices.end(); ++k)
+        // process the captures in the given order
+        for (size_t f = 0; f < fileNames.size() && (!CV || CV->isRunning()); f++)
         {
-            cloud_cluster->points.push_back(cloud->points[*k]); 
-            if (j == 0) // FIRST BOX
+            if (processFrame(pipeline, fileNames[f], frame + 1, budget, CV.get(), mergedCloud))
             {
-                // Color the first box green
-                cloud->points[*k].r = 0;
-                cloud->points[*k].g = 255;
-                cloud->points[*k].b = 0;
+                frame++;
             }
-            else if (j > 0 && j <= 1) //
+            if (CV)
             {
-                cloud->points[*k].r = 255;
-                cloud->points[*k].g = 0;
-                cloud->points[*k].b = 0;
+                CV->spin(1);
             }
         }
 
-        // finding the minimum and max. point on each side
-        PointXYZRGBA minPt, maxPt;
-        getMinMax3D(*cloud_cluster, minPt, maxPt);
-
-        float length = maxPt.x - minPt.x;
-        float width = maxPt.y - minPt.y;
-        float height = maxPt.z - minPt.z;
-
-        cout << "BOX " << j + 1 << ": " << length << " " << width << " " << height << endl;
-
-        // merging the colored boxes to the point cloud
-        *mergedCloud += *cloud;
-
-        j++;
+        // enter visualization loop
+        while (CV && CV->isRunning())
+        {
+            CV->spin(100);
+        }
+        return 0;
     }
 
-    // get the elapsed time
-    double elapsedTime = watch.getTimeSeconds();
-    cout << elapsedTime << " seconds passed " << endl;
-
-    // render the scene
-    // CV.addCloud(cloud);
-    // CV.addCloud(copiedCloud);
-    CV.addCloud(mergedCloud);
-    CV.addCoordinateFrame(mergedCloud->sensor_origin_, mergedCloud->sensor_orientation_);
+    // files present at startup are old captures, a new file is read once its size stops changing between two polls,
+    // and when several are ready only the latest is processed to stay within the latency budget
+    cout << "Watching " << inputs[0] << " for new captures" << endl;
+    set<string> seen(fileNames.begin(), fileNames.end());
+    map<string, off_t> pendingSizes;
+    while (!CV || CV->isRunning())
+    {
+        listClouds(inputs[0], fileNames);
+        vector<string> ready;
+        for (size_t f = 0; f < fileNames.size(); f++)
+        {
+            struct stat status;
+            if (seen.count(fileNames[f]) || stat(fileNames[f].c_str(), &status) != 0)
+            {
+                continue;
+            }
+            map<string, off_t>::iterator pending = pendingSizes.find(fileNames[f]);
+            if (pending != pendingSizes.end() && pending->second == status.st_size)
+            {
+                ready.push_back(fileNames[f]);
+                pendingSizes.erase(pending);
+                seen.insert(fileNames[f]);
+            }
+            else
+            {
+                pendingSizes[fileNames[f]] = status.st_size;
+            }
+        }
 
-    // register mouse and keyboard event callbacks
-    CV.registerPointPickingCallback(pointPickingCallback, cloud);
-    CV.registerKeyboardCallback(keyboardCallback);
+        if (!ready.empty())
+        {
+            if (ready.size() > 1)
+            {
+                cout << "Skipped " << ready.size() - 1 << " stale captures" << endl;
+            }
+            if (processFrame(pipeline, ready.back(), frame + 1, budget, CV.get(), mergedCloud))
+            {
+                frame++;
+            }
+        }
 
-    // enter visualization loop
-    while (CV.isRunning())
-    {
-        CV.spin(100);
+        if (CV)
+        {
+            CV->spin(POLL_INTERVAL_MS);
+        }
+        else
+        {
+            this_thread::sleep_for(chrono::milliseconds(POLL_INTERVAL_MS));
+        }
     }
 
     // exit program
     return 0;
-}
\ No newline at end of file
+}